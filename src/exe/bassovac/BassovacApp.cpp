@@ -2,38 +2,85 @@
 #include "bvprob/Bassovac.hpp"
 #include "bvprob/Fasta.hpp"
 #include "bvprob/PBin.hpp"
+#include "bvprob/ReferenceWindow.hpp"
 #include "bvprob/ResultFormatter.hpp"
 #include "bvprob/Sample.hpp"
+#include "bvprob/UnknownSequenceError.hpp"
 #include "io/BamFilter.hpp"
 #include "io/BamReader.hpp"
+#include "io/DownsamplingBamReader.hpp"
+#include "io/MappedBamReader.hpp"
+#include "io/MergingBamReader.hpp"
 #include "io/Pileup.hpp"
+#include "io/PipelinedBamReader.hpp"
+#include "io/RegionChunker.hpp"
 #include "io/RegionLimitedBamReader.hpp"
+#include "io/SiteSummary.hpp"
+#include "io/TargetRegions.hpp"
+#include "io/TumorDrivenIntersector.hpp"
+#include "utility/BoundedQueue.hpp"
 #include "utility/Lut.hpp"
+#include "utility/OrderedTaskRunner.hpp"
+#include "utility/ThreadPool.hpp"
 #include "version.h"
 
 #include <bam.h>
 #include <boost/program_options.hpp>
 
+#include <algorithm>
 #include <cmath>
 #include <cstdint>
 #include <ctime>
+#include <exception>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
 using namespace std;
 using namespace std::placeholders;
 namespace po = boost::program_options;
 
+namespace {
+    // batch and queue sizes for --pipeline. entries and sites are passed
+    // between threads in batches to keep synchronization off the hot path.
+    const size_t ENTRY_BATCH_SIZE = 256;
+    const size_t ENTRY_QUEUE_SIZE = 16;
+    const size_t SITE_BATCH_SIZE = 256;
+    const size_t SITE_QUEUE_SIZE = 16;
+
+    void reportQueue(ostream& out, char const* name, QueueStats const& stats) {
+        out << "  " << setw(14) << left << name << right
+            << " mean " << fixed << setprecision(2) << stats.meanOccupancy()
+            << " / max " << stats.maxOccupancy
+            << " of " << stats.capacity
+            << " batches, producer waited " << stats.fullWaits
+            << "x, consumer waited " << stats.emptyWaits << "x\n";
+    }
+}
+
 BassovacApp::BassovacApp(int& argc, char** argv)
     : _fixedPoint(false)
+    , _pipeline(false)
     , _normalVariantFrequency(0.5)
     , _tumorVariantFrequency(0.5)
     , _minBaseQual(0)
+    , _minNormalDepth(1)
+    , _minTumorDepth(1)
     , _maxBins(2)
     , _maxDepth(1000000)
+    , _threads(1)
+    , _chunkSize(1000000)
+    , _inflateThreads(0)
+    , _seekGap(BamIntersector::DEFAULT_SEEK_GAP)
+    , _downsampleDepth(0)
+    , _downsampleSeed(0)
+    , _nativeBamReader(false)
+    , _tumorDriven(false)
 {
 
     po::options_description helpOpts("Help");
@@ -44,9 +91,9 @@ BassovacApp::BassovacApp(int& argc, char** argv)
 
     po::options_description requiredOpts("Required Arguments");
     requiredOpts.add_options()
-        ("fasta,f", po::value<string>(&_fasta), "fasta of reference sequence")
-        ("normal-bam,n", po::value<string>(&_normalBam), "sorted .bam/.sam file containing normal reads")
-        ("tumor-bam,t", po::value<string>(&_tumorBam), "sorted .bam/.sam file containing tumor reads")
+        ("fasta,f", po::value<string>(&_fasta), "fasta of reference sequence, plain or bgzip compressed (a .gzi next to it is used if present), or a .2bit version of it (bassovac fasta-to-2bit <in.fa> <out.2bit> makes one)")
+        ("normal-bam,n", po::value<vector<string>>(&_normalBams)->multitoken(), "sorted .bam/.sam file(s) containing normal reads, or - to read bam from stdin. several files are merged as they are read")
+        ("tumor-bam,t", po::value<vector<string>>(&_tumorBams)->multitoken(), "sorted .bam/.sam file(s) containing tumor reads, or - to read bam from stdin. several files are merged as they are read")
         ("normal-purity", po::value<double>(&_normalPurity), "normal purity")
         ("tumor-purity", po::value<double>(&_tumorPurity), "tumor purity")
         ("tumor-mass-fraction,u", po::value<double>(&_tumorMassFraction)->default_value(1.0), "tumor mass fraction")
@@ -57,11 +104,15 @@ BassovacApp::BassovacApp(int& argc, char** argv)
         ("region,R",
             po::value<string>(&_bamRegionString),
             "Region to call variants in (e.g., 20:15000000-20000000)")
+        ("targets", po::value<string>(&_targetsFile),
+            "bed file of regions to call variants in. overlapping intervals are merged and all of them are read in a single pass over each bam, which must be indexed")
 
         ("output-file,o", po::value<string>(&_outputFile), "output file (empty or - means stdout, which is the default)")
         ("bins,b", po::value<uint32_t>(&_maxBins)->default_value(2), "maximum number of p-value bins to use")
         ("min-mapqual,q", po::value<uint32_t>(&_minMapQual)->default_value(0), "minimum mapping quality for reads")
         ("min-basequal,Q", po::value<uint32_t>(&_minBaseQual)->default_value(0), "minimum base quality for bases to be considered")
+        ("min-normal-depth", po::value<uint32_t>(&_minNormalDepth)->default_value(1), "minimum number of normal reads covering a site for it to be called")
+        ("min-tumor-depth", po::value<uint32_t>(&_minTumorDepth)->default_value(1), "minimum number of tumor reads covering a site for it to be called")
         ("min-somatic-pvalue,s", po::value<double>(&_minSomaticPvalue)->default_value(0.0), "minimum somatic pvalue for output to be displayed")
 //        ("normal-var-freq", po::value<double>(&_normalVariantFrequency)->default_value(0.5), "normal variant frequency")
 //        ("tumor-var-freq", po::value<double>(&_tumorVariantFrequency)->default_value(0.5), "tumor variant frequency")
@@ -71,6 +122,15 @@ BassovacApp::BassovacApp(int& argc, char** argv)
         ("precision,p", po::value<uint32_t>(&_fpPrecision)->default_value(6), "floating point precision of output")
         ("fixed,x", "use fixed point notation (default=scientific)")
         ("max-depth,m", po::value<uint32_t>(&_maxDepth), "maximum expected read depth at any given position (used for optimization)")
+        ("threads", po::value<uint32_t>(&_threads)->default_value(1), "number of worker threads. values > 1 split the genome into chunks and require indexed bam files")
+        ("chunk-size", po::value<uint32_t>(&_chunkSize)->default_value(1000000), "number of bases in each chunk of work when --threads > 1")
+        ("decompress-threads", po::value<uint32_t>(&_inflateThreads)->default_value(0), "number of threads shared by all bam readers for decompressing ahead of them (0 decompresses on the reading thread)")
+        ("seek-gap", po::value<uint32_t>(&_seekGap)->default_value(BamIntersector::DEFAULT_SEEK_GAP), "when the reads of one bam fall this many bases behind the other's, skip ahead through its index instead of reading through them (0 never skips)")
+        ("downsample-depth", po::value<uint32_t>(&_downsampleDepth)->default_value(0), "keep at most this many reads covering any position, choosing those to keep by a seeded hash of their names, and report the number dropped at each site in two extra output fields (0 keeps every read)")
+        ("downsample-seed", po::value<uint32_t>(&_downsampleSeed)->default_value(0), "seed of the hash choosing the reads kept by --downsample-depth")
+        ("native-bam-reader", "read bam files through memory mapped buffers with the built in reader instead of samtools")
+        ("pipeline", "decode bam files and write output on separate threads, overlapping i/o with computation")
+        ("tumor-driven", "read the whole tumor bam, but only read the normal bam around sites where tumor reads differ from the reference. sites where only normal reads differ are not reported. requires an indexed normal bam")
     ;
 
     po::options_description allOpts("All Options");
@@ -108,6 +168,27 @@ BassovacApp::BassovacApp(int& argc, char** argv)
     if (vm.count("fixed"))
         _fixedPoint = true;
 
+    if (vm.count("native-bam-reader"))
+        _nativeBamReader = true;
+
+    if (vm.count("pipeline"))
+        _pipeline = true;
+
+    if (vm.count("tumor-driven"))
+        _tumorDriven = true;
+
+    if (_pipeline && _threads > 1)
+        throw runtime_error("Error: --pipeline can not be combined with --threads");
+
+    if (_pipeline && _tumorDriven)
+        throw runtime_error("Error: --pipeline can not be combined with --tumor-driven");
+
+    if (!_targetsFile.empty() && !_bamRegionString.empty())
+        throw runtime_error("Error: --targets can not be combined with --region");
+
+    if (_chunkSize == 0)
+        throw runtime_error("Error: --chunk-size must be greater than 0");
+
     vector<string> requiredArguments = { "fasta", "normal-bam", "tumor-bam", "normal-purity", "tumor-purity" };
 
     for (auto iter = requiredArguments.begin(); iter != requiredArguments.end(); ++iter) {
@@ -117,101 +198,379 @@ BassovacApp::BassovacApp(int& argc, char** argv)
             throw runtime_error(ss.str());
         }
     }
+
+    // streams (stdin, pipes) are read once, in order, and have no index
+    bool normalStream = any_of(_normalBams.begin(), _normalBams.end(), BamReader::isStream);
+    bool tumorStream = any_of(_tumorBams.begin(), _tumorBams.end(), BamReader::isStream);
+    if (count(_normalBams.begin(), _normalBams.end(), "-") + count(_tumorBams.begin(), _tumorBams.end(), "-") > 1)
+        throw runtime_error("Error: only one of the bams can be read from stdin");
+
+    if (normalStream || tumorStream) {
+        if (_threads > 1)
+            throw runtime_error("Error: --threads can not be used with a bam read from a stream");
+        if (_nativeBamReader)
+            throw runtime_error("Error: --native-bam-reader can not be used with a bam read from a stream");
+        if (!_bamRegionString.empty())
+            throw runtime_error("Error: --region can not be used with a bam read from a stream");
+        if (!_targetsFile.empty())
+            throw runtime_error("Error: --targets can not be used with a bam read from a stream");
+    }
+
+    if (normalStream && _tumorDriven)
+        throw runtime_error("Error: --tumor-driven needs an indexed normal bam, not a stream");
 }
 
 BassovacApp::~BassovacApp() {
 }
 
-void BassovacApp::resultCb(int32_t pos, const Pileup& normal, const Pileup& tumor) {
-    const char* sequenceName = _normalReader->targetName(normal[0].tid);
-    int ref;
-    try {
-        ref = bam_nt16_table[int(_refSeq->sequence(sequenceName, pos+1))];
-    } catch (const length_error& e) {
-        cerr << "Pileup error, probably due to alignments hanging off the end of a sequence:\n\t" << e.what() << "\n";
-        return;
-    }
+void BassovacApp::resultCb(
+        ResultFormatter& formatter,
+        ReferenceWindow& reference,
+        BamReaderBase const& reader,
+        int32_t pos,
+        const Pileup& normal,
+        const Pileup& tumor
+        )
+{
+    SiteResult result;
+    if (callSite(reference, reader, pos, normal, tumor, result))
+        formatter.printResult(result);
+}
 
-    uint32_t nSupporting = normal.readsMatching(ref, _minBaseQual);
-    uint32_t tSupporting = tumor.readsMatching(ref, _minBaseQual);
-    if (nSupporting == normal.size() && tSupporting == tumor.size()) {
-        return;
+bool BassovacApp::callSite(
+        ReferenceWindow& reference,
+        BamReaderBase const& reader,
+        int32_t pos,
+        const Pileup& normal,
+        const Pileup& tumor,
+        SiteResult& result
+        )
+{
+    const char* sequenceName = reader.targetName(normal.tid());
+    Fasta::Contig const& contig = _contigs[normal.tid()];
+    if (!contig.valid())
+        throw UnknownSequenceError("Sequence '" + string(sequenceName) + "' not found in fasta '" + _fasta + "'");
+
+    int ref = reference.base(normal.tid(), pos);
+    if (ref < 0) {
+        cerr << "Pileup error, probably due to alignments hanging off the end of a sequence:\n\t"
+            << "Request for " << sequenceName << ":" << pos + 1 << "-" << pos + 2
+            << " in " << _fasta << ", but " << sequenceName << " has length " << contig.length() << "\n";
+        return false;
     }
 
-    // compute base counts and variant alleles
-    int nBaseCounts[4];
-    int tBaseCounts[4];
-    normal.baseCounts(nBaseCounts);
-    tumor.baseCounts(tBaseCounts);
-    int nVariant = Pileup::variantAllele(ref, nBaseCounts);
-    int tVariant = Pileup::variantAllele(ref, tBaseCounts);
+    // one pass over each pileup gathers everything below
+    SiteSummary nSummary;
+    SiteSummary tSummary;
+    nSummary.summarize(normal, ref, _minBaseQual);
+    tSummary.summarize(tumor, ref, _minBaseQual);
+    if (nSummary.supporting == normal.size() && tSummary.supporting == tumor.size()) {
+        return false;
+    }
 
+    int nVariant = Pileup::variantAllele(ref, nSummary.baseCounts);
+    int tVariant = Pileup::variantAllele(ref, tSummary.baseCounts);
 
-    // TODO: have the Sample objects create the bins to avoid extra copying
-    vector<uint8_t> nErr = normal.baseQualities(_minBaseQual);
-    vector<uint8_t> tErr = tumor.baseQualities(_minBaseQual);
-    if (nErr.empty() || tErr.empty())
-        return;
+    if (nSummary.qualified == 0 || tSummary.qualified == 0)
+        return false;
 
     Sample nSample;
     Sample tSample;
     nSample.setValues(
-        nErr.size(),
-        nSupporting,
+        nSummary.qualified,
+        nSummary.supporting,
         _normalVariantFrequency,
         _normalPurity,
         _tumorMassFraction*(1.0-_normalPurity), // adjusted normal purity complement
-        &nErr[0],
-        nErr.size(),
+        nSummary.qualityHistogram,
         _maxBins
         );
 
     tSample.setValues(
-        tErr.size(),
-        tSupporting,
+        tSummary.qualified,
+        tSummary.supporting,
         _tumorVariantFrequency,
         _tumorMassFraction*_tumorPurity, // adjusted tumor purity
         1.0-_tumorPurity, // adjusted tumor purity complement
-        &tErr[0],
-        tErr.size(),
+        tSummary.qualityHistogram,
         _maxBins
         );
 
     Bassovac bv(nSample, tSample, _normalHetVariantRate, _normalHomVariantRate, _tumorBgMutationRate);
 
     if (bv.somaticVariantProbability() < _minSomaticPvalue) {
-        return;
+        return false;
     }
 
-    _formatter->printResult(
+    result = SiteResult(
         sequenceName,
         pos,
         ref,
         nVariant,
         tVariant,
-        nBaseCounts,
-        tBaseCounts,
+        nSummary.baseCounts,
+        tSummary.baseCounts,
         nSample,
         tSample,
         bv
         );
+    result.nDroppedReads = normal.dropped();
+    result.tDroppedReads = tumor.dropped();
+    return true;
+}
+
+void BassovacApp::intersect(
+        BamReaderBase& normal,
+        BamReaderBase& tumor,
+        ReferenceWindow& reference,
+        BamIntersector::callback_t cb
+        ) const
+{
+    if (_downsampleDepth == 0) {
+        intersectReads(normal, tumor, reference, cb);
+        return;
+    }
+
+    DownsamplingBamReader normalSample(normal, _downsampleDepth, _downsampleSeed);
+    DownsamplingBamReader tumorSample(tumor, _downsampleDepth, _downsampleSeed);
+    intersectReads(normalSample, tumorSample, reference, cb);
+}
+
+void BassovacApp::intersectReads(
+        BamReaderBase& normal,
+        BamReaderBase& tumor,
+        ReferenceWindow& window,
+        BamIntersector::callback_t cb
+        ) const
+{
+    // positions past the end of the sequence, or on sequences missing from
+    // the fasta, are left to callSite() to report
+    auto reference = bind(&ReferenceWindow::bases, ref(window), _1, _2, _3, _4);
+    if (_tumorDriven) {
+        TumorDrivenIntersector intersector(normal, tumor, cb, reference, _minBaseQual);
+        intersector.setMinDepth(_minNormalDepth, _minTumorDepth);
+        if (!_targetsFile.empty())
+            intersector.setTargets(_targets);
+        intersector.run();
+    } else {
+        BamIntersector intersector(normal, tumor, cb);
+        intersector.setCandidateFilter(reference, _minBaseQual);
+        intersector.setMinDepth(_minNormalDepth, _minTumorDepth);
+        intersector.setSeekGap(_seekGap);
+        if (!_targetsFile.empty())
+            intersector.setTargets(_targets);
+        intersector.run();
+    }
+}
+
+BamReaderBase* BassovacApp::openSample(
+        vector<string> const& paths,
+        function<BamReaderBase*(string const&)> const& open
+        ) const
+{
+    vector<unique_ptr<BamReaderBase>> readers;
+    for (auto i = paths.begin(); i != paths.end(); ++i) {
+        readers.emplace_back(open(*i));
+        readers.back()->setFilter(_bamFilter.get());
+    }
+
+    if (readers.size() == 1)
+        return readers[0].release();
+    return new MergingBamReader(move(readers));
 }
 
 void BassovacApp::openBams() {
     _bamFilter.reset(new BamFilter(BAM_DEF_MASK, _minMapQual));
+    if (_inflateThreads > 0)
+        _inflatePool.reset(new ThreadPool(_inflateThreads));
+
+    ThreadPool* pool = _inflatePool.get();
+    char const* region = _bamRegionString.c_str();
+    // repositioned at the targets, or at each group of candidate sites
+    Region none = { 0, 0, 0 };
+    auto open = [&](string const& path, bool repositioned) -> BamReaderBase* {
+        if (_nativeBamReader) {
+            if (!_targetsFile.empty())
+                return new MappedBamReader(path, none, pool);
+            if (_bamRegionString.empty())
+                return new MappedBamReader(path, pool);
+            return new MappedBamReader(path, region, pool);
+        }
+
+        if (!_targetsFile.empty())
+            return new RegionLimitedBamReader(path, none, pool);
+        if (!_bamRegionString.empty())
+            return new RegionLimitedBamReader(path, region, pool);
+        if (repositioned)
+            return new RegionLimitedBamReader(path, none, pool);
+        return new BamReader(path, pool);
+    };
+
+    // the tumor driven mode queries the normal bam around candidate sites
+    _normalReader.reset(openSample(_normalBams, bind(open, _1, _tumorDriven)));
+    _tumorReader.reset(openSample(_tumorBams, bind(open, _1, false)));
+    _refSeq.reset(new Fasta(_fasta));
 
-    if (_bamRegionString.empty()) {
-        _normalReader.reset(new BamReader(_normalBam));
-        _tumorReader.reset(new BamReader(_tumorBam));
+    // looked up once rather than by name at every site
+    bam_header_t* header = _normalReader->header();
+    _contigs.clear();
+    for (int32_t tid = 0; tid < header->n_targets; ++tid)
+        _contigs.push_back(_refSeq->contig(header->target_name[tid]));
+
+    if (!_targetsFile.empty()) {
+        _targets = readBedRegions(_targetsFile, _normalReader->header());
+        // the tumor driven mode queries the normal bam itself
+        if (!_tumorDriven)
+            _normalReader->setTargets(_targets);
+        _tumorReader->setTargets(_targets);
     }
-    else {
-        _normalReader.reset(new RegionLimitedBamReader(_normalBam, _bamRegionString.c_str()));
-        _tumorReader.reset(new RegionLimitedBamReader(_tumorBam, _bamRegionString.c_str()));
+}
+
+vector<Region> BassovacApp::callableRegions() const {
+    bam_header_t* header = _normalReader->header();
+    vector<Region> rv;
+
+    if (!_targetsFile.empty())
+        return _targets;
+
+    if (!_bamRegionString.empty()) {
+        Region r;
+        if (bam_parse_region(header, _bamRegionString.c_str(), &r.tid, &r.beg, &r.end) < 0)
+            throw runtime_error("Failed to parse bam region '" + _bamRegionString + "'");
+        rv.push_back(r);
+        return rv;
     }
 
-    _normalReader->setFilter(_bamFilter.get());
-    _tumorReader->setFilter(_bamFilter.get());
-    _refSeq.reset(new Fasta(_fasta));
+    for (int32_t tid = 0; tid < header->n_targets; ++tid) {
+        // positions past the end of the reference sequence can't be called,
+        // so prefer its length to that in the bam header when we have it.
+        size_t len = _contigs[tid].length();
+        if (len == 0)
+            len = header->target_len[tid];
+
+        Region r;
+        r.tid = tid;
+        r.beg = 0;
+        r.end = int32_t(len);
+        rv.push_back(r);
+    }
+    return rv;
+}
+
+void BassovacApp::runChunked(std::ostream& out) {
+    int32_t chunkSize = int32_t(min<uint32_t>(_chunkSize, numeric_limits<int32_t>::max()));
+    vector<Region> chunks = chunkRegions(callableRegions(), chunkSize);
+
+    // each worker gets its own pair of readers which is repositioned for
+    // every chunk it processes.
+    vector<unique_ptr<BamReaderBase>> normalReaders(_threads);
+    vector<unique_ptr<BamReaderBase>> tumorReaders(_threads);
+    vector<unique_ptr<ReferenceWindow>> references(_threads);
+
+    auto openChunk = [&](string const& path, Region const& chunk) -> BamReaderBase* {
+        if (_nativeBamReader)
+            return new MappedBamReader(path, chunk, _inflatePool.get());
+        return new RegionLimitedBamReader(path, chunk, _inflatePool.get());
+    };
+
+    auto task = [&](uint32_t worker, size_t idx, string& result) {
+        Region const& chunk = chunks[idx];
+        unique_ptr<BamReaderBase>& normal = normalReaders[worker];
+        unique_ptr<BamReaderBase>& tumor = tumorReaders[worker];
+        unique_ptr<ReferenceWindow>& reference = references[worker];
+        if (!normal) {
+            normal.reset(openSample(_normalBams, bind(openChunk, _1, cref(chunk))));
+            tumor.reset(openSample(_tumorBams, bind(openChunk, _1, cref(chunk))));
+            reference.reset(new ReferenceWindow(_contigs));
+        } else {
+            normal->setRegion(chunk);
+            tumor->setRegion(chunk);
+        }
+
+        stringstream ss;
+        ResultFormatter formatter(&ss, _fixedPoint, _fpPrecision, _downsampleDepth > 0);
+        intersect(*normal, *tumor, *reference,
+            bind(&BassovacApp::resultCb, this, ref(formatter), ref(*reference), cref(*normal), _1, _2, _3));
+        result = ss.str();
+    };
+
+    auto sink = [&](string const& result) {
+        out << result;
+    };
+
+    OrderedTaskRunner runner(_threads, 4 * _threads);
+    runner.run(chunks.size(), task, sink);
+}
+
+void BassovacApp::runPipelined(std::ostream& out) {
+    // stage 1: one decode thread per bam file
+    PipelinedBamReader normal(*_normalReader, ENTRY_BATCH_SIZE, ENTRY_QUEUE_SIZE);
+    PipelinedBamReader tumor(*_tumorReader, ENTRY_BATCH_SIZE, ENTRY_QUEUE_SIZE);
+
+    // stage 3: the writer formats finished sites and writes them out
+    typedef vector<SiteResult> SiteBatch;
+    BoundedQueue<SiteBatch*> sites(SITE_QUEUE_SIZE);
+    exception_ptr writerError;
+    thread writer([&]() {
+        try {
+            ResultFormatter formatter(&out, _fixedPoint, _fpPrecision, _downsampleDepth > 0);
+            SiteBatch* batch;
+            while (sites.pop(batch)) {
+                unique_ptr<SiteBatch> owner(batch);
+                for (auto i = batch->begin(); i != batch->end(); ++i)
+                    formatter.printResult(*i);
+            }
+        } catch (...) {
+            writerError = current_exception();
+            sites.cancel();
+        }
+    });
+
+    // stage 2: pileups and the model run on this thread
+    ReferenceWindow reference(_contigs);
+    unique_ptr<SiteBatch> batch(new SiteBatch);
+    batch->reserve(SITE_BATCH_SIZE);
+    auto flush = [&]() {
+        SiteBatch* p = batch.get();
+        if (!sites.push(p))
+            throw runtime_error("Output writer failed");
+        batch.release();
+    };
+
+    auto cb = [&](int32_t pos, const Pileup& n, const Pileup& t) {
+        if (!batch) {
+            batch.reset(new SiteBatch);
+            batch->reserve(SITE_BATCH_SIZE);
+        }
+        SiteResult result;
+        if (!callSite(reference, normal, pos, n, t, result))
+            return;
+        batch->push_back(result);
+        if (batch->size() == SITE_BATCH_SIZE)
+            flush();
+    };
+
+    try {
+        intersect(normal, tumor, reference, cb);
+        if (batch && !batch->empty())
+            flush();
+    } catch (...) {
+        sites.cancel();
+        writer.join();
+        // a failure in the writer is the more interesting error
+        if (writerError)
+            rethrow_exception(writerError);
+        throw;
+    }
+    sites.close();
+    writer.join();
+    if (writerError)
+        rethrow_exception(writerError);
+
+    cerr << "Pipeline queue occupancy:\n";
+    reportQueue(cerr, "normal decode", normal.queueStats());
+    reportQueue(cerr, "tumor decode", tumor.queueStats());
+    reportQueue(cerr, "writer", sites.stats());
 }
 
 void BassovacApp::run() {
@@ -228,16 +587,23 @@ void BassovacApp::run() {
         out = &cout;
     }
 
-    _formatter.reset(new ResultFormatter(out, _fixedPoint, _fpPrecision));
+    clock_t start(clock());
+    if (_threads > 1) {
+        runChunked(*out);
+    } else if (_pipeline) {
+        runPipelined(*out);
+    } else {
+        _formatter.reset(new ResultFormatter(out, _fixedPoint, _fpPrecision, _downsampleDepth > 0));
 
-    BamIntersector intersector(*_normalReader, *_tumorReader,
-        bind(&BassovacApp::resultCb, this, _1, _2, _3));
+        ReferenceWindow reference(_contigs);
+        auto cb = [&](int32_t pos, const Pileup& n, const Pileup& t) {
+            resultCb(*_formatter, reference, *_normalReader, pos, n, t);
+        };
 
-    clock_t start(clock());
-    intersector.run();
+        intersect(*_normalReader, *_tumorReader, reference, cb);
+    }
     cerr << "Main loop: " << ((clock()-start)/double(CLOCKS_PER_SEC)) << "s CPU time\n";
 
     if (!_outputFile.empty())
         delete out;
 }
-
@@ -1,15 +1,21 @@
 #pragma once
 
+#include "bvprob/Fasta.hpp"
 #include "io/BamReaderBase.hpp"
 #include "io/BamIntersector.hpp"
 #include "io/BamFilter.hpp"
 
+#include <functional>
+#include <iosfwd>
 #include <memory>
 #include <string>
+#include <vector>
 
-class Fasta;
 class Pileup;
+class ReferenceWindow;
 class ResultFormatter;
+class ThreadPool;
+struct SiteResult;
 
 class BassovacApp {
 public:
@@ -19,23 +25,71 @@ public:
     void run();
 
 protected:
-    void resultCb(int32_t pos, const Pileup& normal, const Pileup& tumor);
+    void resultCb(
+        ResultFormatter& formatter,
+        ReferenceWindow& reference,
+        BamReaderBase const& reader,
+        int32_t pos,
+        const Pileup& normal,
+        const Pileup& tumor
+        );
 
+    // run the model at one site. returns false if there is nothing to report.
+    bool callSite(
+        ReferenceWindow& reference,
+        BamReaderBase const& reader,
+        int32_t pos,
+        const Pileup& normal,
+        const Pileup& tumor,
+        SiteResult& result
+        );
+
+    // pile up the reads of normal and tumor, making the callback at each
+    // site that could be called. reads are downsampled first if asked to.
+    // reference serves the candidate filter, and should serve the callback
+    // too, which runs on the same thread.
+    void intersect(
+        BamReaderBase& normal,
+        BamReaderBase& tumor,
+        ReferenceWindow& reference,
+        BamIntersector::callback_t cb
+        ) const;
+    void intersectReads(
+        BamReaderBase& normal,
+        BamReaderBase& tumor,
+        ReferenceWindow& reference,
+        BamIntersector::callback_t cb
+        ) const;
+
+    // open each of paths with open, merging them if there are several
+    BamReaderBase* openSample(
+        std::vector<std::string> const& paths,
+        std::function<BamReaderBase*(std::string const&)> const& open
+        ) const;
     void openBams();
+    std::vector<Region> callableRegions() const;
+    void runChunked(std::ostream& out);
+    void runPipelined(std::ostream& out);
 
 protected:
     std::string _fasta;
-    std::string _normalBam;
-    std::string _tumorBam;
+    std::vector<std::string> _normalBams;
+    std::vector<std::string> _tumorBams;
     std::string _outputFile;
     std::string _bamRegionString;
+    std::string _targetsFile;
+    std::vector<Region> _targets;
     std::unique_ptr<Fasta> _refSeq;
+    // the fasta sequence of each bam tid
+    std::vector<Fasta::Contig> _contigs;
     std::unique_ptr<BamReaderBase> _normalReader;
     std::unique_ptr<BamReaderBase> _tumorReader;
     std::unique_ptr<ResultFormatter> _formatter;
     std::unique_ptr<BamFilter> _bamFilter;
+    std::unique_ptr<ThreadPool> _inflatePool;
 
     bool _fixedPoint;
+    bool _pipeline;
     uint32_t _fpPrecision;
     double _normalVariantFrequency;
     double _normalPurity;
@@ -48,6 +102,16 @@ protected:
     double _minSomaticPvalue;
     uint32_t _minMapQual;
     uint32_t _minBaseQual;
+    uint32_t _minNormalDepth;
+    uint32_t _minTumorDepth;
     uint32_t _maxBins;
     uint32_t _maxDepth;
+    uint32_t _threads;
+    uint32_t _chunkSize;
+    uint32_t _inflateThreads;
+    uint32_t _seekGap;
+    uint32_t _downsampleDepth;
+    uint32_t _downsampleSeed;
+    bool _nativeBamReader;
+    bool _tumorDriven;
 };
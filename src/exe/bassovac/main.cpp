@@ -1,13 +1,42 @@
 #include "BassovacApp.hpp"
 
 #include "bvprob/Bassovac.hpp"
+#include "bvprob/Fasta.hpp"
+#include "bvprob/TwoBit.hpp"
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <stdexcept>
 
 using namespace std;
 
+namespace {
+    // bassovac fasta-to-2bit <in.fa> <out.2bit>
+    void fastaToTwoBit(int argc, char** argv) {
+        if (argc != 4) {
+            throw runtime_error(string("Usage: ") + argv[0] + " fasta-to-2bit <in.fa> <out.2bit>\n\n"
+                "Writes a .2bit copy of a fasta, which bassovac can read in its place. "
+                "Bases other than ACGT are stored as N.");
+        }
+
+        Fasta fasta(argv[2]);
+        ofstream out(argv[3], ios::binary);
+        if (!out)
+            throw runtime_error(string("Failed to open output file ") + argv[3]);
+        writeTwoBit(fasta, out);
+        out.close();
+        if (!out)
+            throw runtime_error(string("Failed to write ") + argv[3]);
+    }
+}
+
 int main(int argc, char** argv) {
     try {
+        if (argc > 1 && strcmp(argv[1], "fasta-to-2bit") == 0) {
+            fastaToTwoBit(argc, argv);
+            return 0;
+        }
+
         BassovacApp app(argc, argv);
         app.run();
     } catch (const exception& e) {
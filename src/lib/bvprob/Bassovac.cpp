@@ -127,7 +127,7 @@ void Bassovac::bernoulliProbabilityOfReference(
     double pA = nvar1 * s1.adjustedPurity;
     double pB = nvar2 * s1.adjustedPurityComplement;
 
-    vector<PBin>& bins = s1.readErrorBins;
+    PBin* bins = s1.readErrorBins;
     for (uint32_t i = 0; i < s1.nBins; ++i) {
         double err = bins[i].harmonicMean;
         bins[i].pObserveRef = 1 - (1-4.0/3.0 * err) * (pA+pB)/2.0 - err;
@@ -147,12 +147,11 @@ double Bassovac::probabilityObservedGivenGenotypes(
     ) const
 {
     bernoulliProbabilityOfReference(s1, a1, s2, a2);
-    vector<PBin> const& bins = s1.readErrorBins;
+    PBin const* bins = s1.readErrorBins;
     double rv = 0.0;
     if (s1.nBins == 1) {
         rv = Binomial::pdf(bins[0].pObserveRef, s1.totalReads, s1.supportingReads);
     } else if (s1.nBins == 2) {
-        const vector<PBin>& bins = s1.readErrorBins;
         rv = Binomial::pdfConvolve2(
             bins[0].pObserveRef, bins[1].pObserveRef,
             bins[0].size, bins[1].size,
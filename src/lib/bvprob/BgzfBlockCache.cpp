@@ -0,0 +1,213 @@
+#include "BgzfBlockCache.hpp"
+#include "IOError.hpp"
+#include "io/Bgzf.hpp"
+
+#include <boost/format.hpp>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using boost::format;
+using namespace std;
+
+BgzfBlockCache::BgzfBlockCache(
+        char const* data,
+        size_t len,
+        string const& path,
+        string const& gziPath,
+        size_t capacity)
+    : _data(data)
+    , _len(len)
+    , _path(path)
+    , _capacity(max<size_t>(capacity, 1))
+    , _size(0)
+    , _inflated(0)
+{
+    // a plain gzip file fails here, rather than on the first read
+    if (_len)
+        blockSize(0);
+
+    if (gziPath.empty())
+        scanBlocks();
+    else
+        loadGzi(gziPath);
+}
+
+size_t BgzfBlockCache::blockSize(uint64_t offset) const {
+    size_t left = offset < _len ? _len - offset : 0;
+    try {
+        if (left < Bgzf::HEADER_SIZE)
+            throw runtime_error("truncated block header");
+        uint8_t const* header = reinterpret_cast<uint8_t const*>(_data + offset);
+        size_t xlen = Bgzf::extraLength(header);
+        if (left < Bgzf::HEADER_SIZE + xlen)
+            throw runtime_error("truncated block header");
+        size_t rv = Bgzf::blockSize(header, header + Bgzf::HEADER_SIZE);
+        if (left < rv)
+            throw runtime_error("truncated block");
+        return rv;
+    } catch (runtime_error const& e) {
+        throw runtime_error(str(format(
+            "%1% is not bgzf compressed (%2% at offset %3%), use bgzip to compress it")
+            % _path % e.what() % offset));
+    }
+}
+
+uint32_t BgzfBlockCache::inflatedSize(uint64_t offset) const {
+    size_t size = blockSize(offset);
+    return Bgzf::inflatedSize(reinterpret_cast<uint8_t const*>(_data + offset + size));
+}
+
+void BgzfBlockCache::scanBlocks() {
+    for (uint64_t offset = 0; offset < _len; offset += blockSize(offset)) {
+        uint32_t n = inflatedSize(offset);
+        if (n) {
+            _compressed.push_back(offset);
+            _uncompressed.push_back(_size);
+            _size += n;
+        }
+    }
+}
+
+void BgzfBlockCache::loadGzi(string const& gziPath) {
+    ifstream in(gziPath.c_str(), ios::binary);
+    uint64_t count = 0;
+    if (!in.read(reinterpret_cast<char*>(&count), sizeof(count)))
+        throw IOError(str(format("Failed to read bgzf index %1%") % gziPath));
+
+    // the first block is implied
+    vector<uint64_t> compressed(1, 0);
+    vector<uint64_t> uncompressed(1, 0);
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t entry[2];
+        if (!in.read(reinterpret_cast<char*>(entry), sizeof(entry)))
+            throw IOError(str(format("Truncated bgzf index %1%") % gziPath));
+        if (entry[0] <= compressed.back() || entry[0] >= _len || entry[1] < uncompressed.back())
+            throw runtime_error(str(format("Bgzf index %1% does not match %2%") % gziPath % _path));
+        compressed.push_back(entry[0]);
+        uncompressed.push_back(entry[1]);
+    }
+
+    // drop empty blocks, e.g., the end of file marker
+    for (size_t i = 0; i + 1 < compressed.size(); ++i) {
+        if (uncompressed[i] != uncompressed[i + 1]) {
+            _compressed.push_back(compressed[i]);
+            _uncompressed.push_back(uncompressed[i]);
+        }
+    }
+    if (_len) {
+        _compressed.push_back(compressed.back());
+        _uncompressed.push_back(uncompressed.back());
+    }
+    while (!_compressed.empty() && inflatedSize(_compressed.back()) == 0) {
+        _compressed.pop_back();
+        _uncompressed.pop_back();
+    }
+    if (!_compressed.empty())
+        _size = _uncompressed.back() + inflatedSize(_compressed.back());
+}
+
+BgzfBlockCache::BlockPtr BgzfBlockCache::inflateBlock(size_t i) const {
+    uint8_t const* block = reinterpret_cast<uint8_t const*>(_data + _compressed[i]);
+    size_t size = blockSize(_compressed[i]);
+    shared_ptr<Block> rv(new Block);
+    rv->begin = _uncompressed[i];
+    rv->data.resize(Bgzf::inflatedSize(block + size));
+    try {
+        Bgzf::inflate(block, size, reinterpret_cast<uint8_t*>(rv->data.data()));
+    } catch (runtime_error const& e) {
+        throw runtime_error(str(format("%1% at offset %2% of %3%")
+            % e.what() % _compressed[i] % _path));
+    }
+
+    uint64_t end = i + 1 < _uncompressed.size() ? _uncompressed[i + 1] : _size;
+    if (rv->begin + rv->data.size() != end) {
+        throw runtime_error(str(format(
+            "Bgzf block at offset %1% of %2% does not have the size its index gives")
+            % _compressed[i] % _path));
+    }
+    return rv;
+}
+
+void BgzfBlockCache::readAhead(size_t i) const {
+    if (i + 1 >= _compressed.size())
+        return;
+
+    static uintptr_t const pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+    size_t last = min(i + 1 + READ_AHEAD, _compressed.size());
+    uintptr_t begin = uintptr_t(_data + _compressed[i + 1]) & ~(pageSize - 1);
+    uintptr_t end = uintptr_t(_data + (last < _compressed.size() ? _compressed[last] : _len));
+    // only a hint, failure is harmless
+    posix_madvise(reinterpret_cast<void*>(begin), end - begin, POSIX_MADV_WILLNEED);
+}
+
+BgzfBlockCache::BlockPtr BgzfBlockCache::block(uint64_t offset) {
+    if (offset >= _size)
+        return BlockPtr();
+
+    size_t i = upper_bound(_uncompressed.begin(), _uncompressed.end(), offset)
+        - _uncompressed.begin() - 1;
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto iter = _blocks.find(i);
+        if (iter != _blocks.end()) {
+            _lru.splice(_lru.begin(), _lru, iter->second.lru);
+            return iter->second.block;
+        }
+    }
+
+    // inflate without holding the lock. another thread may get the same
+    // block meanwhile, in which case the first one in is kept.
+    readAhead(i);
+    BlockPtr rv = inflateBlock(i);
+
+    lock_guard<mutex> lock(_mutex);
+    ++_inflated;
+    auto iter = _blocks.find(i);
+    if (iter != _blocks.end())
+        return iter->second.block;
+
+    _lru.push_front(i);
+    Entry& e = _blocks[i];
+    e.block = rv;
+    e.lru = _lru.begin();
+    while (_blocks.size() > _capacity) {
+        _blocks.erase(_lru.back());
+        _lru.pop_back();
+    }
+    return rv;
+}
+
+void BgzfBlockCache::read(uint64_t offset, size_t len, char* out) {
+    if (offset > _size || len > _size - offset) {
+        throw runtime_error(str(format(
+            "Request for %1% bytes at offset %2% of %3%, which has %4% uncompressed")
+            % len % offset % _path % _size));
+    }
+
+    while (len) {
+        BlockPtr b = block(offset);
+        size_t skip = offset - b->begin;
+        size_t n = min(len, b->data.size() - skip);
+        memcpy(out, b->data.data() + skip, n);
+        out += n;
+        offset += n;
+        len -= n;
+    }
+}
+
+size_t BgzfBlockCache::cached() const {
+    lock_guard<mutex> lock(_mutex);
+    return _blocks.size();
+}
+
+uint64_t BgzfBlockCache::inflated() const {
+    lock_guard<mutex> lock(_mutex);
+    return _inflated;
+}
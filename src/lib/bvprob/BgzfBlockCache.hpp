@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Random access to the uncompressed bytes of a memory mapped bgzf file, e.g.,
+// a bgzip compressed fasta, through a small LRU cache of inflated blocks, so
+// that only the blocks that are read get inflated. On a miss, the kernel is
+// asked to read ahead the compressed bytes of the next few blocks, since
+// reads mostly sweep forward. Blocks are located with the .gzi index written
+// by bgzip -i if there is one, or else by walking the block headers. Safe to
+// share between threads.
+class BgzfBlockCache {
+public:
+    static std::size_t const DEFAULT_CAPACITY = 64;
+    static std::size_t const READ_AHEAD = 8;
+
+    struct Block {
+        // the uncompressed offset of data[0]
+        uint64_t begin;
+        std::vector<char> data;
+    };
+    typedef std::shared_ptr<Block const> BlockPtr;
+
+    // data must outlive the cache. path is used in error messages. gziPath
+    // may be empty.
+    BgzfBlockCache(
+        char const* data,
+        std::size_t len,
+        std::string const& path,
+        std::string const& gziPath,
+        std::size_t capacity = DEFAULT_CAPACITY
+        );
+
+    // the block holding the byte at uncompressed offset, or null if offset is
+    // past the end. it stays valid while it is held, even once evicted.
+    BlockPtr block(uint64_t offset);
+
+    // copy len bytes from uncompressed offset to out. throws if they run
+    // past the end.
+    void read(uint64_t offset, std::size_t len, char* out);
+
+    // the size of the uncompressed data
+    uint64_t size() const {
+        return _size;
+    }
+
+    // not counting empty blocks
+    std::size_t blockCount() const {
+        return _compressed.size();
+    }
+
+    // the number of blocks held in the cache
+    std::size_t cached() const;
+
+    // the number of blocks inflated so far
+    uint64_t inflated() const;
+
+protected:
+    void loadGzi(std::string const& gziPath);
+    void scanBlocks();
+    // the total size of the compressed block at offset, checking that it is
+    // a complete bgzf block
+    std::size_t blockSize(uint64_t offset) const;
+    uint32_t inflatedSize(uint64_t offset) const;
+    BlockPtr inflateBlock(std::size_t i) const;
+    void readAhead(std::size_t i) const;
+
+protected:
+    char const* _data;
+    std::size_t _len;
+    std::string _path;
+    std::size_t _capacity;
+    uint64_t _size;
+
+    // the compressed and uncompressed offsets of each non empty block
+    std::vector<uint64_t> _compressed;
+    std::vector<uint64_t> _uncompressed;
+
+    struct Entry {
+        BlockPtr block;
+        std::list<std::size_t>::iterator lru;
+    };
+
+    mutable std::mutex _mutex;
+    // block numbers, most recently used first
+    std::list<std::size_t> _lru;
+    std::unordered_map<std::size_t, Entry> _blocks;
+    uint64_t _inflated;
+};
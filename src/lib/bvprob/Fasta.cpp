@@ -1,8 +1,11 @@
 #include "Fasta.hpp"
+#include "BgzfBlockCache.hpp"
 #include "IOError.hpp"
+#include "TwoBit.hpp"
 #include "Tokenizer.hpp"
 #include "UnknownSequenceError.hpp"
 
+#include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 #include <algorithm>
 #include <cctype>
@@ -19,6 +22,7 @@ using namespace std::placeholders;
 
 namespace {
     const char* INDEX_EXTENSION = ".fai";
+    const char* BGZF_INDEX_EXTENSION = ".gzi";
     const char SEQ_BEGIN_CHAR = '>';
 }
 
@@ -83,17 +87,90 @@ public: // functions
 protected: // data
     vector<string> _entryNames;
     map<string, Entry> _entries;
-    friend class IndexGenerator;
+    template<typename> friend class IndexGenerator;
 };
 
+// Reads text held in memory a character at a time, for IndexGenerator.
+// Dereferencing at the end gives 0.
+class TextCursor {
+public:
+    TextCursor(char const* data, size_t len)
+        : _beg(data)
+        , _pos(data)
+        , _end(data + len)
+    {
+    }
+
+    bool atEnd() const {
+        return _pos == _end;
+    }
+
+    char operator*() const {
+        return _pos == _end ? 0 : *_pos;
+    }
+
+    void operator++() {
+        ++_pos;
+    }
+
+    size_t offset() const {
+        return _pos - _beg;
+    }
+
+protected:
+    char const* _beg;
+    char const* _pos;
+    char const* _end;
+};
+
+// Reads the uncompressed text of a bgzf file a character at a time, holding
+// on to one block at a time, so that indexing a compressed fasta never needs
+// more than the cache holds.
+class BlockCursor {
+public:
+    explicit BlockCursor(BgzfBlockCache& cache)
+        : _cache(cache)
+        , _block(cache.block(0))
+        , _offset(0)
+        , _skip(0)
+    {
+    }
+
+    bool atEnd() const {
+        return !_block;
+    }
+
+    char operator*() const {
+        return _block ? _block->data[_skip] : 0;
+    }
+
+    void operator++() {
+        ++_offset;
+        if (++_skip == _block->data.size()) {
+            _block = _cache.block(_offset);
+            _skip = 0;
+        }
+    }
+
+    size_t offset() const {
+        return _offset;
+    }
+
+protected:
+    BgzfBlockCache& _cache;
+    BgzfBlockCache::BlockPtr _block;
+    uint64_t _offset;
+    // the offset of _offset in _block
+    size_t _skip;
+};
+
+template<typename Cursor>
 class IndexGenerator {
 public:
     typedef Fasta::Index::Entry Entry;
 
-    IndexGenerator(char const* data, size_t len)
-        : _beg(data)
-        , _pos(data)
-        , _end(data+len)
+    explicit IndexGenerator(Cursor const& pos)
+        : _pos(pos)
         , _isspace(bind(&std::isspace<char>, _1, _loc))
         , _isgraph(bind(&std::isgraph<char>, _1, _loc))
     {
@@ -107,11 +184,12 @@ public:
         }
         ++_pos;
 
-        char const* space = find_if(_pos, _end, _isspace);
-        e.name = string(_pos, space);
+        e.name.clear();
+        for (; !_pos.atEnd() && !_isspace(*_pos); ++_pos)
+            e.name += *_pos;
         // skip comment
-        _pos = find(_pos, _end, '\n');
-        _pos = find_if(_pos, _end, _isgraph);
+        skipUntil([](char c) { return c == '\n'; });
+        skipUntil(_isgraph);
     }
 
     void countLines(Entry& e) {
@@ -120,50 +198,242 @@ public:
                 "Empty sequence '%1%' in fasta file") %e.name));
         }
 
-        char const* newline = find_if(_pos, _end, _isspace);
-        e.len = e.lineLength = e.lineBasesLength = newline - _pos;
-        _pos = newline;
-        while (_isspace(*_pos)) {
+        e.len = e.lineLength = e.lineBasesLength = lineBases();
+        while (!_pos.atEnd() && _isspace(*_pos)) {
             ++e.lineLength;
             ++_pos;
         }
 
-        while (*_pos != SEQ_BEGIN_CHAR) {
-            char const* newline = find_if(_pos, _end, _isspace);
-            size_t len = newline - _pos;
+        while (!_pos.atEnd() && *_pos != SEQ_BEGIN_CHAR) {
+            size_t len = lineBases();
             e.len += len;
-            _pos = find_if(newline, _end, _isgraph);
+            skipUntil(_isgraph);
             if (len != e.lineBasesLength)
                 break;
         }
         // we should be at the next seq now
-        if (_pos != _end && *_pos != SEQ_BEGIN_CHAR) {
+        if (!_pos.atEnd() && *_pos != SEQ_BEGIN_CHAR) {
             throw runtime_error("Uneven line length");
         }
     }
 
     unique_ptr<Fasta::Index> generate() {
         unique_ptr<Fasta::Index> index(new Fasta::Index);
-        while (_pos < _end) {
+        while (!_pos.atEnd()) {
             Entry e;
             extractName(e);
-            e.offset = _pos - _beg;
+            e.offset = _pos.offset();
             countLines(e);
             index->_entryNames.push_back(e.name);
             index->_entries[e.name] = e;
         }
         return index;
     }
-    
+
 protected:
-    char const* _beg;
-    char const* _pos;
-    char const* _end;
+    template<typename Pred>
+    void skipUntil(Pred const& pred) {
+        while (!_pos.atEnd() && !pred(*_pos))
+            ++_pos;
+    }
+
+    // skip to the end of the bases on this line, returning how many there are
+    size_t lineBases() {
+        size_t rv = 0;
+        for (; !_pos.atEnd() && !_isspace(*_pos); ++_pos)
+            ++rv;
+        return rv;
+    }
+
+protected:
+    Cursor _pos;
     locale _loc;
     function<bool(char)> _isspace;
     function<bool(char)> _isgraph;
 };
 
+Fasta::Contig::Contig()
+    : _data(0)
+    , _dna(0)
+    , _len(0)
+    , _lineBases(1)
+    , _lineLength(1)
+    , _cache(0)
+    , _offset(0)
+{
+    _nRuns.count = _maskRuns.count = 0;
+}
+
+Fasta::Contig::Contig(char const* data, size_t len, size_t lineBases, size_t lineLength)
+    : _data(data)
+    , _dna(0)
+    , _len(len)
+    , _lineBases(lineBases)
+    , _lineLength(lineLength)
+    , _cache(0)
+    , _offset(0)
+{
+    _nRuns.count = _maskRuns.count = 0;
+}
+
+Fasta::Contig::Contig(uint8_t const* dna, size_t len, Runs const& nRuns, Runs const& maskRuns)
+    : _data(0)
+    , _dna(dna)
+    , _len(len)
+    , _lineBases(1)
+    , _lineLength(1)
+    , _nRuns(nRuns)
+    , _maskRuns(maskRuns)
+    , _cache(0)
+    , _offset(0)
+{
+}
+
+Fasta::Contig::Contig(
+        BgzfBlockCache* cache,
+        uint64_t offset,
+        size_t len,
+        size_t lineBases,
+        size_t lineLength)
+    : _data(0)
+    , _dna(0)
+    , _len(len)
+    , _lineBases(lineBases)
+    , _lineLength(lineLength)
+    , _cache(cache)
+    , _offset(offset)
+{
+    _nRuns.count = _maskRuns.count = 0;
+}
+
+uint32_t Fasta::Contig::Runs::find(size_t pos) const {
+    // the first run starting after pos, then the one before it if it
+    // reaches pos
+    uint32_t lo = 0;
+    uint32_t hi = count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (start(mid) <= pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo > 0 && start(lo - 1) + size_t(size(lo - 1)) > pos)
+        --lo;
+    return lo;
+}
+
+char Fasta::Contig::packedBase(size_t pos) const {
+    char rv = "TCAG"[(_dna[pos / 4] >> (6 - 2 * (pos % 4))) & 3];
+    uint32_t i = _nRuns.find(pos);
+    if (i < _nRuns.count && _nRuns.start(i) <= pos)
+        rv = 'N';
+    i = _maskRuns.find(pos);
+    if (i < _maskRuns.count && _maskRuns.start(i) <= pos)
+        rv = char(tolower(rv));
+    return rv;
+}
+
+void Fasta::Contig::packedBases(size_t begin, size_t end, char* out) const {
+    // the four bases of every byte value
+    static struct Table {
+        Table() {
+            for (int b = 0; b < 256; ++b) {
+                for (int k = 0; k < 4; ++k)
+                    bases[b][k] = "TCAG"[(b >> (6 - 2 * k)) & 3];
+            }
+        }
+        char bases[256][4];
+    } const table;
+
+    char* dst = out;
+    size_t pos = begin;
+    for (; pos < end && pos % 4; ++pos)
+        *dst++ = table.bases[_dna[pos / 4]][pos % 4];
+    for (; pos + 4 <= end; pos += 4, dst += 4)
+        memcpy(dst, table.bases[_dna[pos / 4]], 4);
+    for (; pos < end; ++pos)
+        *dst++ = table.bases[_dna[pos / 4]][pos % 4];
+
+    for (uint32_t i = _nRuns.find(begin); i < _nRuns.count && _nRuns.start(i) < end; ++i) {
+        size_t from = max<size_t>(begin, _nRuns.start(i));
+        size_t to = min<size_t>(end, _nRuns.start(i) + size_t(_nRuns.size(i)));
+        fill(out + (from - begin), out + (to - begin), 'N');
+    }
+    for (uint32_t i = _maskRuns.find(begin); i < _maskRuns.count && _maskRuns.start(i) < end; ++i) {
+        size_t from = max<size_t>(begin, _maskRuns.start(i));
+        size_t to = min<size_t>(end, _maskRuns.start(i) + size_t(_maskRuns.size(i)));
+        for (char* c = out + (from - begin); c != out + (to - begin); ++c)
+            *c = char(tolower(*c));
+    }
+}
+
+char Fasta::Contig::cachedBase(size_t pos) const {
+    char rv;
+    _cache->read(_offset + pos / _lineBases * _lineLength + pos % _lineBases, 1, &rv);
+    return rv;
+}
+
+void Fasta::Contig::cachedBases(size_t begin, size_t end, char* out) const {
+    // a line at a time, holding on to the block the last one was in
+    BgzfBlockCache::BlockPtr block;
+    size_t line = begin / _lineBases;
+    size_t skip = begin - line * _lineBases;
+    uint64_t src = _offset + line * _lineLength;
+    size_t left = end - begin;
+    while (left) {
+        size_t n = min(left, _lineBases - skip);
+        for (uint64_t pos = src + skip; pos != src + skip + n;) {
+            if (!block || pos < block->begin || pos >= block->begin + block->data.size()) {
+                block = _cache->block(pos);
+                if (!block) {
+                    throw runtime_error(str(format(
+                        "Compressed fasta is shorter than its index says (offset %1%)")
+                        % pos));
+                }
+            }
+            size_t count = min<uint64_t>(src + skip + n - pos, block->begin + block->data.size() - pos);
+            memcpy(out, block->data.data() + (pos - block->begin), count);
+            out += count;
+            pos += count;
+        }
+        left -= n;
+        skip = 0;
+        src += _lineLength;
+    }
+}
+
+size_t Fasta::Contig::bases(size_t begin, size_t end, char* out) const {
+    end = min(end, _len);
+    if (begin >= end)
+        return 0;
+
+    if (_dna) {
+        packedBases(begin, end, out);
+        return end - begin;
+    }
+
+    if (_cache) {
+        cachedBases(begin, end, out);
+        return end - begin;
+    }
+
+    // a line at a time
+    size_t line = begin / _lineBases;
+    size_t skip = begin - line * _lineBases;
+    char const* src = _data + line * _lineLength;
+    size_t left = end - begin;
+    while (left) {
+        size_t n = min(left, _lineBases - skip);
+        copy(src + skip, src + skip + n, out);
+        out += n;
+        left -= n;
+        skip = 0;
+        src += _lineLength;
+    }
+    return end - begin;
+}
+
 Fasta::Fasta(
         std::string const& name,
         char const* data,
@@ -172,8 +442,9 @@ Fasta::Fasta(
     , _data(data)
     , _len(len)
 {
-    IndexGenerator gen(data, len);
+    IndexGenerator<TextCursor> gen(TextCursor(data, len));
     _index = gen.generate();
+    addTextContigs();
 }
 
 Fasta::Fasta(std::string const& path)
@@ -188,13 +459,37 @@ Fasta::Fasta(std::string const& path)
     _data = _f->data();
     _len = _f->size();
 
+    if (isTwoBit(_data, _len)) {
+        auto seqs = readTwoBit(_data, _len, path);
+        for (auto i = seqs.begin(); i != seqs.end(); ++i) {
+            _names.push_back(i->first);
+            _contigs[i->first] = i->second;
+        }
+        return;
+    }
+
+    // bgzf is gzip with extra fields, checked by the cache
+    bool compressed = _len >= 2 && uint8_t(_data[0]) == 0x1f && uint8_t(_data[1]) == 0x8b;
+    if (compressed) {
+        string gziPath = path + BGZF_INDEX_EXTENSION;
+        if (!boost::filesystem::exists(gziPath))
+            gziPath.clear();
+        _cache.reset(new BgzfBlockCache(_data, _len, path, gziPath));
+    }
+
     string faiPath = path + INDEX_EXTENSION;
     ifstream in(faiPath);
     if (in) {
         _index.reset(new Index(in));
     } else {
-        IndexGenerator gen(_data, _len);
-        _index = gen.generate();
+        // compressed text is indexed as it is inflated, a block at a time
+        if (compressed) {
+            IndexGenerator<BlockCursor> gen((BlockCursor(*_cache)));
+            _index = gen.generate();
+        } else {
+            IndexGenerator<TextCursor> gen(TextCursor(_data, _len));
+            _index = gen.generate();
+        }
         ofstream out(faiPath);
         if (!out) {
             throw IOError(str(format(
@@ -202,6 +497,7 @@ Fasta::Fasta(std::string const& path)
         }
         _index->save(out);
     }
+    addTextContigs();
 }
 
 Fasta::~Fasta() {
@@ -210,17 +506,34 @@ Fasta::~Fasta() {
     // types in the header.
 }
 
+void Fasta::addTextContigs() {
+    _names = _index->names();
+    for (auto i = _names.begin(); i != _names.end(); ++i) {
+        Index::Entry const* e = _index->entry(*i);
+        if (_cache)
+            _contigs[*i] = Contig(_cache.get(), e->offset, e->len, e->lineBasesLength, e->lineLength);
+        else
+            _contigs[*i] = Contig(_data + e->offset, e->len, e->lineBasesLength, e->lineLength);
+    }
+}
+
 std::string const& Fasta::name() const {
     return _name;
 }
 
-size_t Fasta::seqlen(std::string const& seq) const {
-    Index::Entry const* e = _index->entry(seq);
-    if (e) {
-        return e->len;
-    }    
+Fasta::Contig Fasta::contig(std::string const& seq) const {
+    auto iter = _contigs.find(seq);
+    if (iter == _contigs.end())
+        return Contig();
+    return iter->second;
+}
+
+vector<string> const& Fasta::sequenceNames() const {
+    return _names;
+}
 
-    return 0;
+size_t Fasta::seqlen(std::string const& seq) const {
+    return contig(seq).length();
 }
 
 std::string Fasta::sequence(std::string const& seq, size_t pos, size_t len) const {
@@ -228,34 +541,22 @@ std::string Fasta::sequence(std::string const& seq, size_t pos, size_t len) cons
         throw runtime_error("Fasta::sequence expects one based coordinates.");
     }
 
-    Index::Entry const* e = _index->entry(seq);
-    if (!e) {
+    Contig c = contig(seq);
+    if (!c.valid()) {
         throw UnknownSequenceError(str(format(
             "Sequence '%1%' not found in fasta '%2%'") %seq %_name));
     }
 
-    if (pos > e->len || pos+len - 1 > e->len) {
+    if (pos > c.length() || pos+len - 1 > c.length()) {
         throw length_error(str(format(
             "Request for %1%:%2%-%3% in %4%, but %1% has length %5%"
-            ) %seq %pos %(pos+len) %_name %e->len));
-    }
-    
-    // convert to 0 based array index
-    --pos;
-
-    size_t skipLines = pos / e->lineBasesLength;
-    size_t lineStart = e->offset + skipLines*e->lineLength;
-    size_t skipBases = pos - skipLines*e->lineBasesLength;
-    string rv;
-    while (len) {
-        size_t start = lineStart+skipBases;
-        size_t thisLen = min(len, e->lineBasesLength-skipBases);
-        len -= thisLen;
-        rv.append(_data+start, thisLen);
-        skipBases = 0;
-        lineStart += e->lineLength;
-    }
-    
+            ) %seq %pos %(pos+len) %_name %c.length()));
+    }
+
+    // contigs are zero based
+    string rv(len, '\0');
+    if (len)
+        c.bases(pos - 1, pos - 1 + len, &rv[0]);
     return rv;
 }
 
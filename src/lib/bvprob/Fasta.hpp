@@ -2,13 +2,116 @@
 
 #include <boost/iostreams/device/mapped_file.hpp>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
+class BgzfBlockCache;
+
+// A reference sequence file: plain text fasta, indexed by a .fai that is
+// written next to it if missing, bgzip compressed fasta, or UCSC .2bit (see
+// TwoBit.hpp). The formats are told apart by their signatures. Either way the
+// file is memory mapped and read in place. Compressed fasta is inflated a
+// block at a time, as it is read, through a BgzfBlockCache; its .gzi is used
+// if there is one.
 class Fasta {
 public:
     class Index;
 
+    // A sequence of the fasta, looked up once so that its bases can be read
+    // without going through the index or allocating. Positions are zero
+    // based. It is valid as long as the Fasta is.
+    class Contig {
+    public:
+        // runs of positions in a 2bit sequence, as arrays of little endian
+        // uint32 starts and sizes, sorted by start. they need not be aligned.
+        struct Runs {
+            char const* starts;
+            char const* sizes;
+            uint32_t count;
+
+            uint32_t start(uint32_t i) const {
+                return load(starts, i);
+            }
+
+            uint32_t size(uint32_t i) const {
+                return load(sizes, i);
+            }
+
+            // the first run ending after pos
+            uint32_t find(size_t pos) const;
+
+            static uint32_t load(char const* p, uint32_t i) {
+                uint32_t rv;
+                memcpy(&rv, p + 4 * size_t(i), sizeof(rv));
+                return rv;
+            }
+        };
+
+        Contig();
+        // a text sequence laid out in lines of lineBases bases
+        Contig(char const* data, size_t len, size_t lineBases, size_t lineLength);
+        // a 2bit sequence: dna holds four bases to a byte, the first in the
+        // high bits, and the runs give the positions that are N or lower case
+        Contig(uint8_t const* dna, size_t len, Runs const& nRuns, Runs const& maskRuns);
+        // a text sequence starting at uncompressed offset of a bgzf file
+        Contig(
+            BgzfBlockCache* cache,
+            uint64_t offset,
+            size_t len,
+            size_t lineBases,
+            size_t lineLength
+            );
+
+        // false for sequences not in the fasta
+        bool valid() const {
+            return _data != 0 || _dna != 0 || _cache != 0;
+        }
+
+        size_t length() const {
+            return _len;
+        }
+
+        // the base at pos, or 0 if pos is past the end
+        char base(size_t pos) const {
+            if (pos >= _len)
+                return 0;
+            if (_dna)
+                return packedBase(pos);
+            if (_cache)
+                return cachedBase(pos);
+            return _data[pos / _lineBases * _lineLength + pos % _lineBases];
+        }
+
+        // copy the bases in [begin, end) to out, stopping at the end of the
+        // sequence. returns the number copied.
+        size_t bases(size_t begin, size_t end, char* out) const;
+
+    protected:
+        char packedBase(size_t pos) const;
+        void packedBases(size_t begin, size_t end, char* out) const;
+        char cachedBase(size_t pos) const;
+        void cachedBases(size_t begin, size_t end, char* out) const;
+
+    protected:
+        // the first base of a text sequence
+        char const* _data;
+        // the packed bases of a 2bit sequence
+        uint8_t const* _dna;
+        size_t _len;
+        size_t _lineBases;
+        // including the line terminator
+        size_t _lineLength;
+        Runs _nRuns;
+        Runs _maskRuns;
+        // the blocks of a bgzf sequence, and the offset of its first base
+        BgzfBlockCache* _cache;
+        uint64_t _offset;
+    };
+
     explicit Fasta(std::string const& path);
 
     // this is useful for testing with with data in memory
@@ -20,16 +123,28 @@ public:
 
     ~Fasta();
 
+    // an invalid Contig if seq is not in the fasta
+    Contig contig(std::string const& seq) const;
+
+    // in the order of the file
+    std::vector<std::string> const& sequenceNames() const;
+
     size_t seqlen(std::string const& seq) const;
     char sequence(std::string const& seq, size_t pos) const;
     std::string sequence(std::string const& seq, size_t pos, size_t len) const;
 
     std::string const& name() const;
 
+protected:
+    void addTextContigs();
+
 protected:
     std::string _name;
     std::unique_ptr<Index> _index;
     char const* _data;
     size_t _len;
     std::unique_ptr<boost::iostreams::mapped_file_source> _f;
+    std::unique_ptr<BgzfBlockCache> _cache;
+    std::vector<std::string> _names;
+    std::map<std::string, Contig> _contigs;
 };
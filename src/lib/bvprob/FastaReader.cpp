@@ -1,20 +1,43 @@
 #include "FastaReader.hpp"
+#include "Tokenizer.hpp"
 
 #include <boost/format.hpp>
+#include <algorithm>
 #include <cassert>
+#include <fstream>
 #include <stdexcept>
 
 using boost::format;
 using namespace std;
 
-FastaReader::FastaReader(const std::string& path)
+FastaReader::FastaReader(const std::string& path, int32_t windowSize)
     : _path(path)
+    , _windowSize(max(windowSize, 1))
     , _len(0)
+    , _begin(0)
+    , _end(0)
     , _buf(NULL)
 {
     _fai = fai_load(path.c_str());
     if (_fai == NULL)
         throw runtime_error(str(format("Failed to load fasta file: %1%") %path));
+
+    // faidx doesn't give out sequence lengths, but fai_load made sure the
+    // index is there
+    string faiPath = path + ".fai";
+    ifstream in(faiPath.c_str());
+    string line;
+    while (getline(in, line)) {
+        Tokenizer<char> tok(line, '\t');
+        string name;
+        int32_t len;
+        if (!tok.extract(name) || !tok.extract(len)) {
+            fai_destroy(_fai);
+            throw runtime_error(str(format(
+                "Failed to parse fasta index line '%1%' in %2%") %line %faiPath));
+        }
+        _lengths[name] = len;
+    }
 }
 
 FastaReader::~FastaReader() {
@@ -23,14 +46,35 @@ FastaReader::~FastaReader() {
     fai_destroy(_fai);
 }
 
+void FastaReader::fill(int32_t pos) {
+    // a little behind pos, so that stepping back now and then doesn't
+    // refill, and the rest ahead of it
+    _begin = max(pos - _windowSize / 8, 0);
+    _end = int32_t(min<int64_t>(int64_t(_begin) + _windowSize, _len));
+
+    if (_buf)
+        free(_buf);
+    int n = 0;
+    _buf = faidx_fetch_seq(_fai, &_region[0], _begin, _end - 1, &n);
+    if (_buf == NULL || n != _end - _begin) {
+        string msg = str(format("Failed to read %1%:%2%-%3% from fasta file %4%")
+            %_region %(_begin + 1) %_end %_path);
+        _begin = _end = 0;
+        throw runtime_error(msg);
+    }
+}
+
 char FastaReader::sequence(const std::string& region, int32_t pos) {
     if (region != _region) {
-        if (_buf) free(_buf);
-        _buf = fai_fetch(_fai, region.c_str(), &_len);
+        auto iter = _lengths.find(region);
+        _len = iter == _lengths.end() ? 0 : iter->second;
         _region = region;
+        _begin = _end = 0;
     }
-    if (_len <= pos) {
+    if (pos < 0 || _len <= pos) {
         throw length_error(str(format("Invalid fasta read request: file %1%, region %2%, position %3%, but region length=%4%") %_path %region %pos %_len));
     }
-    return _buf[pos];
+    if (pos < _begin || pos >= _end)
+        fill(pos);
+    return _buf[pos - _begin];
 }
@@ -1,23 +1,43 @@
 #pragma once
 
 #include <faidx.h>
+#include <cstdint>
+#include <map>
 #include <string>
 
+// Reads a fasta through samtools faidx, keeping a window of at most
+// windowSize bases of the last sequence read. The window is refilled from
+// the requested position onwards when a position outside of it is asked
+// for, so sweeping through a sequence reads it once, a window at a time,
+// and a jump to a distant position only reads a window around it.
 class FastaReader {
 public:
-    FastaReader(const std::string& path);
+    static int32_t const DEFAULT_WINDOW_SIZE = 1 << 16;
+
+    FastaReader(const std::string& path, int32_t windowSize = DEFAULT_WINDOW_SIZE);
     ~FastaReader();
 
     const std::string& path() const {
         return _path;
     }
 
+    // the base at zero based pos of sequence region. throws length_error
+    // for unknown sequences and positions past their end.
     char sequence(const std::string& region, int32_t pos);
 
+protected:
+    void fill(int32_t pos);
+
 protected:
     faidx_t* _fai;
     std::string _path;
+    int32_t _windowSize;
+    // sequence lengths, from the .fai
+    std::map<std::string, int32_t> _lengths;
     std::string _region;
     int _len;
+    // the bases in [_begin, _end) of _region
+    int32_t _begin;
+    int32_t _end;
     char* _buf;
 };
@@ -1,6 +1,5 @@
 #include "PBin.hpp"
 #include "utility/Lut.hpp"
-#include "utility/Lut.hpp"
 
 #include <algorithm>
 #include <cassert>
@@ -23,8 +22,23 @@ void PBin::setValues(const uint8_t* begin, const uint8_t* end)
     }
 }
 
+void PBin::setValues(const uint32_t* histogram, uint32_t first, uint32_t last)
+{
+    size = 0;
+    harmonicMean = 0.0;
+    // one value at a time, in ascending order, to get exactly the sum of
+    // the sorted array version
+    for (uint32_t q = first; q < last; ++q) {
+        double reciprocal = Lut::phred2p_reciprocal(q);
+        for (uint32_t i = 0; i < histogram[q]; ++i)
+            harmonicMean += reciprocal;
+        size += histogram[q];
+    }
+    if (size > 0)
+        harmonicMean = size / harmonicMean;
+}
+
 uint32_t binPValues2(const uint8_t* sortedPVals, uint32_t n, std::vector<PBin>& rv) {
-    std::vector<uint8_t> diffs(n - 1);
     uint8_t maxGap = 0.0;
     uint32_t maxIdx = 0;
     for (uint32_t i = 1; i < n; ++i) {
@@ -93,3 +107,42 @@ uint32_t binPValues(const uint8_t* sortedPVals, uint32_t n, uint32_t requestedBi
 
     return nBins;
 }
+
+uint32_t binPValues(const uint32_t* histogram, uint32_t requestedBins, PBin* rv)
+{
+    if (requestedBins == 0)
+        return 0;
+
+    // the distinct values present. the gaps between consecutive ones are the
+    // candidate bin boundaries; the widest gaps win, earlier ones first on
+    // ties, as in the sorted array version.
+    uint32_t values[256];
+    uint32_t nValues = 0;
+    for (uint32_t q = 0; q < 256; ++q) {
+        if (histogram[q])
+            values[nValues++] = q;
+    }
+
+    uint32_t nBins = std::min(std::max(nValues, 1u), requestedBins);
+
+    // order the gaps widest first. an insertion sort is stable, and unlike
+    // stable_sort needs no temporary buffer.
+    uint32_t gaps[256];
+    uint32_t nGaps = 0;
+    for (uint32_t i = 1; i < nValues; ++i) {
+        uint32_t width = values[i] - values[i - 1];
+        uint32_t j = nGaps++;
+        for (; j > 0 && values[gaps[j - 1]] - values[gaps[j - 1] - 1] < width; --j)
+            gaps[j] = gaps[j - 1];
+        gaps[j] = i;
+    }
+    sort(gaps, gaps + nBins - 1);
+
+    uint32_t first = 0;
+    for (uint32_t i = 0; i < nBins - 1; ++i) {
+        rv[i].setValues(histogram, first, values[gaps[i]]);
+        first = values[gaps[i]];
+    }
+    rv[nBins - 1].setValues(histogram, first, 256);
+    return nBins;
+}
@@ -10,7 +10,15 @@ public:
     double pObserveRef;
 
     void setValues(const uint8_t* begin, const uint8_t* end);
+    // the values in [first, last) of a 256 bucket histogram
+    void setValues(const uint32_t* histogram, uint32_t first, uint32_t last);
 };
 
 uint32_t binPValues2(const uint8_t* sortedPVals, uint32_t n, std::vector<PBin>& rv);
 uint32_t binPValues(const uint8_t* sortedPVals, uint32_t n, uint32_t requestedBins, std::vector<PBin>& rv);
+
+// same as above for values given as counts in a 256 bucket histogram. the
+// bins are identical to those of the sorted values the histogram describes,
+// without the values ever being expanded and sorted.
+// rv must have room for requestedBins bins.
+uint32_t binPValues(const uint32_t* histogram, uint32_t requestedBins, PBin* rv);
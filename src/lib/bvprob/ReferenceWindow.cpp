@@ -0,0 +1,56 @@
+#include "ReferenceWindow.hpp"
+
+#include <bam.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+uint32_t const ReferenceWindow::DEFAULT_SIZE;
+
+ReferenceWindow::ReferenceWindow(vector<Fasta::Contig> const& contigs, uint32_t size)
+    : _contigs(contigs)
+    , _size(size)
+    , _tid(-1)
+    , _begin(0)
+    , _end(0)
+{
+    if (_size == 0)
+        throw invalid_argument("ReferenceWindow: the window size must be positive");
+}
+
+bool ReferenceWindow::load(int tid, uint32_t pos) {
+    if (tid < 0 || size_t(tid) >= _contigs.size())
+        return false;
+    Fasta::Contig const& contig = _contigs[tid];
+    if (pos >= contig.length())
+        return false;
+
+    _codes.resize(_size);
+    char* chars = reinterpret_cast<char*>(_codes.data());
+    uint32_t n = contig.bases(pos, pos + min<size_t>(_size, contig.length() - pos), chars);
+    for (uint32_t i = 0; i < n; ++i)
+        _codes[i] = bam_nt16_table[_codes[i]];
+
+    _tid = tid;
+    _begin = pos;
+    _end = pos + n;
+    return true;
+}
+
+uint32_t ReferenceWindow::bases(int tid, uint32_t begin, uint32_t end, uint8_t* ref) {
+    uint32_t rv = 0;
+    while (begin < end) {
+        if (tid != _tid || begin < _begin || begin >= _end) {
+            if (!load(tid, begin))
+                break;
+        }
+        uint32_t n = min(end, _end) - begin;
+        memcpy(ref + rv, &_codes[begin - _begin], n);
+        rv += n;
+        begin += n;
+    }
+    return rv;
+}
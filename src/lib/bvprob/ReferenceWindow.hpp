@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Fasta.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The reference under a sweep along the genome, decoded ahead of it. Bases
+// are read from the fasta a large window at a time, line breaks dropped, and
+// converted to nt16 codes once, so that looking up a base or a run of them is
+// an index into (or a copy from) one contiguous buffer. The window is moved
+// to start at the first position asked for outside of it, so it suits
+// positions asked for in order; going back just decodes again. One object
+// serves one sweep; it is not safe to share between threads.
+class ReferenceWindow {
+public:
+    static uint32_t const DEFAULT_SIZE = 1 << 18;
+
+    // contigs, indexed by tid, must outlive this object
+    explicit ReferenceWindow(std::vector<Fasta::Contig> const& contigs, uint32_t size = DEFAULT_SIZE);
+
+    // the nt16 code of the base at zero based tid:pos, or -1 if pos is
+    // past the end of the sequence or the sequence is not in the fasta
+    int base(int tid, uint32_t pos) {
+        if (tid != _tid || pos < _begin || pos >= _end) {
+            if (!load(tid, pos))
+                return -1;
+        }
+        return _codes[pos - _begin];
+    }
+
+    // write the nt16 codes of the bases in [begin, end) of tid to ref,
+    // stopping at the end of the sequence. returns the number written. this
+    // is a BamIntersector::reference_t.
+    uint32_t bases(int tid, uint32_t begin, uint32_t end, uint8_t* ref);
+
+protected:
+    // move the window to start at tid:pos. false if there is nothing there.
+    bool load(int tid, uint32_t pos);
+
+protected:
+    std::vector<Fasta::Contig> const& _contigs;
+    uint32_t _size;
+    std::vector<uint8_t> _codes;
+    // the window holds [_begin, _end) of _tid
+    int _tid;
+    uint32_t _begin;
+    uint32_t _end;
+};
@@ -4,6 +4,7 @@
 
 #include <bam.h>
 
+#include <algorithm>
 #include <cmath>
 #include <iomanip>
 #include <sstream>
@@ -11,13 +12,47 @@
 
 using namespace std;
 
-ResultFormatter::ResultFormatter(std::ostream* out, bool fixedPoint, uint32_t precision)
+ResultFormatter::ResultFormatter(std::ostream* out, bool fixedPoint, uint32_t precision, bool reportDropped)
     : _out(out)
     , _fixedPoint(fixedPoint)
     , _precision(precision)
+    , _reportDropped(reportDropped)
 {
 }
 
+SiteResult::SiteResult(
+    const char* sequenceName,
+    int32_t pos,
+    int ref,
+    int nVariant,
+    int tVariant,
+    int nBaseCounts[4],
+    int tBaseCounts[4],
+    const Sample& normal,
+    const Sample& tumor,
+    const Bassovac& bv
+    )
+    : sequenceName(sequenceName)
+    , pos(pos)
+    , ref(ref)
+    , nVariant(nVariant)
+    , tVariant(tVariant)
+    , nTotalReads(normal.totalReads)
+    , nSupportingReads(normal.supportingReads)
+    , tTotalReads(tumor.totalReads)
+    , tSupportingReads(tumor.supportingReads)
+    , nDroppedReads(0)
+    , tDroppedReads(0)
+    , homozygousVariantProbability(bv.homozygousVariantProbability())
+    , heterozygousVariantProbability(bv.heterozygousVariantProbability())
+    , somaticVariantProbability(bv.somaticVariantProbability())
+    , lossOfHeterozygosityProbability(bv.lossOfHeterozygosityProbability())
+    , nonNotableEventProbability(bv.nonNotableEventProbability())
+{
+    copy(nBaseCounts, nBaseCounts + 4, this->nBaseCounts);
+    copy(tBaseCounts, tBaseCounts + 4, this->tBaseCounts);
+}
+
 void ResultFormatter::printResult(
     const char* sequenceName,
     int32_t pos,
@@ -31,29 +66,34 @@ void ResultFormatter::printResult(
     const Bassovac& bv
     )
 {
+    printResult(SiteResult(sequenceName, pos, ref, nVariant, tVariant,
+        nBaseCounts, tBaseCounts, normal, tumor, bv));
+}
+
+void ResultFormatter::printResult(const SiteResult& r) {
     *_out << 
         (_fixedPoint ? fixed : scientific) << 
         setprecision(_precision) << 
-        sequenceName <<
-        "\t" << pos <<
-        "\t" << (pos+1) <<
-        "\t" << bam_nt16_rev_table[ref] <<
-        "\t" << (nVariant ? bam_nt16_rev_table[nVariant] : '.') <<
-        "\t" << (tVariant ? bam_nt16_rev_table[tVariant] : '.') <<
-        "\t" << nBaseCounts[0] << "," << nBaseCounts[1] << "," << nBaseCounts[2] << "," << nBaseCounts[3] <<
-        "\t" << tBaseCounts[0] << "," << tBaseCounts[1] << "," << tBaseCounts[2] << "," << tBaseCounts[3] <<
-        "\t" << normal.totalReads <<
-        "\t" << normal.supportingReads <<
-//        "\t" << normal.readErrorProbability <<
-        "\t" << tumor.totalReads << 
-        "\t" << tumor.supportingReads <<
-//        "\t" << tumor.readErrorProbability <<
-        "\t" << bv.homozygousVariantProbability() <<
-        "\t" << bv.heterozygousVariantProbability() <<
-        "\t" << bv.somaticVariantProbability() <<
-        "\t" << bv.lossOfHeterozygosityProbability() <<
-        "\t" << bv.nonNotableEventProbability() << 
-        "\n";
+        r.sequenceName <<
+        "\t" << r.pos <<
+        "\t" << (r.pos+1) <<
+        "\t" << bam_nt16_rev_table[r.ref] <<
+        "\t" << (r.nVariant ? bam_nt16_rev_table[r.nVariant] : '.') <<
+        "\t" << (r.tVariant ? bam_nt16_rev_table[r.tVariant] : '.') <<
+        "\t" << r.nBaseCounts[0] << "," << r.nBaseCounts[1] << "," << r.nBaseCounts[2] << "," << r.nBaseCounts[3] <<
+        "\t" << r.tBaseCounts[0] << "," << r.tBaseCounts[1] << "," << r.tBaseCounts[2] << "," << r.tBaseCounts[3] <<
+        "\t" << r.nTotalReads <<
+        "\t" << r.nSupportingReads <<
+        "\t" << r.tTotalReads << 
+        "\t" << r.tSupportingReads <<
+        "\t" << r.homozygousVariantProbability <<
+        "\t" << r.heterozygousVariantProbability <<
+        "\t" << r.somaticVariantProbability <<
+        "\t" << r.lossOfHeterozygosityProbability <<
+        "\t" << r.nonNotableEventProbability;
+    if (_reportDropped)
+        *_out << "\t" << r.nDroppedReads << "\t" << r.tDroppedReads;
+    *_out << "\n";
 }
 
 string ResultFormatter::describeFormat() {
@@ -85,5 +125,10 @@ string ResultFormatter::describeFormat() {
     for (unsigned i = 0; i < sizeof(fields)/sizeof(fields[0]); ++i) {
         ss << "\t" << (i+1) << ") " << fields[i] << "\n";
     }
+
+    unsigned n = sizeof(fields)/sizeof(fields[0]);
+    ss << "\nWith --downsample-depth, two more fields follow:\n\n"
+        << "\t" << (n+1) << ") Normal reads covering this position dropped by downsampling\n"
+        << "\t" << (n+2) << ") Tumor reads covering this position dropped by downsampling\n";
     return ss.str();
 }
@@ -1,14 +1,56 @@
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 
 class Bassovac;
 struct Sample;
 
+// Everything printed for one site. This is a plain value so that results can
+// be queued and formatted away from the Sample and Bassovac objects that
+// produced them.
+struct SiteResult {
+    SiteResult() {}
+    SiteResult(
+        const char* sequenceName,
+        int32_t pos,
+        int ref,
+        int nVariant,
+        int tVariant,
+        int nBaseCounts[4],
+        int tBaseCounts[4],
+        const Sample& normal,
+        const Sample& tumor,
+        const Bassovac& bv
+        );
+
+    const char* sequenceName;
+    int32_t pos;
+    int ref;
+    int nVariant;
+    int tVariant;
+    int nBaseCounts[4];
+    int tBaseCounts[4];
+    unsigned nTotalReads;
+    unsigned nSupportingReads;
+    unsigned tTotalReads;
+    unsigned tSupportingReads;
+    // reads left out by downsampling
+    unsigned nDroppedReads;
+    unsigned tDroppedReads;
+    double homozygousVariantProbability;
+    double heterozygousVariantProbability;
+    double somaticVariantProbability;
+    double lossOfHeterozygosityProbability;
+    double nonNotableEventProbability;
+};
+
 class ResultFormatter {
 public:
-    ResultFormatter(std::ostream* out, bool fixedPoint, uint32_t precision);
+    // with reportDropped, the numbers of normal and tumor reads dropped by
+    // downsampling are printed after the other fields
+    ResultFormatter(std::ostream* out, bool fixedPoint, uint32_t precision, bool reportDropped = false);
 
     void printResult(
         const char* sequenceName,
@@ -23,10 +65,13 @@ public:
         const Bassovac& bv
         );
 
+    void printResult(const SiteResult& result);
+
     static std::string describeFormat();
 
 protected:
     std::ostream* _out;
     bool _fixedPoint;
     uint32_t _precision;
+    bool _reportDropped;
 };
@@ -1,17 +1,20 @@
 #include "Sample.hpp"
 
+#include <algorithm>
 #include <cstdint>
 
 using namespace std;
 
+uint32_t const Sample::MAX_BINS;
+
 Sample::Sample()
     : totalReads(0)
     , supportingReads(0)
     , variantFrequency(0.0)
+    , nBins(0)
     , adjustedPurity(0.0)
     , adjustedPurityComplement(0.0)
 {
-    readErrorBins.resize(5);
 }
 
 void Sample::setValues(
@@ -24,14 +27,31 @@ void Sample::setValues(
         uint32_t nPvals,
         uint32_t nBins
         )
+{
+    uint32_t histogram[256] = {0};
+    for (uint32_t i = 0; i < nPvals; ++i)
+        ++histogram[sortedPvals[i]];
+
+    setValues(totalReads, supportingReads, variantFrequency, adjustedPurity,
+        adjustedPurityComplement, histogram, nBins);
+}
+
+void Sample::setValues(
+        unsigned totalReads,
+        unsigned supportingReads,
+        double variantFrequency,
+        double adjustedPurity,
+        double adjustedPurityComplement,
+        const uint32_t* pvalHistogram,
+        uint32_t nBins
+        )
 {
     this->totalReads = totalReads;
     this->supportingReads = supportingReads;
     this->variantFrequency = variantFrequency;
-    this->readErrorBins = readErrorBins;
     this->adjustedPurity = adjustedPurity;
     this->adjustedPurityComplement = adjustedPurityComplement;
-    this->nBins = binPValues(sortedPvals, nPvals, nBins, readErrorBins);
+    this->nBins = binPValues(pvalHistogram, min(nBins, MAX_BINS), readErrorBins);
 }
 
 double Sample::piecewisePhi(const AlleleType alleles[2]) const {
@@ -45,24 +65,26 @@ std::ostream& operator<<(std::ostream& out, const Sample& s) {
     out << s.totalReads << "\t"
         << s.supportingReads << "\t"
         << s.variantFrequency << "\t"
-        << s.readErrorBins.size() << "\t";
-    for (auto iter = s.readErrorBins.begin(); iter != s.readErrorBins.end(); ++iter)
-        out << iter->size << "\t" << iter->harmonicMean << "\t";
+        << s.nBins << "\t";
+    for (uint32_t i = 0; i < s.nBins; ++i)
+        out << s.readErrorBins[i].size << "\t" << s.readErrorBins[i].harmonicMean << "\t";
     out << s.adjustedPurity << "\t" << s.adjustedPurityComplement << "\n";
  
     return out;
 }
 
 std::istream& operator>>(std::istream& in, Sample& s) {
-    size_t nBins;
     s.totalReads = 6;
     in >> s.totalReads 
         >> s.supportingReads 
         >> s.variantFrequency 
-        >> nBins;
-    s.readErrorBins.resize(nBins);
-    for (auto iter = s.readErrorBins.begin(); iter != s.readErrorBins.end(); ++iter)
-        in >> iter->size >> iter->harmonicMean;
+        >> s.nBins;
+    if (s.nBins > Sample::MAX_BINS) {
+        in.setstate(std::ios::failbit);
+        return in;
+    }
+    for (uint32_t i = 0; i < s.nBins; ++i)
+        in >> s.readErrorBins[i].size >> s.readErrorBins[i].harmonicMean;
     in >> s.adjustedPurity >> s.adjustedPurityComplement;
      
     return in;
@@ -4,7 +4,6 @@
 
 #include <cstdint>
 #include <iostream>
-#include <vector>
 
 enum AlleleType {
     VAR,
@@ -12,6 +11,10 @@ enum AlleleType {
 };
 
 struct Sample {
+    // the most read error bins a sample can hold. the bins are stored in
+    // place so that making a Sample allocates nothing.
+    static uint32_t const MAX_BINS = 5;
+
     Sample();
 
     void setValues(
@@ -25,12 +28,24 @@ struct Sample {
         uint32_t nBins
         );
 
+    // as above, with the read error probabilities given as a 256 bucket
+    // phred histogram
+    void setValues(
+        unsigned totalReads,
+        unsigned supportingReads,
+        double variantFrequency,
+        double adjustedPurity,
+        double adjustedPurityComplement,
+        const uint32_t* pvalHistogram,
+        uint32_t nBins
+        );
+
     double piecewisePhi(const AlleleType alleles[2]) const;
 
     unsigned totalReads;
     unsigned supportingReads;
     double variantFrequency;
-    std::vector<PBin> readErrorBins;
+    PBin readErrorBins[MAX_BINS];
     uint32_t nBins;
     double adjustedPurity;
     double adjustedPurityComplement;
@@ -0,0 +1,251 @@
+#include "TwoBit.hpp"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+
+using boost::format;
+using namespace std;
+
+namespace {
+    uint32_t const SIGNATURE = 0x1A412743;
+    uint32_t const SWAPPED_SIGNATURE = 0x4327411A;
+    // version 1 has 64 bit sequence offsets
+    uint32_t const MAX_VERSION = 1;
+    // at least this many bases are read from the fasta at a time
+    size_t const CHUNK_SIZE = 1 << 20;
+
+    // the 2 bit code of c, in the order TCAG, or -1 for other bases
+    int code(char c) {
+        switch (c) {
+            case 'T': case 't': return 0;
+            case 'C': case 'c': return 1;
+            case 'A': case 'a': return 2;
+            case 'G': case 'g': return 3;
+            default: return -1;
+        }
+    }
+
+    // reads little endian fields from a mapped file, checking bounds
+    class Cursor {
+    public:
+        Cursor(char const* data, size_t len, size_t pos, string const& path)
+            : _data(data)
+            , _len(len)
+            , _pos(pos)
+            , _path(path)
+        {
+        }
+
+        char const* take(size_t n) {
+            if (_pos > _len || n > _len - _pos) {
+                throw runtime_error(str(format(
+                    "Truncated 2bit file %1%: %2% bytes needed at offset %3%")
+                    % _path % n % _pos));
+            }
+            char const* rv = _data + _pos;
+            _pos += n;
+            return rv;
+        }
+
+        uint32_t u32() {
+            uint32_t rv;
+            memcpy(&rv, take(sizeof(rv)), sizeof(rv));
+            return rv;
+        }
+
+        uint64_t u64() {
+            uint64_t rv;
+            memcpy(&rv, take(sizeof(rv)), sizeof(rv));
+            return rv;
+        }
+
+        uint8_t u8() {
+            return uint8_t(*take(1));
+        }
+
+        Fasta::Contig::Runs runs() {
+            Fasta::Contig::Runs rv;
+            rv.count = u32();
+            rv.starts = take(4 * size_t(rv.count));
+            rv.sizes = take(4 * size_t(rv.count));
+            return rv;
+        }
+
+    protected:
+        char const* _data;
+        size_t _len;
+        size_t _pos;
+        string const& _path;
+    };
+
+    void put32(ostream& out, uint32_t x) {
+        out.write(reinterpret_cast<char const*>(&x), sizeof(x));
+    }
+
+    void put64(ostream& out, uint64_t x) {
+        out.write(reinterpret_cast<char const*>(&x), sizeof(x));
+    }
+
+    // the runs of a sequence, as they are written
+    struct RunList {
+        vector<uint32_t> starts;
+        vector<uint32_t> sizes;
+
+        // extend the last run with pos, or start a new one
+        void add(uint32_t pos) {
+            if (!starts.empty() && starts.back() + sizes.back() == pos) {
+                ++sizes.back();
+            } else {
+                starts.push_back(pos);
+                sizes.push_back(1);
+            }
+        }
+
+        void write(ostream& out) const {
+            put32(out, uint32_t(starts.size()));
+            if (!starts.empty()) {
+                out.write(reinterpret_cast<char const*>(starts.data()), 4 * starts.size());
+                out.write(reinterpret_cast<char const*>(sizes.data()), 4 * sizes.size());
+            }
+        }
+    };
+
+    struct SequenceRuns {
+        RunList n;
+        RunList mask;
+
+        // the size of the sequence record of a sequence of len bases
+        uint64_t recordSize(size_t len) const {
+            return 4 + 4 + 8 * uint64_t(n.starts.size())
+                + 4 + 8 * uint64_t(mask.starts.size())
+                + 4 + (len + 3) / 4;
+        }
+    };
+}
+
+bool isTwoBit(char const* data, size_t len) {
+    if (len < 4)
+        return false;
+    uint32_t signature;
+    memcpy(&signature, data, sizeof(signature));
+    return signature == SIGNATURE || signature == SWAPPED_SIGNATURE;
+}
+
+vector<pair<string, Fasta::Contig>> readTwoBit(char const* data, size_t len, string const& path) {
+    Cursor header(data, len, 0, path);
+    uint32_t signature = header.u32();
+    if (signature == SWAPPED_SIGNATURE) {
+        throw runtime_error(str(format(
+            "2bit file %1% was written on a machine of the other byte order, which is not supported")
+            % path));
+    }
+    if (signature != SIGNATURE)
+        throw runtime_error(str(format("%1% is not a 2bit file") % path));
+
+    uint32_t version = header.u32();
+    if (version > MAX_VERSION)
+        throw runtime_error(str(format("Unsupported 2bit version %1% in %2%") % version % path));
+    uint32_t count = header.u32();
+    header.u32(); // reserved
+
+    vector<pair<string, Fasta::Contig>> rv;
+    rv.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t nameSize = header.u8();
+        string name(header.take(nameSize), nameSize);
+        uint64_t offset = version == 0 ? header.u32() : header.u64();
+        if (offset > len)
+            throw runtime_error(str(format("Invalid offset for sequence %1% in 2bit file %2%") % name % path));
+
+        Cursor record(data, len, size_t(offset), path);
+        uint32_t dnaSize = record.u32();
+        Fasta::Contig::Runs nRuns = record.runs();
+        Fasta::Contig::Runs maskRuns = record.runs();
+        record.u32(); // reserved
+        uint8_t const* dna = reinterpret_cast<uint8_t const*>(record.take((size_t(dnaSize) + 3) / 4));
+        rv.push_back(make_pair(name, Fasta::Contig(dna, dnaSize, nRuns, maskRuns)));
+    }
+    return rv;
+}
+
+void writeTwoBit(Fasta const& fasta, ostream& out) {
+    vector<string> const& names = fasta.sequenceNames();
+    vector<char> buf(CHUNK_SIZE);
+
+    // the runs are needed up front, to find where each record goes
+    vector<SequenceRuns> runs(names.size());
+    uint64_t indexSize = 0;
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (names[i].size() > numeric_limits<uint8_t>::max())
+            throw runtime_error(str(format("Sequence name %1% is too long for 2bit") % names[i]));
+        Fasta::Contig contig = fasta.contig(names[i]);
+        if (contig.length() > numeric_limits<uint32_t>::max())
+            throw runtime_error(str(format("Sequence %1% is too long for 2bit") % names[i]));
+
+        for (size_t pos = 0; pos < contig.length(); pos += buf.size()) {
+            size_t n = contig.bases(pos, pos + buf.size(), buf.data());
+            for (size_t k = 0; k < n; ++k) {
+                char c = buf[k];
+                if (code(c) < 0)
+                    runs[i].n.add(uint32_t(pos + k));
+                if (islower(uint8_t(c)))
+                    runs[i].mask.add(uint32_t(pos + k));
+            }
+        }
+        indexSize += 1 + names[i].size();
+    }
+
+    // offsets are 32 bits unless they don't fit
+    uint64_t records = 0;
+    for (size_t i = 0; i < names.size(); ++i)
+        records += runs[i].recordSize(fasta.seqlen(names[i]));
+    uint64_t headerSize = 16 + indexSize + 4 * names.size();
+    uint32_t version = headerSize + records > numeric_limits<uint32_t>::max() ? 1 : 0;
+    if (version == 1)
+        headerSize += 4 * names.size();
+
+    put32(out, SIGNATURE);
+    put32(out, version);
+    put32(out, uint32_t(names.size()));
+    put32(out, 0);
+    uint64_t offset = headerSize;
+    for (size_t i = 0; i < names.size(); ++i) {
+        out.put(char(names[i].size()));
+        out.write(names[i].data(), names[i].size());
+        if (version == 0)
+            put32(out, uint32_t(offset));
+        else
+            put64(out, offset);
+        offset += runs[i].recordSize(fasta.seqlen(names[i]));
+    }
+
+    vector<uint8_t> packed(CHUNK_SIZE / 4);
+    for (size_t i = 0; i < names.size(); ++i) {
+        Fasta::Contig contig = fasta.contig(names[i]);
+        put32(out, uint32_t(contig.length()));
+        runs[i].n.write(out);
+        runs[i].mask.write(out);
+        put32(out, 0);
+
+        // CHUNK_SIZE is a multiple of 4, so bytes never straddle chunks.
+        // N is packed as T (0), as UCSC does.
+        for (size_t pos = 0; pos < contig.length(); pos += buf.size()) {
+            size_t n = contig.bases(pos, pos + buf.size(), buf.data());
+            size_t bytes = (n + 3) / 4;
+            fill(packed.begin(), packed.begin() + bytes, 0);
+            for (size_t k = 0; k < n; ++k)
+                packed[k / 4] |= max(code(buf[k]), 0) << (6 - 2 * (k % 4));
+            out.write(reinterpret_cast<char const*>(packed.data()), bytes);
+        }
+    }
+
+    if (!out)
+        throw runtime_error(str(format("Failed to write 2bit version of %1%") % fasta.name()));
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Fasta.hpp"
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+// UCSC .2bit reference files: bases packed four to a byte, with tables of the
+// runs of N and of lower case bases. They take about a quarter of the space
+// of a fasta, mapped or on disk. Bases other than ACGT, e.g., IUPAC
+// ambiguity codes, are stored as N, as UCSC's faToTwoBit does.
+
+// whether data starts with a 2bit signature, in either byte order
+bool isTwoBit(char const* data, std::size_t len);
+
+// the sequences of the 2bit file mapped at data, in file order. the contigs
+// point into data. path is used in error messages.
+std::vector<std::pair<std::string, Fasta::Contig>> readTwoBit(
+    char const* data,
+    std::size_t len,
+    std::string const& path
+    );
+
+// write every sequence of fasta to out in 2bit format
+void writeTwoBit(Fasta const& fasta, std::ostream& out);
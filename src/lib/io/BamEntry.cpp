@@ -1,9 +1,10 @@
 #include "BamEntry.hpp"
 
 bool BamEntry::resolveCigar(uint32_t pos, PileupData& rv) const {
-    int readPos = _cigarParser.getSnvPileupOffset(pos - start());
+    int32_t readPos = cigarIndex().readOffset(pos - start());
     if (readPos >= 0) {
         rv.tid = tid();
+        rv.readOffset = readPos;
         rv.base = base(readPos);
         rv.quality = baseQuality(readPos);
         return true;
@@ -11,3 +12,30 @@ bool BamEntry::resolveCigar(uint32_t pos, PileupData& rv) const {
 
     return false;
 }
+
+void BamEntry::release(BamEntry const* entry) {
+    if (!entry)
+        return;
+    BamEntry* e = const_cast<BamEntry*>(entry);
+    if (e->_pool)
+        e->_pool->put(e);
+    else
+        delete e;
+}
+
+void BamEntry::release(BamEntry const* const* entries, std::size_t n) {
+    std::size_t i = 0;
+    while (i < n) {
+        EntryPool* pool = entries[i]->_pool;
+        if (!pool) {
+            delete entries[i++];
+            continue;
+        }
+
+        std::size_t j = i + 1;
+        while (j < n && entries[j]->_pool == pool)
+            ++j;
+        pool->put(const_cast<BamEntry* const*>(entries + i), j - i);
+        i = j;
+    }
+}
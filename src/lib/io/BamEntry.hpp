@@ -1,10 +1,15 @@
 #pragma once
 
-#include "CigarParser.hpp"
+#include "CigarIndex.hpp"
+#include "EntryPool.hpp"
+#include "RecordBuffer.hpp"
 
 #include <bam.h>
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <thread>
 
 enum PosCompare {
     BEFORE,
@@ -28,10 +33,24 @@ public:
         }
     };
 
+    // takes ownership of rawData
     explicit BamEntry(bam1_t* rawData);
+    // a view of a record whose variable length data lives in buffer. the
+    // buffer is kept alive for as long as the entry exists.
+    BamEntry(bam1_core_t const& core, uint8_t* data, int32_t dataLen, RecordBuffer* buffer);
     ~BamEntry();
 
+    // entries that came from a reader should be released rather than
+    // deleted; pooled entries go back to their pool, others are deleted.
+    static void release(BamEntry const* entry);
+    // releases a range of entries, returning runs from the same pool together
+    static void release(BamEntry const* const* entries, std::size_t n);
+
     PosCompare cmp(const BamEntry& rhs) const;
+    // the read base aligned to reference position pos, if any. lookups may
+    // be made in any order, and from several threads at once. the cigar
+    // index is built on the first lookup, so reads that are only walked in
+    // order (e.g., by the pileup) never pay for it.
     bool resolveCigar(uint32_t pos, PileupData& rv) const;
 
     const char* name() const;
@@ -40,35 +59,112 @@ public:
     // note: samtools uses uint32_t for end, int32_t for start
     uint32_t end() const;
     const bam1_t* rawData() const;
+    CigarIndex const& cigarIndex() const;
     int base(uint32_t offset) const;
     int baseQuality(uint32_t offset) const;
     uint32_t flag() const;
     uint32_t nCigar() const;
 
+protected:
+    friend class BamReaderBase;
+    friend class EntryPool;
+    friend class MappedBamReader;
+
+    // the record owned by the entry, ready to be read into. any view is
+    // dropped. call update() once the record is filled in.
+    bam1_t* prepareRecord();
+    // recompute the cached end after the record changed, and drop the
+    // cigar index
+    void update();
+    void setView(bam1_core_t const& core, uint8_t* data, int32_t dataLen, RecordBuffer* buffer);
+    // stop referencing a view's buffer
+    void detach();
+
 protected:
     bam1_t* _rawData;
+    bam1_t* _owned;
+    bam1_t _view;
+    RecordBuffer* _buffer;
+    EntryPool* _pool;
     uint32_t _end;
-
-    mutable uint32_t _readPos;
-    mutable uint32_t _refPos;
-    mutable int _lastCigarIdx;
-    mutable CigarParser _cigarParser;
+    // built by the first caller of cigarIndex()
+    enum {
+        CIGAR_INDEX_NONE,
+        CIGAR_INDEX_BUILDING,
+        CIGAR_INDEX_READY
+    };
+    mutable CigarIndex _cigarIndex;
+    mutable std::atomic<uint8_t> _cigarIndexState;
 };
 
 inline
 BamEntry::BamEntry(bam1_t* rawData)
     : _rawData(rawData)
-    , _end(bam_calend(&rawData->core, bam1_cigar(rawData)))
-    , _readPos(0)
-    , _refPos(0)
-    , _lastCigarIdx(-1)
-    , _cigarParser(bam1_cigar(rawData), rawData->core.n_cigar)
+    , _owned(rawData)
+    , _buffer(0)
+    , _pool(0)
+    , _end(0)
+    , _cigarIndexState(CIGAR_INDEX_NONE)
 {
+    update();
+}
+
+inline
+BamEntry::BamEntry(bam1_core_t const& core, uint8_t* data, int32_t dataLen, RecordBuffer* buffer)
+    : _rawData(&_view)
+    , _owned(0)
+    , _buffer(0)
+    , _pool(0)
+    , _end(0)
+    , _cigarIndexState(CIGAR_INDEX_NONE)
+{
+    setView(core, data, dataLen, buffer);
 }
 
 inline
 BamEntry::~BamEntry() {
-    bam_destroy1(_rawData);
+    detach();
+    if (_owned)
+        bam_destroy1(_owned);
+    if (_pool)
+        _pool->forget();
+}
+
+inline
+bam1_t* BamEntry::prepareRecord() {
+    detach();
+    if (!_owned)
+        _owned = bam_init1();
+    _rawData = _owned;
+    return _owned;
+}
+
+inline
+void BamEntry::update() {
+    _end = bam_calend(&_rawData->core, bam1_cigar(_rawData));
+    _cigarIndexState.store(CIGAR_INDEX_NONE, std::memory_order_relaxed);
+}
+
+inline
+void BamEntry::setView(bam1_core_t const& core, uint8_t* data, int32_t dataLen, RecordBuffer* buffer) {
+    buffer->ref();
+    detach();
+    _view.core = core;
+    _view.data = data;
+    _view.data_len = dataLen;
+    _view.m_data = dataLen;
+    _view.l_aux = dataLen - core.n_cigar * 4 - core.l_qname - core.l_qseq - (core.l_qseq + 1) / 2;
+    _buffer = buffer;
+    _rawData = &_view;
+    update();
+}
+
+inline
+void BamEntry::detach() {
+    if (_buffer) {
+        _buffer->unref();
+        _buffer = 0;
+    }
 }
 
 inline
@@ -112,6 +208,22 @@ const bam1_t* BamEntry::rawData() const {
     return _rawData;
 }
 
+inline
+CigarIndex const& BamEntry::cigarIndex() const {
+    if (_cigarIndexState.load(std::memory_order_acquire) != CIGAR_INDEX_READY) {
+        uint8_t state = CIGAR_INDEX_NONE;
+        if (_cigarIndexState.compare_exchange_strong(state, CIGAR_INDEX_BUILDING, std::memory_order_acquire)) {
+            _cigarIndex.build(bam1_cigar(_rawData), _rawData->core.n_cigar);
+            _cigarIndexState.store(CIGAR_INDEX_READY, std::memory_order_release);
+        } else {
+            // another thread is building it, which doesn't take long
+            while (_cigarIndexState.load(std::memory_order_acquire) != CIGAR_INDEX_READY)
+                std::this_thread::yield();
+        }
+    }
+    return _cigarIndex;
+}
+
 inline
 int BamEntry::base(uint32_t offset) const {
     return bam1_seqi(bam1_seq(_rawData), offset);
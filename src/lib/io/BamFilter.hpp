@@ -19,8 +19,14 @@ public:
     {
     }
 
+    // only the core of a record is looked at, so readers can judge records
+    // before decoding the rest of them
+    bool accept(const bam1_core_t& core) const {
+        return (core.flag & _mask) == 0 && (core.qual >= _minMapQual);
+    }
+
     bool accept(const bam1_t* b) const {
-        return (b->core.flag & _mask) == 0 && (b->core.qual >= _minMapQual);
+        return accept(b->core);
     }
 
 protected:
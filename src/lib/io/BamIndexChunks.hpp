@@ -0,0 +1,85 @@
+#pragma once
+
+#include "BamReaderBase.hpp"
+
+#include <bam.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// get_chunk_coordinates is exported by libbam (for pysam) but not declared in
+// any of its headers.
+extern "C" {
+    typedef struct {
+        uint64_t u, v;
+    } bam_pair64_t;
+
+    bam_pair64_t* get_chunk_coordinates(const bam_index_t* idx, int tid, int beg, int end, int* cnt_off);
+}
+
+// A span of bgzf virtual file offsets [beg, end) that may contain alignments
+// overlapping some region.
+struct BgzfChunk {
+    uint64_t beg;
+    uint64_t end;
+};
+
+// the chunks a bam_iter_query for the same region would visit, in file order
+inline
+std::vector<BgzfChunk> bamIndexChunks(bam_index_t const* index, int tid, int beg, int end) {
+    // bam_iter_query returns no iterator at all for an empty range, which
+    // get_chunk_coordinates doesn't handle
+    if (end < (beg < 0 ? 0 : beg))
+        return std::vector<BgzfChunk>();
+
+    int n = 0;
+    bam_pair64_t* off = get_chunk_coordinates(index, tid, beg, end, &n);
+    std::vector<BgzfChunk> rv(n);
+    for (int i = 0; i < n; ++i) {
+        rv[i].beg = off[i].u;
+        rv[i].end = off[i].v;
+    }
+    free(off);
+    return rv;
+}
+
+// the chunks of every one of regions, coalesced into a single list in file
+// order. chunks that overlap or share a bgzf block are merged, so walking the
+// list reads each block at most once and needs no seek between the targets
+// of a block.
+inline
+std::vector<BgzfChunk> bamIndexChunks(bam_index_t const* index, std::vector<Region> const& regions) {
+    std::vector<BgzfChunk> all;
+    for (auto i = regions.begin(); i != regions.end(); ++i) {
+        std::vector<BgzfChunk> chunks = bamIndexChunks(index, i->tid, i->beg, i->end);
+        all.insert(all.end(), chunks.begin(), chunks.end());
+    }
+
+    std::sort(all.begin(), all.end(),
+        [](BgzfChunk const& a, BgzfChunk const& b) { return a.beg < b.beg; });
+
+    std::vector<BgzfChunk> rv;
+    for (auto i = all.begin(); i != all.end(); ++i) {
+        if (!rv.empty() && (i->beg >> 16) <= (rv.back().end >> 16))
+            rv.back().end = std::max(rv.back().end, i->end);
+        else
+            rv.push_back(*i);
+    }
+    return rv;
+}
+
+// the offset to read on from to see every alignment overlapping tid:pos and
+// all those after it. false if there are none.
+inline
+bool bamIndexOffset(bam_index_t const* index, int nTargets, int tid, int pos, uint64_t* offset) {
+    for (; tid < nTargets; ++tid, pos = 0) {
+        std::vector<BgzfChunk> chunks = bamIndexChunks(index, tid, pos, 1 << 29);
+        if (!chunks.empty()) {
+            *offset = chunks[0].beg;
+            return true;
+        }
+    }
+    return false;
+}
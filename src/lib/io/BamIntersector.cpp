@@ -1,5 +1,6 @@
 #include "BamIntersector.hpp"
 #include "PileupBuffer.hpp"
+#include "TargetRegions.hpp"
 
 #include <algorithm>
 #include <iostream>
@@ -7,6 +8,8 @@
 
 using namespace std;
 
+uint32_t const BamIntersector::DEFAULT_SEEK_GAP;
+
 
 BamIntersector::BamIntersector(
         BamReaderBase& readerN,
@@ -19,9 +22,75 @@ BamIntersector::BamIntersector(
     , _tid(0)
     , _pos(0)
     , _region(readerN.region())
+    , _window(PileupWindow::DEFAULT_WIDTH)
+    , _minQual(0)
+    , _minNormalDepth(1)
+    , _minTumorDepth(1)
+    , _seekGap(DEFAULT_SEEK_GAP)
+    , _seeks(0)
+    , _targets(0)
 {
 }
 
+void BamIntersector::setSeekGap(uint32_t bases) {
+    _seekGap = bases;
+}
+
+void BamIntersector::skipAhead(BamReaderBase& reader, PileupBuffer const& other) {
+    if (_seekGap == 0)
+        return;
+
+    BamEntry const* next = reader.peek();
+    if (!next || next->tid() > other.tid())
+        return;
+    if (next->tid() == other.tid() && next->start() + int64_t(_seekGap) > other.start())
+        return;
+
+    if (reader.skipTo(other.tid(), other.start()))
+        ++_seeks;
+}
+
+void BamIntersector::setTargets(vector<Region> const& targets) {
+    _targets = &targets;
+}
+
+void BamIntersector::setMinDepth(uint32_t normal, uint32_t tumor) {
+    _minNormalDepth = max(normal, 1u);
+    _minTumorDepth = max(tumor, 1u);
+}
+
+uint32_t BamIntersector::markCallable(uint32_t begin, uint32_t end) {
+    // a read spanning a position may still be in a deletion or skipped
+    // region there, so this only rules positions out
+    _pn.countSpans(begin, end, _spanN);
+    _pt.countSpans(begin, end, _spanT);
+
+    uint32_t columns = end - begin;
+    _callable.resize(columns);
+    int32_t n = 0;
+    int32_t t = 0;
+    uint32_t count = 0;
+    for (uint32_t c = 0; c < columns; ++c) {
+        n += _spanN[c];
+        t += _spanT[c];
+        _callable[c] = uint32_t(n) >= _minNormalDepth && uint32_t(t) >= _minTumorDepth;
+        count += _callable[c];
+    }
+
+    if (_targets && count) {
+        maskOutsideRegions(*_targets, _tid, begin, end, _callable.data());
+        count = uint32_t(std::count(_callable.begin(), _callable.end(), 1));
+    }
+    return count;
+}
+
+void BamIntersector::setCandidateFilter(reference_t reference, int minQual) {
+    _reference = reference;
+    _minQual = minQual;
+    _pn.setMinQuality(minQual);
+    _pt.setMinQuality(minQual);
+}
+
 void BamIntersector::run() {
     _pn.push(_readerN.take());
     _pt.push(_readerT.take());
@@ -31,8 +100,12 @@ void BamIntersector::run() {
             PosCompare cmp = _pn.front()->cmp(*_pt.front());
             if (cmp == BEFORE) {
                 _pn.clearBefore(_pt.tid(), _pt.start());
+                if (_pn.empty())
+                    skipAhead(_readerN, _pt);
             } else if (cmp == AFTER) {
                 _pt.clearBefore(_pn.tid(), _pn.start());
+                if (_pt.empty())
+                    skipAhead(_readerT, _pn);
             } else {
                 doPileup();
             }
@@ -69,6 +142,13 @@ void BamIntersector::doPileup() {
     if (_region) {
         _pos = max(int(_region->beg), _pos);
         end = min(unsigned(_region->end), end);
+        if (_pos >= _region->end) {
+            // whatever is left in the buffers hangs off the end of the
+            // region. there is nothing more to call.
+            _pn.clear();
+            _pt.clear();
+            return;
+        }
     }
 
     if (cmp == BEFORE) {
@@ -76,14 +156,53 @@ void BamIntersector::doPileup() {
     } else if (cmp == AFTER) {
         _pt.clear();
     } else {
+        // go on past the end of the first read to fill a whole window. a
+        // position is complete once every read starting at or before it is
+        // buffered.
+        uint32_t limit = _pos + _window;
+        if (_region)
+            limit = min(unsigned(_region->end), limit);
+        if (limit > end) {
+            while (_pn.pushBefore(_readerN.peek(), limit)) _readerN.take();
+            while (_pt.pushBefore(_readerT.peek(), limit)) _readerT.take();
+            end = limit;
+        }
+
         while (uint32_t(_pos) < end) {
-            Pileup* normal = _pn.pileup(_pos);
-            Pileup* tumor  = _pt.pileup(_pos);
-            if (!normal->empty() && !tumor->empty())
-                _cb(_pos, *normal, *tumor);
-            ++_pos;
-            delete normal;
-            delete tumor;
+            uint32_t stop = min(end, _pos + _window);
+            if (markCallable(_pos, stop) == 0) {
+                _pos = stop;
+                continue;
+            }
+
+            _wn.collect(_pn, _pos, stop);
+            _wt.collect(_pt, _pos, stop);
+
+            // with a reference, a column is worth building if either
+            // sample has a read that doesn't simply agree with it
+            uint8_t const* mask = _callable.data();
+            if (_reference) {
+                uint32_t columns = stop - _pos;
+                _ref.resize(columns);
+                _candidates.assign(columns, 0);
+                uint32_t refLen = _reference(_tid, _pos, stop, _ref.data());
+                _wn.markCandidates(_ref.data(), refLen, _minQual, _candidates.data());
+                _wt.markCandidates(_ref.data(), refLen, _minQual, _candidates.data());
+                for (uint32_t c = 0; c < columns; ++c)
+                    _candidates[c] &= _callable[c];
+                mask = _candidates.data();
+            }
+            _wn.build(mask);
+            _wt.build(mask);
+            for (; uint32_t(_pos) < stop; ++_pos) {
+                Pileup const& normal = _wn.column(_pos);
+                Pileup const& tumor = _wt.column(_pos);
+                if (normal.size() >= _minNormalDepth && tumor.size() >= _minTumorDepth) {
+                    _wn.setDropped(_readerN.droppedAt(_tid, _pos));
+                    _wt.setDropped(_readerT.droppedAt(_tid, _pos));
+                    _cb(_pos, normal, tumor);
+                }
+            }
         }
         _pn.clearBefore(_pn.tid(), _pos);
         _pt.clearBefore(_pt.tid(), _pos);
@@ -3,14 +3,23 @@
 #include "BamReaderBase.hpp"
 #include "Pileup.hpp"
 #include "PileupBuffer.hpp"
+#include "PileupWindow.hpp"
 
+#include <cstdint>
 #include <functional>
 #include <sam.h>
 #include <string>
+#include <vector>
 
 class BamIntersector {
 public:
     typedef std::function<void(int32_t, const Pileup&, const Pileup&)> callback_t;
+    // writes the nt16 codes of the reference bases in [begin, end) of
+    // sequence tid to ref, returning how many there are. may return fewer
+    // than asked for (e.g., none for a sequence it doesn't have).
+    typedef std::function<uint32_t(int tid, uint32_t begin, uint32_t end, uint8_t* ref)> reference_t;
+
+    static uint32_t const DEFAULT_SEEK_GAP = 100000;
 
     BamIntersector(
         BamReaderBase& readerN,
@@ -18,9 +27,43 @@ public:
         callback_t cb
         );
 
+    // only pile up positions where some read differs from the reference
+    // or has a base quality below minQual. the callback is not made for
+    // positions where every read agrees with the reference.
+    void setCandidateFilter(reference_t reference, int minQual);
+
+    // only make the callback where the normal and tumor pileups have at
+    // least this many reads. positions are first screened by counting the
+    // reads whose alignments span them, without looking at their cigars.
+    // the default, and the least allowed, is 1.
+    void setMinDepth(uint32_t normal, uint32_t tumor);
+
+    // when one sample's reads are this many bases or more behind the
+    // other's, skip its reader ahead through the bam index instead of
+    // reading through them. 0 never skips.
+    void setSeekGap(uint32_t bases);
+
+    // only make the callback at positions inside targets, which must be
+    // merged (see mergeRegions) and outlive the intersector. meant for
+    // readers limited to the same targets with setTargets().
+    void setTargets(std::vector<Region> const& targets);
+
+    // number of times a reader was skipped ahead
+    uint64_t seeks() const {
+        return _seeks;
+    }
+
     void run();
     void doPileup();
 
+protected:
+    // mark the positions in [begin, end) that the reads spanning them could
+    // cover deeply enough in both samples. returns how many there are.
+    uint32_t markCallable(uint32_t begin, uint32_t end);
+
+    // skip reader ahead to the start of other if it is far enough behind
+    void skipAhead(BamReaderBase& reader, PileupBuffer const& other);
+
 protected:
     BamReaderBase& _readerN;
     BamReaderBase& _readerT;
@@ -31,4 +74,24 @@ protected:
     PileupBuffer _pn;
     PileupBuffer _pt;
     Region const* _region;
+
+    uint32_t _window;
+    PileupWindow _wn;
+    PileupWindow _wt;
+
+    reference_t _reference;
+    int _minQual;
+    std::vector<uint8_t> _ref;
+    std::vector<uint8_t> _candidates;
+
+    uint32_t _minNormalDepth;
+    uint32_t _minTumorDepth;
+    std::vector<int32_t> _spanN;
+    std::vector<int32_t> _spanT;
+    std::vector<uint8_t> _callable;
+
+    uint32_t _seekGap;
+    uint64_t _seeks;
+
+    std::vector<Region> const* _targets;
 };
@@ -1,37 +1,79 @@
 #pragma once
 
+#include "BamIndexChunks.hpp"
 #include "BamReaderBase.hpp"
+#include "BgzfReader.hpp"
+#include "utility/ThreadPool.hpp"
 
 #include <boost/format.hpp>
+#include <sys/stat.h>
 #include <functional>
+#include <memory>
 #include <stdexcept>
 #include <string>
 
 class BamReader : public BamReaderBase {
 public:
-    explicit BamReader(std::string const& path);
+    // given a thread pool, bgzf blocks of bam files are inflated on the pool
+    // ahead of the reader. the pool may be shared by several readers.
+    // path may name a stream (see isStream), which is read as bam
+    explicit BamReader(std::string const& path, ThreadPool* inflatePool = 0);
     ~BamReader();
 
+    // whether path is "-", for stdin, or something other than a regular
+    // file, e.g., a named pipe or /dev/stdin. a stream can only be read once,
+    // from start to end: there is no index to use and no seeking in it.
+    static bool isStream(std::string const& path);
+
     bam_header_t* header() const;
     std::string const& path() const;
 
+    // needs the bam to be indexed; the index is loaded on first use. never
+    // skips in a stream.
+    bool skipTo(int tid, int pos);
+
 protected:
+    // records the filter rejects are passed over after decoding their core
     virtual bool takeImpl(bam1_t* entry);
 
+    // virtual file offsets in whichever bgzf stream records come from
+    uint64_t tell() const;
+    void seek(uint64_t voffset);
+
+    // takeImpl() in steps: readCore() decodes the core of the next record,
+    // then the rest of it must be read with readData() or passed over with
+    // skipData(). sam text, and bam on big endian hosts, are decoded whole by
+    // readCore().
+    bool readCore(bam1_t* entry);
+    void readData(bam1_t* entry);
+    void skipData(bam1_t const* entry);
+
 protected:
     std::string path_;
     samfile_t* fp_;
+    std::unique_ptr<BgzfReader> bgzf_;
+    bool stream_;
+    // records can be decoded a part at a time
+    bool lazy_;
+    bam_index_t* skipIndex_;
+    bool skipIndexLoaded_;
 };
 
 inline
-BamReader::BamReader(std::string const& path)
+BamReader::BamReader(std::string const& path, ThreadPool* inflatePool)
     : path_(path)
     , fp_(0)
+    , stream_(isStream(path))
+    , lazy_(false)
+    , skipIndex_(0)
+    , skipIndexLoaded_(false)
 {
     using boost::format;
 
+    // there is no looking ahead in a stream to tell bam from sam, and it is
+    // bam that comes down pipes
     std::string mode = "r";
-    if (path_.find(".bam") != std::string::npos)
+    if (stream_ || path_.find(".bam") != std::string::npos)
         mode += 'b';
 
     fp_ = samopen(path_.c_str(), mode.c_str(), 0);
@@ -42,19 +84,108 @@ BamReader::BamReader(std::string const& path)
     if (!fp_->x.bam) {
         throw std::runtime_error(str(format("%1% is not a valid bam file") % path));
     }
+
+    // records are read from our own bgzf stream starting where samtools
+    // finished reading the header (bit 1 of type is set for bam input).
+    // readBamCore doesn't byte swap. a stream can't be opened a second time,
+    // so it is inflated by samtools.
+    lazy_ = (fp_->type & 1) && !bam_is_be;
+    if (inflatePool && lazy_ && !stream_) {
+        bgzf_.reset(new BgzfReader(path_, inflatePool, 2 * inflatePool->threads()));
+        bgzf_->seek(bam_tell(fp_->x.bam));
+    }
 }
 
 inline
 BamReader::~BamReader() {
+    if (skipIndex_)
+        bam_index_destroy(skipIndex_);
     samclose(fp_);
     fp_ = 0;
 }
 
+inline
+bool BamReader::isStream(std::string const& path) {
+    if (path == "-")
+        return true;
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && !S_ISREG(st.st_mode);
+}
+
+inline
+bool BamReader::skipTo(int tid, int pos) {
+    // sam files can't be indexed
+    if (!(fp_->type & 1) || stream_)
+        return false;
+
+    if (!skipIndexLoaded_) {
+        skipIndexLoaded_ = true;
+        skipIndex_ = bam_index_load(path_.c_str());
+    }
+
+    uint64_t offset;
+    if (!skipIndex_ || !bamIndexOffset(skipIndex_, header()->n_targets, tid, pos, &offset))
+        return false;
+
+    // never go back: that would read entries a second time
+    if (offset <= tell())
+        return false;
+
+    discardPeeked();
+    seek(offset);
+    return true;
+}
+
+inline
+uint64_t BamReader::tell() const {
+    return bgzf_ ? bgzf_->tell() : bam_tell(fp_->x.bam);
+}
+
+inline
+void BamReader::seek(uint64_t voffset) {
+    if (bgzf_)
+        bgzf_->seek(voffset);
+    else
+        bam_seek(fp_->x.bam, voffset, SEEK_SET);
+}
+
 inline
 bool BamReader::takeImpl(bam1_t* entry) {
+    while (readCore(entry)) {
+        if (accepts(entry->core)) {
+            readData(entry);
+            return true;
+        }
+        skipData(entry);
+    }
+    return false;
+}
+
+inline
+bool BamReader::readCore(bam1_t* entry) {
+    if (bgzf_)
+        return readBamCore(*bgzf_, entry);
+    if (lazy_)
+        return readBamCore(fp_->x.bam, path_, entry);
     return samread(fp_, entry) > 0;
 }
 
+inline
+void BamReader::readData(bam1_t* entry) {
+    if (bgzf_)
+        readBamData(*bgzf_, entry);
+    else if (lazy_)
+        readBamData(fp_->x.bam, path_, entry);
+}
+
+inline
+void BamReader::skipData(bam1_t const* entry) {
+    if (bgzf_)
+        skipBamData(*bgzf_, entry);
+    else if (lazy_)
+        skipBamData(fp_->x.bam, path_, entry);
+}
+
 inline
 bam_header_t* BamReader::header() const {
     return fp_->header;
@@ -1,19 +1,27 @@
 #include "BamReaderBase.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <stdexcept>
 
 #include "BamEntry.hpp"
 #include "BamFilter.hpp"
+#include "EntryPool.hpp"
+
+using namespace std;
 
 BamReaderBase::BamReaderBase()
     : buf_(0)
     , filter_(0)
+    , entryPool_(new EntryPool)
 {
 }
 
 BamReaderBase::~BamReaderBase() {
-    delete buf_;
+    BamEntry::release(buf_);
     buf_ = 0;
+    // entries still held by callers keep the pool alive
+    entryPool_->close();
 }
 
 BamEntry* BamReaderBase::peek() {
@@ -28,18 +36,98 @@ BamEntry* BamReaderBase::take() {
         buf_ = NULL;
         return rv;
     }
+    return next();
+}
+
+size_t BamReaderBase::take(vector<BamEntry*>& out, size_t n) {
+    size_t rv = 0;
+    if (buf_ && n > 0) {
+        out.push_back(buf_);
+        buf_ = 0;
+        ++rv;
+    }
+    if (rv < n)
+        rv += nextBatch(out, n - rv);
+    return rv;
+}
 
-    bam1_t* entry = bam_init1();
-    memset(entry, 0, sizeof(bam1_t));
+BamEntry* BamReaderBase::next() {
+    BamEntry* rv = entryPool_->get();
+    bam1_t* entry = rv->prepareRecord();
     while (takeImpl(entry)) {
         if (!filter_ || filter_->accept(entry)) {
-            return new BamEntry(entry);
+            rv->update();
+            return rv;
         }
     }
-    bam_destroy1(entry);
+    entryPool_->put(rv);
     return 0;
 }
 
+size_t BamReaderBase::nextBatch(vector<BamEntry*>& out, size_t n) {
+    size_t const first = out.size();
+    vector<BamEntry*> batch;
+    while (out.size() - first < n) {
+        batch.clear();
+        entryPool_->get(batch, n - (out.size() - first));
+
+        // decode the whole batch before looking at any of it
+        size_t filled = 0;
+        for (; filled < batch.size(); ++filled) {
+            if (!takeImpl(batch[filled]->prepareRecord()))
+                break;
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < filled; ++i) {
+            if (!filter_ || filter_->accept(batch[i]->rawData())) {
+                batch[i]->update();
+                out.push_back(batch[i]);
+            } else {
+                batch[kept++] = batch[i];
+            }
+        }
+        // rejected entries and those left over at the end of input
+        copy(batch.begin() + filled, batch.end(), batch.begin() + kept);
+        kept += batch.size() - filled;
+        if (kept)
+            entryPool_->put(&batch[0], kept);
+
+        if (filled < batch.size())
+            break;
+    }
+    return out.size() - first;
+}
+
+bool BamReaderBase::accepts(bam1_core_t const& core) const {
+    return !filter_ || filter_->accept(core);
+}
+
+bool BamReaderBase::takeImpl(bam1_t*) {
+    throw std::logic_error("Reader for " + path() + " does not decode records one at a time");
+}
+
+void BamReaderBase::setRegion(Region const&) {
+    throw std::logic_error("Reader for " + path() + " can not be limited to a region");
+}
+
+void BamReaderBase::setTargets(vector<Region> const&) {
+    throw std::logic_error("Reader for " + path() + " can not be limited to targets");
+}
+
+bool BamReaderBase::skipTo(int, int) {
+    return false;
+}
+
+uint32_t BamReaderBase::droppedAt(int, int32_t) {
+    return 0;
+}
+
+void BamReaderBase::discardPeeked() {
+    BamEntry::release(buf_);
+    buf_ = 0;
+}
+
 char const* BamReaderBase::targetName(int tid) const {
     assert(tid >= 0 && tid < header()->n_targets);
     return header()->target_name[tid];
@@ -3,10 +3,14 @@
 #include <sam.h>
 #include <bam.h>
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 class BamEntry;
 class BamFilter;
+class EntryPool;
 
 struct Region {
     int tid;
@@ -27,9 +31,36 @@ public:
         return 0;
     }
 
-    // items returned by take must be deleted by the caller
+    // reposition the reader at the start of region. only indexed readers
+    // support this; the default throws.
+    virtual void setRegion(Region const& region);
+
+    // reposition the reader to produce the entries overlapping any of
+    // targets, which must be merged (see mergeRegions), in a single pass.
+    // region() is null while reading targets. only indexed readers support
+    // this; the default throws.
+    virtual void setTargets(std::vector<Region> const& targets);
+
+    // move ahead to the entries overlapping tid:pos, skipping those before
+    // them through the bam index rather than reading through them. some
+    // entries ending before pos may still follow. returns false, and leaves
+    // the reader where it was, if it has no index or nothing to skip to.
+    virtual bool skipTo(int tid, int pos);
+
+    // the number of entries covering tid:pos that the reader left out on
+    // purpose, e.g., by downsampling. positions must be asked for in order.
+    // the default drops nothing.
+    virtual uint32_t droppedAt(int tid, int32_t pos);
+
+    // items returned by take must be given back with BamEntry::release
+    // (deleting them also works, but defeats the reuse of entries)
     BamEntry* take();
 
+    // take up to n entries, appending them to out. returns the number taken,
+    // which is less than n only at the end of input. this amortizes the
+    // per entry overhead of take() for callers that can work in batches.
+    std::size_t take(std::vector<BamEntry*>& out, std::size_t n);
+
     // items returned by peek should not be deleted by the caller
     BamEntry* peek();
 
@@ -40,9 +71,38 @@ public:
     }
 
 protected:
-    virtual bool takeImpl(bam1_t* entry) = 0;
+    // decode the next record into entry, returning false at the end of
+    // input. readers that decode records implement this; the default throws,
+    // since it is never called on readers that override next() instead.
+    virtual bool takeImpl(bam1_t* entry);
+
+    // produce the next entry that passes the filter, or 0 at the end of
+    // input. readers that don't decode records themselves override this
+    // rather than takeImpl.
+    virtual BamEntry* next();
+
+    // drop the entry buffered by peek(), e.g., after repositioning
+    void discardPeeked();
+
+    // batched version of next(); the default decodes up to n records into
+    // pooled entries and filters them together.
+    virtual std::size_t nextBatch(std::vector<BamEntry*>& out, std::size_t n);
+
+    BamFilter const* filter() const {
+        return filter_;
+    }
+
+    // whether the filter, if any, accepts a record with this core. readers
+    // that can decode a record's core alone use this to pass over rejected
+    // records without decoding the rest of them.
+    bool accepts(bam1_core_t const& core) const;
+
+    EntryPool* entryPool() const {
+        return entryPool_;
+    }
 
 private:
     BamEntry* buf_;
     BamFilter* filter_;
+    EntryPool* entryPool_;
 };
@@ -0,0 +1,70 @@
+#include "Bgzf.hpp"
+
+#include <bgzf.h>
+#include <zlib.h>
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+    uint16_t le16(uint8_t const* p) {
+        return uint16_t(p[0] | p[1] << 8);
+    }
+
+    uint32_t le32(uint8_t const* p) {
+        return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+    }
+}
+
+namespace Bgzf {
+    size_t extraLength(uint8_t const* header) {
+        if (header[0] != 31 || header[1] != 139 || header[2] != 8 || !(header[3] & 4))
+            throw runtime_error("invalid bgzf block header");
+        return le16(header + 10);
+    }
+
+    size_t blockSize(uint8_t const* header, uint8_t const* extra) {
+        size_t xlen = le16(header + 10);
+        size_t rv = 0;
+        // look for the BC subfield
+        for (size_t i = 0; i + 4 <= xlen; i += 4 + le16(extra + i + 2)) {
+            if (extra[i] == 'B' && extra[i+1] == 'C' && le16(extra + i + 2) == 2) {
+                rv = size_t(le16(extra + i + 4)) + 1;
+                break;
+            }
+        }
+        if (rv < HEADER_SIZE + xlen + FOOTER_SIZE)
+            throw runtime_error("bgzf block has no valid block size");
+        return rv;
+    }
+
+    uint32_t inflatedSize(uint8_t const* blockEnd) {
+        uint32_t rv = le32(blockEnd - 4);
+        if (rv > BGZF_MAX_BLOCK_SIZE)
+            throw runtime_error("invalid bgzf block: uncompressed size too large");
+        return rv;
+    }
+
+    void inflate(uint8_t const* block, size_t blockSize, uint8_t* out) {
+        uint32_t outSize = inflatedSize(block + blockSize);
+        if (outSize == 0)
+            return;
+
+        size_t skip = HEADER_SIZE + le16(block + 10);
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (inflateInit2(&zs, -15) != Z_OK)
+            throw runtime_error("Failed to initialize zlib");
+
+        zs.next_in = const_cast<uint8_t*>(block + skip);
+        zs.avail_in = blockSize - skip - FOOTER_SIZE;
+        zs.next_out = out;
+        zs.avail_out = outSize;
+        int rv = ::inflate(&zs, Z_FINISH);
+        inflateEnd(&zs);
+        if (rv != Z_STREAM_END || zs.total_out != outSize)
+            throw runtime_error("Failed to inflate bgzf block");
+    }
+}
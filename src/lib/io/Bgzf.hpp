@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Block level helpers for bgzf (blocked gzip) data.
+namespace Bgzf {
+    // the fixed part of a block header, up to and including XLEN
+    const std::size_t HEADER_SIZE = 12;
+    // CRC32 and ISIZE
+    const std::size_t FOOTER_SIZE = 8;
+
+    // size of the extra field of the block whose header starts at header,
+    // which must hold at least HEADER_SIZE bytes. throws if it is not a
+    // bgzf block.
+    std::size_t extraLength(uint8_t const* header);
+
+    // total size of the block given its header and extra field. throws if the
+    // extra field doesn't have a valid block size.
+    std::size_t blockSize(uint8_t const* header, uint8_t const* extra);
+
+    // uncompressed size of a block, given a pointer to its end
+    uint32_t inflatedSize(uint8_t const* blockEnd);
+
+    // inflate the whole block (header and all) into out, which must have
+    // room for inflatedSize() bytes.
+    void inflate(uint8_t const* block, std::size_t blockSize, uint8_t* out);
+}
@@ -0,0 +1,332 @@
+#include "BgzfReader.hpp"
+#include "Bgzf.hpp"
+#include "utility/ThreadPool.hpp"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+using boost::format;
+using namespace std;
+
+BgzfReader::BgzfReader(string const& path, ThreadPool* pool, size_t readAhead)
+    : path_(path)
+    , fp_(0)
+    , pool_(pool)
+    , readAhead_(pool ? readAhead : 0)
+    , offset_(0)
+    , nextAddress_(0)
+    , fileEof_(false)
+{
+    fp_ = fopen(path_.c_str(), "rb");
+    if (!fp_)
+        throw runtime_error(str(format("Failed to open %1%: %2%") % path_ % strerror(errno)));
+}
+
+BgzfReader::~BgzfReader() {
+    // pool jobs write into our blocks; they must finish first
+    discardReadAhead();
+    fclose(fp_);
+}
+
+bool BgzfReader::loadBlock(Block& block) {
+    vector<uint8_t>& buf = block.compressed;
+    buf.resize(BGZF_MAX_BLOCK_SIZE);
+
+    size_t n = fread(&buf[0], 1, Bgzf::HEADER_SIZE, fp_);
+    if (n == 0 && feof(fp_))
+        return false;
+
+    size_t blockSize = 0;
+    try {
+        if (n != Bgzf::HEADER_SIZE)
+            throw runtime_error("truncated bgzf block");
+
+        size_t xlen = Bgzf::extraLength(&buf[0]);
+        if (fread(&buf[Bgzf::HEADER_SIZE], 1, xlen, fp_) != xlen)
+            throw runtime_error("truncated bgzf block");
+
+        blockSize = Bgzf::blockSize(&buf[0], &buf[Bgzf::HEADER_SIZE]);
+        size_t have = Bgzf::HEADER_SIZE + xlen;
+        if (fread(&buf[have], 1, blockSize - have, fp_) != blockSize - have)
+            throw runtime_error("truncated bgzf block");
+    } catch (runtime_error const& e) {
+        throw runtime_error(str(format("%1%: %2% at offset %3%") % path_ % e.what() % nextAddress_));
+    }
+
+    buf.resize(blockSize);
+    block.address = nextAddress_;
+    nextAddress_ += blockSize;
+    return true;
+}
+
+void BgzfReader::inflateBlock(Block* block) {
+    vector<uint8_t>& in = block->compressed;
+    block->data.resize(Bgzf::inflatedSize(&in[0] + in.size()));
+    if (!block->data.empty())
+        Bgzf::inflate(&in[0], in.size(), &block->data[0]);
+}
+
+void BgzfReader::fillReadAhead() {
+    while (!fileEof_ && pending_.size() <= readAhead_) {
+        BlockPtr block;
+        if (free_.empty()) {
+            block.reset(new Block);
+        } else {
+            block.swap(free_.back());
+            free_.pop_back();
+        }
+
+        if (!loadBlock(*block)) {
+            fileEof_ = true;
+            free_.push_back(move(block));
+            break;
+        }
+
+        if (pool_) {
+            Block* p = block.get();
+            block->ready = pool_->submit([p]() { inflateBlock(p); });
+        }
+        pending_.push_back(move(block));
+    }
+}
+
+bool BgzfReader::nextBlock() {
+    if (current_)
+        recycle(current_);
+    offset_ = 0;
+
+    fillReadAhead();
+    if (pending_.empty())
+        return false;
+
+    current_.swap(pending_.front());
+    pending_.pop_front();
+    if (current_->ready.valid())
+        current_->ready.get(); // rethrows inflate errors
+    else
+        inflateBlock(current_.get());
+
+    // top up before the caller starts on this block, so the pool has
+    // something to do meanwhile
+    fillReadAhead();
+    return true;
+}
+
+void BgzfReader::recycle(BlockPtr& block) {
+    if (block->ready.valid())
+        block->ready.wait();
+    block->ready = future<void>();
+    free_.push_back(move(block));
+}
+
+void BgzfReader::discardReadAhead() {
+    while (!pending_.empty()) {
+        recycle(pending_.front());
+        pending_.pop_front();
+    }
+    if (current_)
+        recycle(current_);
+}
+
+size_t BgzfReader::read(void* dst, size_t len) {
+    uint8_t* out = static_cast<uint8_t*>(dst);
+    size_t rv = 0;
+    while (rv < len) {
+        if (!current_ || offset_ == current_->data.size()) {
+            if (!nextBlock())
+                break;
+            continue; // skip empty blocks, e.g., the eof marker
+        }
+
+        size_t n = min(len - rv, current_->data.size() - offset_);
+        memcpy(out + rv, &current_->data[offset_], n);
+        offset_ += n;
+        rv += n;
+    }
+    return rv;
+}
+
+size_t BgzfReader::skip(size_t len) {
+    size_t rv = 0;
+    while (rv < len) {
+        if (!current_ || offset_ == current_->data.size()) {
+            if (!nextBlock())
+                break;
+            continue;
+        }
+
+        size_t n = min(len - rv, current_->data.size() - offset_);
+        offset_ += n;
+        rv += n;
+    }
+    return rv;
+}
+
+uint64_t BgzfReader::tell() const {
+    if (!current_)
+        return uint64_t(nextAddress_) << 16;
+
+    // like bgzf, report the start of the next block once this one is used up
+    if (offset_ == current_->data.size())
+        return uint64_t(current_->address + current_->compressed.size()) << 16;
+
+    return uint64_t(current_->address) << 16 | offset_;
+}
+
+void BgzfReader::seek(uint64_t voffset) {
+    int64_t address = voffset >> 16;
+    size_t offset = voffset & 0xffff;
+
+    if (current_ && current_->address == address) {
+        // staying inside the current block
+        if (offset > current_->data.size())
+            throw runtime_error(str(format("%1%: invalid bgzf offset %2%") % path_ % voffset));
+        offset_ = offset;
+        return;
+    }
+
+    discardReadAhead();
+    if (fseeko(fp_, address, SEEK_SET) != 0)
+        throw runtime_error(str(format("Failed to seek in %1%: %2%") % path_ % strerror(errno)));
+    nextAddress_ = address;
+    fileEof_ = false;
+
+    if (!nextBlock()) {
+        if (offset)
+            throw runtime_error(str(format("%1%: invalid bgzf offset %2%") % path_ % voffset));
+        return;
+    }
+
+    if (offset > current_->data.size())
+        throw runtime_error(str(format("%1%: invalid bgzf offset %2%") % path_ % voffset));
+    offset_ = offset;
+}
+
+namespace {
+    // samtools' bgzf stream, with the interface of BgzfReader
+    class SamtoolsStream {
+    public:
+        SamtoolsStream(BGZF* fp, string const& path)
+            : fp_(fp)
+            , path_(path)
+        {
+        }
+
+        size_t read(void* dst, size_t len) {
+            ssize_t n = bgzf_read(fp_, dst, len);
+            if (n < 0)
+                throw runtime_error(str(format("Failed to read %1%") % path_));
+            return size_t(n);
+        }
+
+        size_t skip(size_t len) {
+            // moves through the blocks like bgzf_read does, but leaves the
+            // last byte to it so that the stream's offsets end up exactly as
+            // after a read
+            size_t rv = 0;
+            while (len - rv > 1) {
+                int available = fp_->block_length - fp_->block_offset;
+                if (available <= 0) {
+                    if (bgzf_read_block(fp_) != 0)
+                        throw runtime_error(str(format("Failed to read %1%") % path_));
+                    available = fp_->block_length - fp_->block_offset;
+                    if (available <= 0)
+                        return rv;
+                }
+                size_t n = min(len - rv - 1, size_t(available));
+                fp_->block_offset += n;
+                rv += n;
+            }
+
+            uint8_t last;
+            if (rv < len)
+                rv += read(&last, len - rv);
+            return rv;
+        }
+
+        string const& path() const {
+            return path_;
+        }
+
+    private:
+        BGZF* fp_;
+        string const& path_;
+    };
+
+    template<typename Stream>
+    bool readCore(Stream& in, bam1_t* entry) {
+        int32_t blockLen;
+        uint32_t x[8];
+
+        size_t n = in.read(&blockLen, 4);
+        if (n == 0)
+            return false;
+
+        if (n != 4 || in.read(x, sizeof(x)) != sizeof(x) || blockLen < int32_t(sizeof(x)))
+            throw runtime_error(str(format("%1%: truncated bam record") % in.path()));
+
+        // this path is only taken on little endian machines (see BamReader)
+        unpackBamCore(x, &entry->core);
+        entry->data_len = blockLen - sizeof(x);
+        return true;
+    }
+
+    template<typename Stream>
+    void readData(Stream& in, bam1_t* entry) {
+        bam1_core_t const* c = &entry->core;
+        if (entry->m_data < entry->data_len) {
+            entry->m_data = entry->data_len;
+            kroundup32(entry->m_data);
+            entry->data = (uint8_t*)realloc(entry->data, entry->m_data);
+        }
+
+        if (in.read(entry->data, entry->data_len) != size_t(entry->data_len))
+            throw runtime_error(str(format("%1%: truncated bam record") % in.path()));
+
+        entry->l_aux = entry->data_len - c->n_cigar * 4 - c->l_qname - c->l_qseq - (c->l_qseq + 1) / 2;
+    }
+
+    template<typename Stream>
+    void skipData(Stream& in, bam1_t const* entry) {
+        if (in.skip(entry->data_len) != size_t(entry->data_len))
+            throw runtime_error(str(format("%1%: truncated bam record") % in.path()));
+    }
+}
+
+bool readBamRecord(BgzfReader& in, bam1_t* entry) {
+    if (!readCore(in, entry))
+        return false;
+    readData(in, entry);
+    return true;
+}
+
+bool readBamCore(BgzfReader& in, bam1_t* entry) {
+    return readCore(in, entry);
+}
+
+void readBamData(BgzfReader& in, bam1_t* entry) {
+    readData(in, entry);
+}
+
+void skipBamData(BgzfReader& in, bam1_t const* entry) {
+    skipData(in, entry);
+}
+
+bool readBamCore(BGZF* in, string const& path, bam1_t* entry) {
+    SamtoolsStream stream(in, path);
+    return readCore(stream, entry);
+}
+
+void readBamData(BGZF* in, string const& path, bam1_t* entry) {
+    SamtoolsStream stream(in, path);
+    readData(stream, entry);
+}
+
+void skipBamData(BGZF* in, string const& path, bam1_t const* entry) {
+    SamtoolsStream stream(in, path);
+    skipData(stream, entry);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <bam.h>
+#include <bgzf.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// Sequential reader for bgzf compressed files (e.g., bam). Compressed blocks
+// are read ahead of the consumer and, given a thread pool, inflated on the
+// pool while earlier blocks are being consumed. Offsets are bgzf virtual file
+// offsets, compatible with bam indexes and bgzf_tell.
+class BgzfReader {
+public:
+    // readAhead is the number of blocks to keep in flight beyond the one being
+    // read; it is only useful with a pool.
+    BgzfReader(std::string const& path, ThreadPool* pool, std::size_t readAhead);
+    ~BgzfReader();
+
+    // returns the number of bytes read, which is less than len only at the
+    // end of the file.
+    std::size_t read(void* dst, std::size_t len);
+    // like read(), but the bytes are passed over rather than copied
+    std::size_t skip(std::size_t len);
+
+    uint64_t tell() const;
+    void seek(uint64_t voffset);
+
+    std::string const& path() const {
+        return path_;
+    }
+
+private:
+    struct Block {
+        int64_t address;
+        std::vector<uint8_t> compressed;
+        std::vector<uint8_t> data;
+        std::future<void> ready;
+    };
+    typedef std::unique_ptr<Block> BlockPtr;
+
+    bool loadBlock(Block& block);
+    static void inflateBlock(Block* block);
+    void fillReadAhead();
+    bool nextBlock();
+    void recycle(BlockPtr& block);
+    void discardReadAhead();
+
+private:
+    std::string path_;
+    FILE* fp_;
+    ThreadPool* pool_;
+    std::size_t readAhead_;
+
+    std::deque<BlockPtr> pending_;
+    std::vector<BlockPtr> free_;
+    BlockPtr current_;
+    std::size_t offset_;
+    int64_t nextAddress_;
+    bool fileEof_;
+};
+
+// unpack the core of a bam record the way bam_read1 does, without byte
+// swapping
+inline
+void unpackBamCore(uint32_t const* x, bam1_core_t* c) {
+    c->tid = x[0];
+    c->pos = x[1];
+    c->bin = x[2] >> 16;
+    c->qual = x[2] >> 8 & 0xff;
+    c->l_qname = x[2] & 0xff;
+    c->flag = x[3] >> 16;
+    c->n_cigar = x[3] & 0xffff;
+    c->l_qseq = x[4];
+    c->mtid = x[5];
+    c->mpos = x[6];
+    c->isize = x[7];
+}
+
+// read the next alignment record into entry, like bam_read1. returns false at
+// the end of the file and throws if the record is truncated.
+bool readBamRecord(BgzfReader& in, bam1_t* entry);
+
+// readBamRecord in two steps, so that a record can be judged by its core
+// before the rest of it is read. readBamCore fills in entry->core and sets
+// entry->data_len; the data must then be either read with readBamData or
+// passed over with skipBamData.
+bool readBamCore(BgzfReader& in, bam1_t* entry);
+void readBamData(BgzfReader& in, bam1_t* entry);
+void skipBamData(BgzfReader& in, bam1_t const* entry);
+
+// the same, through samtools' own bgzf stream for path
+bool readBamCore(BGZF* in, std::string const& path, bam1_t* entry);
+void readBamData(BGZF* in, std::string const& path, bam1_t* entry);
+void skipBamData(BGZF* in, std::string const& path, bam1_t const* entry);
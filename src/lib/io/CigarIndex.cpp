@@ -0,0 +1,46 @@
+#include "CigarIndex.hpp"
+
+#include <bam.h>
+
+namespace {
+    // see CigarParser.cpp
+    static int const BAM_CONSUME_QUERY = 1;
+    static int const BAM_CONSUME_REFERENCE = 2;
+}
+
+CigarIndex::CigarIndex()
+    : _refLength(0)
+{
+}
+
+void CigarIndex::build(uint32_t const* cigar, uint32_t n) {
+    _segments.clear();
+    _refLength = 0;
+
+    uint32_t readPos = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        int op = bam_cigar_op(cigar[i]);
+        uint32_t len = bam_cigar_oplen(cigar[i]);
+        int type = bam_cigar_type(op);
+
+        if ((type & BAM_CONSUME_REFERENCE) && len > 0) {
+            Segment seg = { _refLength, int32_t(readPos) };
+            if (op == BAM_CDEL)
+                seg.readStart = DELETED;
+            else if (op == BAM_CREF_SKIP)
+                seg.readStart = SKIPPED;
+
+            // runs like 50=1X49= continue the previous segment
+            bool merge = !_segments.empty()
+                && seg.readStart >= 0
+                && _segments.back().readStart >= 0
+                && uint32_t(_segments.back().readStart) + (_refLength - _segments.back().refStart) == readPos;
+            if (!merge)
+                _segments.push_back(seg);
+            _refLength += len;
+        }
+
+        if (type & BAM_CONSUME_QUERY)
+            readPos += len;
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Maps reference positions covered by an alignment to read offsets. The index
+// holds one segment per cigar operation that consumes the reference, sorted
+// by reference offset, so any position resolves with a binary search (or
+// directly when there is only one such operation, e.g., 100M or 5S95M).
+// Unlike CigarParser, lookups may come in any order and do not modify the
+// index, so entries can be shared between threads.
+class CigarIndex {
+public:
+    // results of readOffset() for positions that have no read base
+    enum {
+        OUTSIDE = -1,
+        DELETED = -2,
+        SKIPPED = -3
+    };
+
+    CigarIndex();
+
+    // the index is rebuilt in place, reusing its storage
+    void build(uint32_t const* cigar, uint32_t n);
+
+    // the read offset aligned to refOffset, which is relative to the start of
+    // the alignment, or one of the negative codes above
+    int32_t readOffset(uint32_t refOffset) const;
+
+    // number of reference positions the alignment spans
+    uint32_t refLength() const {
+        return _refLength;
+    }
+
+protected:
+    struct Segment {
+        uint32_t refStart;
+        // read offset of refStart, or DELETED or SKIPPED
+        int32_t readStart;
+    };
+
+protected:
+    std::vector<Segment> _segments;
+    uint32_t _refLength;
+};
+
+inline int32_t CigarIndex::readOffset(uint32_t refOffset) const {
+    if (refOffset >= _refLength)
+        return OUTSIDE;
+
+    Segment const* seg = &_segments[0];
+    if (_segments.size() > 1) {
+        // the last segment starting at or before refOffset
+        uint32_t lo = 0;
+        uint32_t hi = _segments.size();
+        while (hi - lo > 1) {
+            uint32_t mid = (lo + hi) / 2;
+            if (_segments[mid].refStart <= refOffset)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        seg = &_segments[lo];
+    }
+
+    if (seg->readStart < 0)
+        return seg->readStart;
+    return seg->readStart + int32_t(refOffset - seg->refStart);
+}
@@ -5,15 +5,22 @@
 #include <cassert>
 
 namespace {
-    inline bool isRefBase(int op) {
-        return op == BAM_CMATCH || op == BAM_CDEL;
-    }
-
     // bam.h documents, but defines no constants for the result of
     // bam_cigar_type:
     // bit 1: consume query; bit 2: consume reference
     static int const BAM_CONSUME_QUERY = 1;
     static int const BAM_CONSUME_REFERENCE = 2;
+
+    // deletions and skipped regions (N) occupy reference positions too. if
+    // we didn't stop on them, a query landing inside one would leave the
+    // parser past the position it was asked about.
+    inline bool isRefBase(int op) {
+        return bam_cigar_type(op) & BAM_CONSUME_REFERENCE;
+    }
+
+    inline bool isAlignedBase(int op) {
+        return op == BAM_CMATCH || op == BAM_CEQUAL || op == BAM_CDIFF;
+    }
 }
 
 CigarParser::CigarParser(uint32_t const* cigar, int len)
@@ -22,8 +29,8 @@ CigarParser::CigarParser(uint32_t const* cigar, int len)
     , readPos_(0)
     , refPos_(0)
     , currentOpIdx_(0)
-    , currentOp_(bam_cigar_op(*cigar))
-    , currentOpLen_(bam_cigar_oplen(*cigar))
+    , currentOp_(len > 0 ? bam_cigar_op(*cigar) : 0)
+    , currentOpLen_(len > 0 ? bam_cigar_oplen(*cigar) : 0)
     , started_(false)
 {
 }
@@ -38,9 +45,11 @@ void CigarParser::advance() {
     }
 
     ++currentOpIdx_;
-    assert(currentOpIdx_ < len_);
-    currentOp_ = bam_cigar_op(cigar_[currentOpIdx_]);
-    currentOpLen_ = bam_cigar_oplen(cigar_[currentOpIdx_]);
+    assert(currentOpIdx_ <= len_);
+    if (currentOpIdx_ < len_) {
+        currentOp_ = bam_cigar_op(cigar_[currentOpIdx_]);
+        currentOpLen_ = bam_cigar_oplen(cigar_[currentOpIdx_]);
+    }
 }
 
 void CigarParser::advanceToNextRefBase() {
@@ -55,12 +64,16 @@ int CigarParser::getSnvPileupOffset(uint32_t pos) {
         started_ = true;
     }
 
-    while (pos - refPos_ >= currentOpLen_) {
+    // the parser only moves forward
+    if (pos < refPos_)
+        return -1;
+
+    while (currentOpIdx_ < len_ && pos - refPos_ >= uint32_t(currentOpLen_)) {
         advance();
         advanceToNextRefBase();
     }
 
-    if (currentOpIdx_ >= len_ || currentOp_ != BAM_CMATCH) {
+    if (currentOpIdx_ >= len_ || !isAlignedBase(currentOp_)) {
         return -1;
     }
     return readPos_ + (pos - refPos_);
@@ -0,0 +1,211 @@
+#include "DownsamplingBamReader.hpp"
+#include "BamEntry.hpp"
+#include "PileupWindow.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+using namespace std;
+
+DownsamplingBamReader::DownsamplingBamReader(BamReaderBase& source, uint32_t maxDepth, uint32_t seed)
+    : source_(source)
+    , maxDepth_(maxDepth)
+    , seed_(seed)
+    , dropped_(0)
+    , keptIdx_(0)
+    , keptTid_(-1)
+    , queryTid_(-1)
+    , groupStart_(0)
+    , longest_(0)
+{
+    if (maxDepth_ == 0)
+        throw invalid_argument("DownsamplingBamReader: the depth cap must be positive");
+}
+
+DownsamplingBamReader::~DownsamplingBamReader() {
+    reset();
+}
+
+bam_header_t* DownsamplingBamReader::header() const {
+    return source_.header();
+}
+
+string const& DownsamplingBamReader::path() const {
+    return source_.path();
+}
+
+Region const* DownsamplingBamReader::region() const {
+    return source_.region();
+}
+
+void DownsamplingBamReader::reset() {
+    discardPeeked();
+    for (size_t i = keptIdx_; i < kept_.size(); ++i)
+        BamEntry::release(kept_[i]);
+    kept_.clear();
+    keptIdx_ = 0;
+    keptEnds_.clear();
+    keptTid_ = -1;
+    groupStart_ = 0;
+}
+
+void DownsamplingBamReader::setRegion(Region const& region) {
+    reset();
+    droppedSpans_.clear();
+    droppedEnds_.clear();
+    queryTid_ = -1;
+    source_.setRegion(region);
+}
+
+void DownsamplingBamReader::setTargets(vector<Region> const& targets) {
+    reset();
+    droppedSpans_.clear();
+    droppedEnds_.clear();
+    queryTid_ = -1;
+    source_.setTargets(targets);
+}
+
+bool DownsamplingBamReader::skipTo(int tid, int pos) {
+    // the source goes back far enough to produce every entry covering pos
+    // again, so those kept from before the skip are forgotten
+    if (!source_.skipTo(tid, pos))
+        return false;
+    reset();
+    return true;
+}
+
+uint64_t DownsamplingBamReader::hashName(char const* name, uint32_t seed) {
+    // fnv-1a, seeded, then the splitmix64 finalizer so that the high bits
+    // depend on every byte
+    uint64_t h = 14695981039346656037ull ^ (uint64_t(seed) * 0x9e3779b97f4a7c15ull);
+    for (char const* p = name; *p; ++p) {
+        h ^= uint8_t(*p);
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+bool DownsamplingBamReader::fillGroup() {
+    BamEntry* e = source_.take();
+    if (!e)
+        return false;
+
+    pruneDropped();
+
+    int tid = e->tid();
+    int32_t start = e->start();
+    groupStart_ = start;
+    if (tid != keptTid_) {
+        keptEnds_.clear();
+        keptTid_ = tid;
+    }
+    while (!keptEnds_.empty() && keptEnds_.front() <= uint32_t(start)) {
+        pop_heap(keptEnds_.begin(), keptEnds_.end(), greater<uint32_t>());
+        keptEnds_.pop_back();
+    }
+    size_t slots = keptEnds_.size() < maxDepth_ ? maxDepth_ - keptEnds_.size() : 0;
+
+    // keep the slots entries with the lowest hashes, ties going to the
+    // earlier entry, without holding on to more than that many
+    group_.clear();
+    choice_.clear();
+    kept_.clear();
+    keptIdx_ = 0;
+    while (true) {
+        longest_ = max(longest_, e->end() - uint32_t(start));
+        choice_.push_back(make_pair(hashName(e->name(), seed_), group_.size()));
+        push_heap(choice_.begin(), choice_.end());
+        group_.push_back(e);
+        if (choice_.size() > slots) {
+            pop_heap(choice_.begin(), choice_.end());
+            BamEntry*& worst = group_[choice_.back().second];
+            choice_.pop_back();
+
+            Span span = { tid, start, worst->end() };
+            droppedSpans_.push_back(span);
+            ++dropped_;
+            BamEntry::release(worst);
+            worst = 0;
+        }
+
+        BamEntry const* next = source_.peek();
+        if (!next || next->tid() != tid || next->start() != start)
+            break;
+        e = source_.take();
+    }
+
+    // in their original order
+    for (auto i = group_.begin(); i != group_.end(); ++i) {
+        if (!*i)
+            continue;
+        kept_.push_back(*i);
+        keptEnds_.push_back((*i)->end());
+        push_heap(keptEnds_.begin(), keptEnds_.end(), greater<uint32_t>());
+    }
+    return true;
+}
+
+void DownsamplingBamReader::pruneDropped() {
+    // the intersectors take reads up to a window ahead of the positions they
+    // ask about, or further while reads overlap the first one they hold.
+    // spans are in order of start, so a long one holds back those behind it
+    // until it too goes.
+    if (keptTid_ < 0)
+        return;
+    uint32_t horizon = max(PileupWindow::DEFAULT_WIDTH, longest_);
+    while (!droppedSpans_.empty()) {
+        Span const& s = droppedSpans_.front();
+        if (s.tid == keptTid_ && uint64_t(s.end) + horizon > uint64_t(groupStart_))
+            break;
+        droppedSpans_.pop_front();
+    }
+}
+
+uint32_t DownsamplingBamReader::droppedAt(int tid, int32_t pos) {
+    if (tid != queryTid_) {
+        droppedEnds_.clear();
+        queryTid_ = tid;
+    }
+
+    while (!droppedSpans_.empty()) {
+        Span const& s = droppedSpans_.front();
+        if (s.tid > tid || (s.tid == tid && s.start > pos))
+            break;
+        if (s.tid == tid && s.end > uint32_t(pos)) {
+            droppedEnds_.push_back(s.end);
+            push_heap(droppedEnds_.begin(), droppedEnds_.end(), greater<uint32_t>());
+        }
+        droppedSpans_.pop_front();
+    }
+
+    while (!droppedEnds_.empty() && droppedEnds_.front() <= uint32_t(pos)) {
+        pop_heap(droppedEnds_.begin(), droppedEnds_.end(), greater<uint32_t>());
+        droppedEnds_.pop_back();
+    }
+    return uint32_t(droppedEnds_.size());
+}
+
+BamEntry* DownsamplingBamReader::next() {
+    while (keptIdx_ == kept_.size()) {
+        if (!fillGroup())
+            return 0;
+    }
+    return kept_[keptIdx_++];
+}
+
+size_t DownsamplingBamReader::nextBatch(vector<BamEntry*>& out, size_t n) {
+    size_t rv = 0;
+    for (; rv < n; ++rv) {
+        BamEntry* entry = next();
+        if (!entry)
+            break;
+        out.push_back(entry);
+    }
+    return rv;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "BamReaderBase.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Caps the read depth of another reader. Entries are taken from the source a
+// start position at a time. Of those starting at one position, only as many
+// are kept as fit under maxDepth together with the kept entries still
+// covering it; the ones kept are those whose names hash lowest under seed.
+// The choice depends only on the names, the seed and the reads before them,
+// so runs are reproducible and both mates of a pair, if they start together,
+// go the same way. Entries are filtered by the source; setFilter() on this
+// object has no effect. The source must outlive this object and must not be
+// used directly while it exists.
+class DownsamplingBamReader : public BamReaderBase {
+public:
+    DownsamplingBamReader(BamReaderBase& source, uint32_t maxDepth, uint32_t seed);
+    ~DownsamplingBamReader();
+
+    bam_header_t* header() const;
+    std::string const& path() const;
+    Region const* region() const;
+
+    void setRegion(Region const& region);
+    void setTargets(std::vector<Region> const& targets);
+    bool skipTo(int tid, int pos);
+
+    // the number of entries covering tid:pos that were dropped. positions
+    // must be asked for in order; dropped entries before the last one asked
+    // for are forgotten. so are those ending more than a pileup window, or
+    // the longest read so far if that is more, before the start of the last
+    // entry taken, as the intersectors never look that far back.
+    uint32_t droppedAt(int tid, int32_t pos);
+
+    // entries dropped so far
+    uint64_t dropped() const {
+        return dropped_;
+    }
+
+    static uint64_t hashName(char const* name, uint32_t seed);
+
+protected:
+    struct Span {
+        int tid;
+        int32_t start;
+        uint32_t end;
+    };
+
+    BamEntry* next();
+    std::size_t nextBatch(std::vector<BamEntry*>& out, std::size_t n);
+
+    // take the entries starting at the next position from the source and
+    // queue those that are kept
+    bool fillGroup();
+    // forget dropped entries that droppedAt() will no longer be asked about
+    void pruneDropped();
+    void reset();
+
+protected:
+    BamReaderBase& source_;
+    uint32_t maxDepth_;
+    uint32_t seed_;
+    uint64_t dropped_;
+
+    // the kept entries of the last group, handed out from keptIdx_ on
+    std::vector<BamEntry*> kept_;
+    std::size_t keptIdx_;
+    // the group being chosen from, as (hash, index) pairs in a max heap
+    std::vector<std::pair<uint64_t, std::size_t>> choice_;
+    std::vector<BamEntry*> group_;
+
+    // ends of the kept entries covering the current position (a min heap)
+    int keptTid_;
+    std::vector<uint32_t> keptEnds_;
+
+    // dropped entries not yet reached by droppedAt(), in order of start,
+    // and the ends of those covering the last position asked for
+    std::deque<Span> droppedSpans_;
+    int queryTid_;
+    std::vector<uint32_t> droppedEnds_;
+    // where the last group started, and the longest entry so far
+    int32_t groupStart_;
+    uint32_t longest_;
+};
@@ -0,0 +1,108 @@
+#include "EntryPool.hpp"
+#include "BamEntry.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+EntryPool::EntryPool()
+    : outstanding_(0)
+    , allocated_(0)
+    , closed_(false)
+{
+}
+
+EntryPool::~EntryPool() {
+    for (auto i = free_.begin(); i != free_.end(); ++i) {
+        (*i)->_pool = 0;
+        delete *i;
+    }
+}
+
+bool EntryPool::finished() const {
+    return closed_ && outstanding_ == 0;
+}
+
+void EntryPool::close() {
+    bool done;
+    {
+        lock_guard<mutex> lock(mutex_);
+        closed_ = true;
+        done = finished();
+    }
+    if (done)
+        delete this;
+}
+
+BamEntry* EntryPool::create() {
+    BamEntry* rv = new BamEntry(bam_init1());
+    rv->_pool = this;
+    ++allocated_;
+    // the free list must be able to hold every entry, so that put() never
+    // allocates
+    if (free_.capacity() < allocated_)
+        free_.reserve(2 * allocated_);
+    return rv;
+}
+
+void EntryPool::grow(size_t n) {
+    if (free_.size() >= n)
+        return;
+    if (allocated_ >= WARM_SIZE)
+        n = max(n, free_.size() + allocated_);
+    while (free_.size() < n)
+        free_.push_back(create());
+}
+
+BamEntry* EntryPool::get() {
+    lock_guard<mutex> lock(mutex_);
+    ++outstanding_;
+    grow(1);
+    BamEntry* rv = free_.back();
+    free_.pop_back();
+    return rv;
+}
+
+void EntryPool::get(vector<BamEntry*>& out, size_t n) {
+    lock_guard<mutex> lock(mutex_);
+    outstanding_ += n;
+    grow(n);
+    out.insert(out.end(), free_.end() - n, free_.end());
+    free_.resize(free_.size() - n);
+}
+
+void EntryPool::put(BamEntry* entry) {
+    put(&entry, 1);
+}
+
+void EntryPool::put(BamEntry* const* entries, size_t n) {
+    // don't keep buffers of views alive while the entries sit here
+    for (size_t i = 0; i < n; ++i)
+        entries[i]->detach();
+
+    bool done;
+    {
+        lock_guard<mutex> lock(mutex_);
+        free_.insert(free_.end(), entries, entries + n);
+        outstanding_ -= n;
+        done = finished();
+    }
+    if (done)
+        delete this;
+}
+
+void EntryPool::forget() {
+    bool done;
+    {
+        lock_guard<mutex> lock(mutex_);
+        --outstanding_;
+        done = finished();
+    }
+    if (done)
+        delete this;
+}
+
+size_t EntryPool::allocated() const {
+    lock_guard<mutex> lock(mutex_);
+    return allocated_;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+class BamEntry;
+
+// Free list of BamEntry objects, owned by a reader. Entries handed out by the
+// pool remember it, and BamEntry::release() puts them back instead of freeing
+// them, so in steady state reading a record allocates nothing: the entry, its
+// bam1_t and the bam1_t's data buffer (at its high water size) are all reused.
+// Entries may be released from any thread, and may outlive the reader; the
+// pool goes away once it is closed and the last entry has come back.
+//
+// The pool grows an entry at a time up to WARM_SIZE entries. Past that it
+// doubles whenever it runs dry, so once it has seen the working depth of
+// the input, a later, somewhat deeper stretch doesn't allocate again.
+class EntryPool {
+public:
+    static std::size_t const WARM_SIZE = 64;
+
+    EntryPool();
+
+    // the owner is done with the pool
+    void close();
+
+    BamEntry* get();
+    void get(std::vector<BamEntry*>& out, std::size_t n);
+    void put(BamEntry* entry);
+    void put(BamEntry* const* entries, std::size_t n);
+
+    // an entry from this pool was deleted rather than released
+    void forget();
+
+    // number of entries ever created by the pool
+    std::size_t allocated() const;
+
+private:
+    ~EntryPool();
+    BamEntry* create();
+    // make sure there are at least n free entries
+    void grow(std::size_t n);
+    bool finished() const;
+
+private:
+    mutable std::mutex mutex_;
+    std::vector<BamEntry*> free_;
+    std::size_t outstanding_;
+    std::size_t allocated_;
+    bool closed_;
+};
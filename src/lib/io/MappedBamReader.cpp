@@ -0,0 +1,477 @@
+#include "MappedBamReader.hpp"
+#include "BamEntry.hpp"
+#include "BamFilter.hpp"
+#include "Bgzf.hpp"
+#include "utility/ThreadPool.hpp"
+
+#include <bgzf.h>
+#include <boost/format.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+
+using boost::format;
+using namespace std;
+
+namespace {
+    // inflated bytes per buffer; 16 full bgzf blocks
+    const size_t BUFFER_SIZE = 16 * BGZF_MAX_BLOCK_SIZE;
+    // retired buffers kept around for reuse
+    const size_t MAX_SPARE_BUFFERS = 16;
+    const size_t CORE_SIZE = 32;
+}
+
+MappedBamReader::MappedBamReader(string const& path, ThreadPool* inflatePool)
+    : path_(path)
+    , fd_(-1)
+    , map_(0)
+    , mapSize_(0)
+    , header_(0)
+    , firstRecord_(0)
+    , pool_(inflatePool)
+    , index_(0)
+    , limited_(false)
+    , chunkIdx_(0)
+    , finished_(false)
+    , targeted_(false)
+    , buffer_(0)
+    , blockIdx_(0)
+    , cursor_(0)
+    , filled_(0)
+    , nextAddress_(0)
+{
+    open();
+    seek(firstRecord_);
+}
+
+MappedBamReader::MappedBamReader(string const& path, char const* region, ThreadPool* inflatePool)
+    : path_(path)
+    , fd_(-1)
+    , map_(0)
+    , mapSize_(0)
+    , header_(0)
+    , firstRecord_(0)
+    , pool_(inflatePool)
+    , index_(0)
+    , limited_(false)
+    , chunkIdx_(0)
+    , finished_(false)
+    , targeted_(false)
+    , buffer_(0)
+    , blockIdx_(0)
+    , cursor_(0)
+    , filled_(0)
+    , nextAddress_(0)
+{
+    open();
+    Region r;
+    if (bam_parse_region(header_, region, &r.tid, &r.beg, &r.end) < 0) {
+        throw runtime_error(str(format(
+            "Failed to parse bam region '%1%' in file %2%. ")
+            % region % path));
+    }
+    setRegion(r);
+}
+
+MappedBamReader::MappedBamReader(string const& path, Region const& region, ThreadPool* inflatePool)
+    : path_(path)
+    , fd_(-1)
+    , map_(0)
+    , mapSize_(0)
+    , header_(0)
+    , firstRecord_(0)
+    , pool_(inflatePool)
+    , index_(0)
+    , limited_(false)
+    , chunkIdx_(0)
+    , finished_(false)
+    , targeted_(false)
+    , buffer_(0)
+    , blockIdx_(0)
+    , cursor_(0)
+    , filled_(0)
+    , nextAddress_(0)
+{
+    open();
+    setRegion(region);
+}
+
+MappedBamReader::~MappedBamReader() {
+    // entries may outlive us; they keep their own buffers alive
+    discardPeeked();
+    if (buffer_)
+        buffer_->unref();
+    for (auto i = spare_.begin(); i != spare_.end(); ++i)
+        (*i)->unref();
+
+    if (index_)
+        bam_index_destroy(index_);
+    if (header_)
+        bam_header_destroy(header_);
+    if (map_)
+        munmap(const_cast<uint8_t*>(map_), mapSize_);
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+void MappedBamReader::open() {
+    if (bam_is_be)
+        throw runtime_error("The native bam reader does not support big endian machines");
+
+    // let samtools deal with the header
+    bamFile fp = bam_open(path_.c_str(), "r");
+    if (!fp)
+        throw runtime_error(str(format("Failed to open samfile %1%") % path_));
+    header_ = bam_header_read(fp);
+    firstRecord_ = bam_tell(fp);
+    bam_close(fp);
+    if (!header_)
+        throw runtime_error(str(format("%1% is not a valid bam file") % path_));
+
+    fd_ = ::open(path_.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd_ < 0 || fstat(fd_, &st) != 0)
+        throw runtime_error(str(format("Failed to open %1%: %2%") % path_ % strerror(errno)));
+
+    mapSize_ = st.st_size;
+    void* p = mmap(0, mapSize_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (p == MAP_FAILED)
+        throw runtime_error(str(format("Failed to map %1%: %2%") % path_ % strerror(errno)));
+    map_ = static_cast<uint8_t const*>(p);
+    madvise(p, mapSize_, MADV_SEQUENTIAL);
+}
+
+bam_header_t* MappedBamReader::header() const {
+    return header_;
+}
+
+string const& MappedBamReader::path() const {
+    return path_;
+}
+
+Region const* MappedBamReader::region() const {
+    return limited_ && !targeted_ ? &region_ : 0;
+}
+
+void MappedBamReader::loadIndex() {
+    if (!index_) {
+        index_ = bam_index_load(path_.c_str());
+        if (!index_)
+            throw runtime_error(str(format("Failed to load bam index for %1%") % path_));
+    }
+}
+
+void MappedBamReader::walkChunks(vector<BgzfChunk>& chunks) {
+    discardPeeked();
+    limited_ = true;
+    chunks_.swap(chunks);
+    chunkIdx_ = 0;
+    finished_ = chunks_.empty();
+    if (!finished_)
+        seek(chunks_[0].beg);
+}
+
+void MappedBamReader::setRegion(Region const& region) {
+    if (region.tid < 0 || region.tid >= header_->n_targets) {
+        throw runtime_error(str(format(
+            "Invalid target id %1% for bam region in file %2%")
+            % region.tid % path_));
+    }
+
+    loadIndex();
+    targeted_ = false;
+    region_ = region;
+    vector<BgzfChunk> chunks = bamIndexChunks(index_, region_.tid, region_.beg, region_.end);
+    walkChunks(chunks);
+}
+
+void MappedBamReader::setTargets(vector<Region> const& targets) {
+    loadIndex();
+    targeted_ = true;
+    targets_ = targets;
+    targetCursor_.reset(&targets_);
+    vector<BgzfChunk> chunks = bamIndexChunks(index_, targets_);
+    walkChunks(chunks);
+}
+
+bool MappedBamReader::skipTo(int tid, int pos) {
+    if (limited_) {
+        if (targeted_ || tid != region_.tid || pos >= region_.end)
+            return false;
+
+        // never go back: that would read entries a second time
+        vector<BgzfChunk> chunks = bamIndexChunks(index_, tid, pos, region_.end);
+        if (!chunks.empty() && chunks[0].beg <= tell())
+            return false;
+
+        walkChunks(chunks);
+        return true;
+    }
+
+    if (!index_)
+        index_ = bam_index_load(path_.c_str());
+
+    uint64_t offset;
+    if (!index_ || !bamIndexOffset(index_, header_->n_targets, tid, pos, &offset) || offset <= tell())
+        return false;
+
+    discardPeeked();
+    seek(offset);
+    return true;
+}
+
+RecordBuffer* MappedBamReader::freshBuffer(size_t capacity) {
+    for (auto i = spare_.begin(); i != spare_.end(); ++i) {
+        if ((*i)->unique()) {
+            RecordBuffer* rv = *i;
+            spare_.erase(i);
+            rv->reserve(capacity);
+            return rv;
+        }
+    }
+    return new RecordBuffer(capacity);
+}
+
+void MappedBamReader::retire(RecordBuffer* buffer) {
+    if (!buffer)
+        return;
+
+    if (spare_.size() == MAX_SPARE_BUFFERS) {
+        // it is still referenced by entries, or we would have reused it
+        spare_.front()->unref();
+        spare_.erase(spare_.begin());
+    }
+    spare_.push_back(buffer);
+}
+
+void MappedBamReader::inflateBlocks() {
+    // find as many whole blocks as fit in the buffer, then inflate them all
+    // at once so that a pool can work on them in parallel.
+    struct Job {
+        uint8_t const* block;
+        size_t size;
+        uint8_t* out;
+    };
+    vector<Job> jobs;
+    uint8_t* base = buffer_->data();
+    size_t capacity = buffer_->capacity();
+
+    try {
+        while (nextAddress_ < int64_t(mapSize_)) {
+            uint8_t const* block = map_ + nextAddress_;
+            size_t avail = mapSize_ - nextAddress_;
+            if (avail < Bgzf::HEADER_SIZE
+                || avail < Bgzf::HEADER_SIZE + Bgzf::extraLength(block))
+            {
+                throw runtime_error("truncated bgzf block");
+            }
+
+            size_t size = Bgzf::blockSize(block, block + Bgzf::HEADER_SIZE);
+            if (size > avail)
+                throw runtime_error("truncated bgzf block");
+
+            uint32_t isize = Bgzf::inflatedSize(block + size);
+            if (filled_ + isize > capacity)
+                break;
+
+            Job job = { block, size, base + filled_ };
+            jobs.push_back(job);
+            BlockSpan span = { filled_, isize, nextAddress_, 0 };
+            blocks_.push_back(span);
+            filled_ += isize;
+            nextAddress_ += size;
+        }
+    } catch (runtime_error const& e) {
+        throw runtime_error(str(format("%1%: %2% at offset %3%") % path_ % e.what() % nextAddress_));
+    }
+
+    if (pool_ && jobs.size() > 1) {
+        vector<future<void>> done;
+        for (auto i = jobs.begin(); i != jobs.end(); ++i) {
+            Job job = *i;
+            done.push_back(pool_->submit([job]() { Bgzf::inflate(job.block, job.size, job.out); }));
+        }
+        // wait for all of them before anything can throw
+        for (auto i = done.begin(); i != done.end(); ++i)
+            i->wait();
+        for (auto i = done.begin(); i != done.end(); ++i)
+            i->get();
+    } else {
+        for (auto i = jobs.begin(); i != jobs.end(); ++i)
+            Bgzf::inflate(i->block, i->size, i->out);
+    }
+}
+
+bool MappedBamReader::ensure(size_t n) {
+    if (filled_ - cursor_ >= n)
+        return true;
+    if (nextAddress_ >= int64_t(mapSize_))
+        return false;
+
+    // move on to a fresh buffer, bringing along the part of the current
+    // record that we already have. entries handed out keep the old buffer.
+    size_t tail = filled_ - cursor_;
+    RecordBuffer* fresh = freshBuffer(max(BUFFER_SIZE, n + BGZF_MAX_BLOCK_SIZE));
+    if (tail)
+        memcpy(fresh->data(), buffer_->data() + cursor_, tail);
+
+    vector<BlockSpan> carried;
+    for (size_t i = blockIdx_; i < blocks_.size(); ++i) {
+        BlockSpan const& b = blocks_[i];
+        if (b.start + b.length <= cursor_)
+            continue;
+        size_t from = max(b.start, cursor_);
+        BlockSpan span = { from - cursor_, b.start + b.length - from, b.address, uint32_t(b.skip + from - b.start) };
+        carried.push_back(span);
+    }
+
+    retire(buffer_);
+    buffer_ = fresh;
+    blocks_.swap(carried);
+    blockIdx_ = 0;
+    cursor_ = 0;
+    filled_ = tail;
+
+    while (filled_ < n && nextAddress_ < int64_t(mapSize_))
+        inflateBlocks();
+    return filled_ >= n;
+}
+
+uint64_t MappedBamReader::tell() {
+    while (blockIdx_ < blocks_.size() && cursor_ >= blocks_[blockIdx_].start + blocks_[blockIdx_].length)
+        ++blockIdx_;
+
+    // like bgzf, the end of a block is reported as the start of the next
+    if (blockIdx_ == blocks_.size())
+        return uint64_t(nextAddress_) << 16;
+
+    BlockSpan const& b = blocks_[blockIdx_];
+    return uint64_t(b.address) << 16 | (b.skip + cursor_ - b.start);
+}
+
+void MappedBamReader::seek(uint64_t voffset) {
+    int64_t address = voffset >> 16;
+    size_t offset = voffset & 0xffff;
+
+    // chunks are often close together; the block may already be here
+    for (size_t i = 0; i < blocks_.size(); ++i) {
+        BlockSpan const& b = blocks_[i];
+        if (b.address == address && b.skip == 0 && offset <= b.length) {
+            blockIdx_ = i;
+            cursor_ = b.start + offset;
+            return;
+        }
+    }
+
+    if (address > int64_t(mapSize_))
+        throw runtime_error(str(format("%1%: invalid bgzf offset %2%") % path_ % voffset));
+
+    retire(buffer_);
+    buffer_ = freshBuffer(BUFFER_SIZE);
+    blocks_.clear();
+    blockIdx_ = 0;
+    cursor_ = 0;
+    filled_ = 0;
+    nextAddress_ = address;
+    inflateBlocks();
+
+    if (offset > (blocks_.empty() ? 0 : blocks_[0].length))
+        throw runtime_error(str(format("%1%: invalid bgzf offset %2%") % path_ % voffset));
+    cursor_ = offset;
+}
+
+BamEntry* MappedBamReader::next() {
+    while (!finished_) {
+        if (limited_ && tell() >= chunks_[chunkIdx_].end) {
+            if (++chunkIdx_ == chunks_.size())
+                break;
+            // adjacent chunks need no seek
+            if (chunks_[chunkIdx_].beg != chunks_[chunkIdx_ - 1].end)
+                seek(chunks_[chunkIdx_].beg);
+        }
+
+        if (!ensure(4)) {
+            if (filled_ != cursor_)
+                throw runtime_error(str(format("%1%: truncated bam record") % path_));
+            break;
+        }
+
+        int32_t blockLen;
+        memcpy(&blockLen, buffer_->data() + cursor_, 4);
+        if (blockLen < int32_t(CORE_SIZE) || !ensure(4 + size_t(blockLen)))
+            throw runtime_error(str(format("%1%: truncated bam record") % path_));
+
+        uint8_t* rec = buffer_->data() + cursor_ + 4;
+        cursor_ += 4 + blockLen;
+
+        // the same unpacking as bam_read1
+        uint32_t x[8];
+        memcpy(x, rec, CORE_SIZE);
+        bam1_core_t core;
+        bam1_core_t* c = &core;
+        c->tid = x[0];
+        c->pos = x[1];
+        c->bin = x[2] >> 16;
+        c->qual = x[2] >> 8 & 0xff;
+        c->l_qname = x[2] & 0xff;
+        c->flag = x[3] >> 16;
+        c->n_cigar = x[3] & 0xffff;
+        c->l_qseq = x[4];
+        c->mtid = x[5];
+        c->mpos = x[6];
+        c->isize = x[7];
+        uint8_t* data = rec + CORE_SIZE;
+
+        if (limited_ && !targeted_ && (c->tid != region_.tid || c->pos >= region_.end))
+            break; // past the region, no need to go on
+
+        // the filter only needs the core, so rejected records are dropped
+        // before their cigar is looked at
+        if (filter() && !filter()->accept(*c))
+            continue;
+
+        if (targeted_) {
+            uint32_t end = c->n_cigar
+                ? bam_calend(c, reinterpret_cast<uint32_t*>(data + c->l_qname))
+                : c->pos + 1;
+            if (!targetCursor_.overlaps(c->tid, c->pos, end)) {
+                if (targetCursor_.done())
+                    break; // past the last target
+                continue;
+            }
+        } else if (limited_) {
+            uint32_t end = c->n_cigar
+                ? bam_calend(c, reinterpret_cast<uint32_t*>(data + c->l_qname))
+                : c->pos + 1;
+            if (end <= uint32_t(region_.beg))
+                continue;
+        }
+
+        BamEntry* rv = entryPool()->get();
+        rv->setView(*c, data, blockLen - CORE_SIZE, buffer_);
+        return rv;
+    }
+
+    finished_ = true;
+    return 0;
+}
+
+size_t MappedBamReader::nextBatch(vector<BamEntry*>& out, size_t n) {
+    // views are cheap to make; there is nothing to gain from batching here
+    size_t rv = 0;
+    for (; rv < n; ++rv) {
+        BamEntry* entry = next();
+        if (!entry)
+            break;
+        out.push_back(entry);
+    }
+    return rv;
+}
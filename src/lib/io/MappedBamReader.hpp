@@ -0,0 +1,91 @@
+#pragma once
+
+#include "BamIndexChunks.hpp"
+#include "BamReaderBase.hpp"
+#include "RecordBuffer.hpp"
+#include "TargetRegions.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+
+// Native bam reader. The file is memory mapped and bgzf blocks are inflated
+// (on a thread pool if one is given) straight into large reference counted
+// buffers. Entries returned by take() are views into those buffers rather
+// than copies, so there is no allocation or copy of the record data per read.
+// A buffer is reused once no entries point into it any more. Records are
+// accessed in place, unaligned, which is fine on the little endian x86
+// machines this runs on; big endian hosts are refused.
+//
+// Without a region the whole file is read, like BamReader. With one, the
+// reader behaves like RegionLimitedBamReader and needs a bam index.
+class MappedBamReader : public BamReaderBase {
+public:
+    explicit MappedBamReader(std::string const& path, ThreadPool* inflatePool = 0);
+    MappedBamReader(std::string const& path, char const* region, ThreadPool* inflatePool = 0);
+    MappedBamReader(std::string const& path, Region const& region, ThreadPool* inflatePool = 0);
+    ~MappedBamReader();
+
+    bam_header_t* header() const;
+    std::string const& path() const;
+    Region const* region() const;
+
+    void setRegion(Region const& region);
+    void setTargets(std::vector<Region> const& targets);
+
+    // skips within the region, if there is one, which doesn't change. never
+    // skips when reading targets.
+    bool skipTo(int tid, int pos);
+
+protected:
+    // a run of inflated bytes from one bgzf block
+    struct BlockSpan {
+        std::size_t start; // offset in the current buffer
+        std::size_t length;
+        int64_t address; // file offset of the compressed block
+        uint32_t skip; // bytes of the block that come before start
+    };
+
+    BamEntry* next();
+    std::size_t nextBatch(std::vector<BamEntry*>& out, std::size_t n);
+
+    void open();
+    void loadIndex();
+    void walkChunks(std::vector<BgzfChunk>& chunks);
+    void seek(uint64_t voffset);
+    uint64_t tell();
+    bool ensure(std::size_t n);
+    void inflateBlocks();
+    RecordBuffer* freshBuffer(std::size_t capacity);
+    void retire(RecordBuffer* buffer);
+
+protected:
+    std::string path_;
+    int fd_;
+    uint8_t const* map_;
+    std::size_t mapSize_;
+    bam_header_t* header_;
+    uint64_t firstRecord_;
+    ThreadPool* pool_;
+
+    bam_index_t* index_;
+    bool limited_;
+    Region region_;
+    std::vector<BgzfChunk> chunks_;
+    std::size_t chunkIdx_;
+    bool finished_;
+    bool targeted_;
+    std::vector<Region> targets_;
+    RegionCursor targetCursor_;
+
+    RecordBuffer* buffer_;
+    std::vector<RecordBuffer*> spare_;
+    std::vector<BlockSpan> blocks_;
+    std::size_t blockIdx_;
+    std::size_t cursor_;
+    std::size_t filled_;
+    int64_t nextAddress_;
+};
@@ -0,0 +1,171 @@
+#include "MergingBamReader.hpp"
+#include "BamEntry.hpp"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+using boost::format;
+using namespace std;
+
+namespace {
+    // unmapped entries, with a tid and start of -1, sort last
+    inline uint64_t sortKey(BamEntry const& e) {
+        return (uint64_t(uint32_t(e.tid())) << 32) | uint32_t(e.start());
+    }
+
+    bool sameSequences(bam_header_t const* a, bam_header_t const* b) {
+        if (a->n_targets != b->n_targets)
+            return false;
+        for (int32_t i = 0; i < a->n_targets; ++i) {
+            if (a->target_len[i] != b->target_len[i] || strcmp(a->target_name[i], b->target_name[i]) != 0)
+                return false;
+        }
+        return true;
+    }
+}
+
+MergingBamReader::MergingBamReader(vector<unique_ptr<BamReaderBase>> sources)
+    : sources_(move(sources))
+    , primed_(false)
+    , heads_(sources_.size(), 0)
+    , lastSource_(0)
+    , skipped_(sources_.size(), 0)
+{
+    if (sources_.empty())
+        throw invalid_argument("MergingBamReader: no readers to merge");
+
+    heap_.reserve(sources_.size());
+    for (size_t i = 0; i < sources_.size(); ++i) {
+        if (i > 0) {
+            path_ += ",";
+            if (!sameSequences(sources_[0]->header(), sources_[i]->header())) {
+                throw invalid_argument(str(format(
+                    "Can not merge %1% with %2%: their sequences differ")
+                    % sources_[i]->path() % sources_[0]->path()));
+            }
+        }
+        path_ += sources_[i]->path();
+    }
+}
+
+MergingBamReader::~MergingBamReader() {
+    reset();
+}
+
+bam_header_t* MergingBamReader::header() const {
+    return sources_[0]->header();
+}
+
+string const& MergingBamReader::path() const {
+    return path_;
+}
+
+Region const* MergingBamReader::region() const {
+    return sources_[0]->region();
+}
+
+void MergingBamReader::reset() {
+    discardPeeked();
+    for (auto i = heads_.begin(); i != heads_.end(); ++i) {
+        BamEntry::release(*i);
+        *i = 0;
+    }
+    heap_.clear();
+    primed_ = false;
+}
+
+void MergingBamReader::setRegion(Region const& region) {
+    reset();
+    for (auto i = sources_.begin(); i != sources_.end(); ++i)
+        (*i)->setRegion(region);
+}
+
+void MergingBamReader::setTargets(vector<Region> const& targets) {
+    reset();
+    for (auto i = sources_.begin(); i != sources_.end(); ++i)
+        (*i)->setTargets(targets);
+}
+
+bool MergingBamReader::skipTo(int tid, int pos) {
+    // make sure the entry at the top, which the caller has likely peeked
+    // at, is accounted for: a source that doesn't skip must still produce it
+    BamEntry* peeked = peek();
+
+    bool rv = false;
+    for (size_t i = 0; i < sources_.size(); ++i) {
+        skipped_[i] = sources_[i]->skipTo(tid, pos);
+        rv |= skipped_[i] != 0;
+    }
+    if (!rv)
+        return false;
+
+    // a source only skips forward, so what it produces now still sorts
+    // after the peeked entry of a source that didn't
+    if (peeked && skipped_[lastSource_])
+        discardPeeked();
+
+    heap_.clear();
+    for (size_t i = 0; i < sources_.size(); ++i) {
+        if (skipped_[i]) {
+            BamEntry::release(heads_[i]);
+            heads_[i] = sources_[i]->take();
+        }
+        if (heads_[i])
+            heap_.push_back(make_pair(sortKey(*heads_[i]), i));
+    }
+    make_heap(heap_.begin(), heap_.end(), greater<HeapItem>());
+    return true;
+}
+
+uint32_t MergingBamReader::droppedAt(int tid, int32_t pos) {
+    uint32_t rv = 0;
+    for (auto i = sources_.begin(); i != sources_.end(); ++i)
+        rv += (*i)->droppedAt(tid, pos);
+    return rv;
+}
+
+void MergingBamReader::advance(size_t i) {
+    BamEntry* e = sources_[i]->take();
+    heads_[i] = e;
+    if (e) {
+        heap_.push_back(make_pair(sortKey(*e), i));
+        push_heap(heap_.begin(), heap_.end(), greater<HeapItem>());
+    }
+}
+
+void MergingBamReader::prime() {
+    for (size_t i = 0; i < sources_.size(); ++i)
+        advance(i);
+    primed_ = true;
+}
+
+BamEntry* MergingBamReader::next() {
+    if (!primed_)
+        prime();
+    if (heap_.empty())
+        return 0;
+
+    pop_heap(heap_.begin(), heap_.end(), greater<HeapItem>());
+    size_t i = heap_.back().second;
+    heap_.pop_back();
+
+    BamEntry* rv = heads_[i];
+    lastSource_ = i;
+    advance(i);
+    return rv;
+}
+
+size_t MergingBamReader::nextBatch(vector<BamEntry*>& out, size_t n) {
+    size_t rv = 0;
+    for (; rv < n; ++rv) {
+        BamEntry* entry = next();
+        if (!entry)
+            break;
+        out.push_back(entry);
+    }
+    return rv;
+}
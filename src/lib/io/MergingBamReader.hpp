@@ -0,0 +1,64 @@
+#pragma once
+
+#include "BamReaderBase.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Merges the entries of several sorted readers, e.g., the per lane bams of
+// one sample, into a single sorted stream, as samtools merge would but
+// without writing the result out. The next entry of each source is kept in a
+// small heap ordered by (tid, start), ties going to the earlier source, and
+// unmapped entries last. The sources must share their sequence dictionary;
+// the header and targetName() are those of the first one. Repositioning
+// (setRegion, setTargets, skipTo) is passed on to every source. Entries are
+// filtered by the sources; setFilter() on this object has no effect.
+class MergingBamReader : public BamReaderBase {
+public:
+    // takes ownership of sources, of which there must be at least one
+    explicit MergingBamReader(std::vector<std::unique_ptr<BamReaderBase>> sources);
+    ~MergingBamReader();
+
+    bam_header_t* header() const;
+    // the paths of the sources, separated by commas
+    std::string const& path() const;
+    Region const* region() const;
+
+    void setRegion(Region const& region);
+    void setTargets(std::vector<Region> const& targets);
+    // skips every source that can skip; true if any did
+    bool skipTo(int tid, int pos);
+    // the sum over the sources
+    uint32_t droppedAt(int tid, int32_t pos);
+
+protected:
+    // (sort key, source index)
+    typedef std::pair<uint64_t, std::size_t> HeapItem;
+
+    BamEntry* next();
+    std::size_t nextBatch(std::vector<BamEntry*>& out, std::size_t n);
+
+    // take the next entry of source i and add it to the heap
+    void advance(std::size_t i);
+    // take the first entry of every source
+    void prime();
+    // forget the entries taken so far, e.g., before repositioning
+    void reset();
+
+protected:
+    std::vector<std::unique_ptr<BamReaderBase>> sources_;
+    std::string path_;
+
+    bool primed_;
+    // the next entry of each source, 0 at its end
+    std::vector<BamEntry*> heads_;
+    // a min heap of the sources with a next entry
+    std::vector<HeapItem> heap_;
+    // the source of the last entry handed out
+    std::size_t lastSource_;
+    std::vector<char> skipped_;
+};
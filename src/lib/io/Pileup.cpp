@@ -12,54 +12,62 @@ Pileup* Pileup::create() {
     return new Pileup;
 }
 
-Pileup::Pileup() {
+Pileup::Pileup()
+    : _tid(-1)
+    , _size(0)
+    , _dropped(0)
+    , _bases(0)
+    , _qualities(0)
+{
 }
 
 Pileup::~Pileup() {
 }
 
-void Pileup::set(std::vector<EntryType>& entries) {
-    _entries.swap(entries);
+void Pileup::assign(int tid, uint8_t const* bases, uint8_t const* qualities, uint32_t n) {
+    _ownBases.assign(bases, bases + n);
+    _ownQualities.assign(qualities, qualities + n);
+    view(tid, _ownBases.data(), _ownQualities.data(), n);
 }
 
 uint32_t Pileup::readsMatching(int base, int minQual) const {
     uint32_t rv = 0;
-    for (auto iter = _entries.begin(); iter != _entries.end(); ++iter) {
-        if (iter->base == base && iter->quality >= minQual)
-            ++rv;
-    }
+    for (uint32_t i = 0; i < _size; ++i)
+        rv += (_bases[i] == base) & (_qualities[i] >= minQual);
     return rv;
 }
 
 double Pileup::baseQualityHarmonicMean() const {
     double denominator = 0.0;
-    for (auto iter = _entries.begin(); iter != _entries.end(); ++iter)
-        denominator += Lut::phred2p_reciprocal(iter->quality);
+    for (uint32_t i = 0; i < _size; ++i)
+        denominator += Lut::phred2p_reciprocal(_qualities[i]);
     return size()/denominator;
 }
 
 vector<uint8_t> Pileup::baseQualities(int minQual) const {
     vector<uint8_t> qualities;
-    qualities.reserve(_entries.size());
-    for (auto iter = _entries.begin(); iter != _entries.end(); ++iter) {
-        int qual = iter->quality;
-        if (qual >= minQual) {
-            qualities.push_back(qual);
-            assert(qual < 256);
-        }
+    qualities.reserve(_size);
+    for (uint32_t i = 0; i < _size; ++i) {
+        if (_qualities[i] >= minQual)
+            qualities.push_back(_qualities[i]);
     }
     countingSort<0, 255>(qualities.begin(), qualities.end());
     return qualities;
 }
 
 void Pileup::baseCounts(int bases[4]) const {
-    memset(bases, 0, sizeof(int)*4);
-    for (auto iter = _entries.begin(); iter != _entries.end(); ++iter) {
-        if (iter->base & 1) ++bases[0];
-        if (iter->base & 2) ++bases[1];
-        if (iter->base & 4) ++bases[2];
-        if (iter->base & 8) ++bases[3];
+    // ambiguity codes count towards every base they allow
+    uint32_t a = 0, c = 0, g = 0, t = 0;
+    for (uint32_t i = 0; i < _size; ++i) {
+        a += _bases[i] & 1;
+        c += _bases[i] >> 1 & 1;
+        g += _bases[i] >> 2 & 1;
+        t += _bases[i] >> 3 & 1;
     }
+    bases[0] = a;
+    bases[1] = c;
+    bases[2] = g;
+    bases[3] = t;
 }
 
 int Pileup::variantAllele(int ref, int occ[4]) {
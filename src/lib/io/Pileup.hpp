@@ -5,6 +5,11 @@
 #include <cstdint>
 #include <vector>
 
+// The bases and qualities of the reads covering one reference position.
+// Storage is structure-of-arrays: one array of 4 bit (nt16) base codes and one
+// of 8 bit qualities, so that the statistics below are simple loops over
+// bytes that the compiler can vectorize. A pileup either owns its arrays or is
+// a view of a column in a PileupWindow.
 class Pileup {
 public:
     typedef BamEntry::PileupData EntryType;
@@ -13,34 +18,85 @@ public:
     static Pileup* create();
     ~Pileup();
 
-    void set(std::vector<EntryType>& entries);
+    // copy n bases and qualities into the pileup
+    void assign(int tid, uint8_t const* bases, uint8_t const* qualities, uint32_t n);
 
     bool empty() const;
     uint32_t size() const;
+    int tid() const;
+    // reads covering the position that were left out by downsampling
+    uint32_t dropped() const;
     uint32_t readsMatching(int base, int minQual) const;
     double baseQualityHarmonicMean() const;
 
-    const EntryType& operator[](uint32_t idx) const;
+    EntryType operator[](uint32_t idx) const;
+
+    uint8_t const* bases() const;
+    uint8_t const* qualities() const;
 
     std::vector<uint8_t> baseQualities(int minQual) const;
 
     void baseCounts(int occ[4]) const;
 
 protected:
+    friend class PileupWindow;
+
     Pileup();
 
+    // point the pileup at arrays owned by someone else
+    void view(int tid, uint8_t const* bases, uint8_t const* qualities, uint32_t n);
+
+    void setDropped(uint32_t n) {
+        _dropped = n;
+    }
+
 protected:
-    std::vector<EntryType> _entries;
+    int _tid;
+    uint32_t _size;
+    uint32_t _dropped;
+    uint8_t const* _bases;
+    uint8_t const* _qualities;
+    std::vector<uint8_t> _ownBases;
+    std::vector<uint8_t> _ownQualities;
 };
 
 inline bool Pileup::empty() const {
-    return _entries.empty();
+    return _size == 0;
 }
 
 inline uint32_t Pileup::size() const {
-    return _entries.size();
+    return _size;
+}
+
+inline int Pileup::tid() const {
+    return _tid;
+}
+
+inline uint32_t Pileup::dropped() const {
+    return _dropped;
+}
+
+inline uint8_t const* Pileup::bases() const {
+    return _bases;
+}
+
+inline uint8_t const* Pileup::qualities() const {
+    return _qualities;
+}
+
+inline Pileup::EntryType Pileup::operator[](uint32_t idx) const {
+    EntryType rv;
+    rv.tid = _tid;
+    rv.readOffset = -1;
+    rv.base = _bases[idx];
+    rv.quality = _qualities[idx];
+    return rv;
 }
 
-inline const Pileup::EntryType& Pileup::operator[](uint32_t idx) const {
-    return _entries[idx];
+inline void Pileup::view(int tid, uint8_t const* bases, uint8_t const* qualities, uint32_t n) {
+    _tid = tid;
+    _size = n;
+    _dropped = 0;
+    _bases = bases;
+    _qualities = qualities;
 }
@@ -1,28 +1,47 @@
 #include "PileupBuffer.hpp"
+#include "PileupWindow.hpp"
 
 #include <algorithm>
+#include <functional>
 
 using namespace std;
 
+namespace {
+    // holes tolerated in the start ordered vector beyond one per live entry
+    // before it is compacted
+    size_t const COMPACT_SLACK = 64;
+
+    // pushed entries held on to before they go back to their reader
+    size_t const RELEASE_BATCH = 64;
+}
+
 PileupBuffer::PileupBuffer()
-    : _end(0)
+    : _head(0)
+    , _live(0)
+    , _end(0)
+    , _minQual(0)
 {
+    _taken.reserve(RELEASE_BATCH);
 }
 
 PileupBuffer::~PileupBuffer() {
     clear();
 }
 
+void PileupBuffer::setMinQuality(int minQual) {
+    _minQual = minQual;
+}
+
 int PileupBuffer::tid() const {
     if (empty())
         return -1;
-    return _buf.front()->tid();
+    return front()->tid();
 }
 
 int32_t PileupBuffer::start() const {
     if (empty())
         return 0;
-    return _buf.front()->start();
+    return front()->start();
 }
 
 uint32_t PileupBuffer::end() const {
@@ -30,24 +49,35 @@ uint32_t PileupBuffer::end() const {
 }
 
 Pileup* PileupBuffer::pileup(uint32_t pos) const {
+    PileupWindow window;
+    window.fill(*this, pos, pos + 1);
+    Pileup const& column = window.column(pos);
+
     Pileup* rv(Pileup::create());
+    rv->assign(tid(), column.bases(), column.qualities(), column.size());
+    return rv;
+}
 
-    std::vector<BamEntry::PileupData> entries;
-    entries.reserve(_buf.size());
-    BamEntry::PileupData pileupData;
-    for (auto iter = _buf.begin(); iter != _buf.end(); ++iter) {
-        if (uint32_t((*iter)->start()) > pos)
-            break;
-
-        if ((*iter)->end() > pos) {
-            if ((*iter)->resolveCigar(pos, pileupData)) {
-                entries.push_back(pileupData);
-            }
-        }
-    }
-    rv->set(entries);
+void PileupBuffer::countSpans(uint32_t begin, uint32_t end, vector<int32_t>& diff) const {
+    diff.assign(end - begin + 1, 0);
+    forEachOverlapping(begin, end, [&](PackedRead const& read) {
+        ++diff[max(uint32_t(read.start()), begin) - begin];
+        --diff[min(read.end(), end) - begin];
+    });
+}
 
-    return rv;
+void PileupBuffer::append(const BamEntry* b) {
+    // b may still be the entry its reader has peeked at, which the caller
+    // takes once this returns, so it must not go back in this call
+    if (_taken.size() == RELEASE_BATCH)
+        releaseTaken();
+    _taken.push_back(b);
+
+    EndSlot es = { b->end(), uint32_t(_buf.size()) };
+    _buf.push_back(_slab.add(*b, _minQual));
+    _ends.push_back(es);
+    push_heap(_ends.begin(), _ends.end(), greater<EndSlot>());
+    ++_live;
 }
 
 bool PileupBuffer::push(const BamEntry* b) {
@@ -55,40 +85,101 @@ bool PileupBuffer::push(const BamEntry* b) {
         return false;
 
     if (empty()) {
-        _buf.push_back(b);
+        append(b);
         _end = b->end();
         return true;
     }
 
-    if (_buf.front()->cmp(*b) == OVERLAP) {
-        _buf.push_back(b);
+    // the same test as BamEntry::cmp
+    PackedRead const* f = front();
+    if (f->tid() == b->tid() && uint32_t(b->start()) < f->end() && uint32_t(f->start()) < b->end()) {
+        append(b);
         return true;
     } else {
         return false;
     }
 }
 
+bool PileupBuffer::pushBefore(const BamEntry* b, uint32_t limit) {
+    if (!b || empty() || b->tid() != tid() || uint32_t(b->start()) >= limit)
+        return false;
+
+    append(b);
+    return true;
+}
+
+void PileupBuffer::releaseTaken() {
+    // entries go back to their reader's pool in one batch
+    if (!_taken.empty())
+        BamEntry::release(_taken.data(), _taken.size());
+    _taken.clear();
+}
+
 void PileupBuffer::clear() {
-    for (auto i = _buf.begin(); i != _buf.end(); ++i)
-        delete *i;
+    releaseTaken();
+    _slab.clear();
     _buf.clear();
+    _ends.clear();
+    _head = 0;
+    _live = 0;
     _end = 0;
 }
 
 void PileupBuffer::clearBefore(int tid, uint32_t pos) {
-    auto iter = _buf.begin();
-    for (; iter != _buf.end(); ++iter) {
-        if ((*iter)->tid() > tid || ((*iter)->tid() == tid && (*iter)->end() > pos))
-            break;
+    // the buffer only ever holds entries from one sequence
+    if (empty() || this->tid() > tid)
+        return;
+    if (this->tid() < tid) {
+        clear();
+        return;
     }
 
-    for (auto del = _buf.begin(); del != iter; ++del)
-        delete *del;
+    uint32_t evicted = 0;
+    while (!_ends.empty() && _ends.front().end <= pos) {
+        uint32_t slot = _ends.front().slot;
+        pop_heap(_ends.begin(), _ends.end(), greater<EndSlot>());
+        _ends.pop_back();
+        _slab.remove(_buf[slot]);
+        _buf[slot] = 0;
+        ++evicted;
+    }
+    if (evicted == 0)
+        return;
 
-    _buf.erase(_buf.begin(), iter);
-    _end = 0;
-    if (!_buf.empty())
-        _end = _buf.front()->end();
+    _live -= evicted;
+
+    if (empty()) {
+        _buf.clear();
+        _head = 0;
+        _end = 0;
+        return;
+    }
+
+    while (!_buf[_head])
+        ++_head;
+    if (_buf.size() > 2 * _live + COMPACT_SLACK)
+        compact();
+    _end = front()->end();
+}
+
+void PileupBuffer::compact() {
+    // squeeze out the holes, then point the heap at the new slots. this is
+    // linear in the live entries, but only happens after at least as many
+    // evictions.
+    size_t out = 0;
+    for (size_t i = _head; i < _buf.size(); ++i) {
+        if (_buf[i])
+            _buf[out++] = _buf[i];
+    }
+    _buf.resize(out);
+    _head = 0;
+
+    _ends.clear();
+    for (size_t i = 0; i < _buf.size(); ++i) {
+        EndSlot es = { _buf[i]->end(), uint32_t(i) };
+        _ends.push_back(es);
+    }
+    make_heap(_ends.begin(), _ends.end(), greater<EndSlot>());
 }
 
 PosCompare PileupBuffer::cmp(const PileupBuffer& other, int32_t* xstart, uint32_t* xend) const {
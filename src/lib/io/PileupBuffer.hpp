@@ -2,46 +2,120 @@
 
 #include "io/BamEntry.hpp"
 #include "Pileup.hpp"
+#include "ReadSlab.hpp"
 
 #include <bam.h>
-#include <deque>
 #include <utility>
+#include <cstddef>
 #include <cstdint>
+#include <vector>
 
 
+// The reads overlapping the current stretch of the genome. Reads are kept in
+// the order they were pushed, i.e., sorted by start, and are also indexed by
+// end in a min-heap so that clearBefore() can evict every read that has ended
+// in time proportional to the number evicted, not just a prefix that stops at
+// the first long (e.g., spliced) read. Evicted reads leave a null slot behind
+// in the start ordered vector; the vector is compacted once the holes
+// outnumber the live reads.
+//
+// Pushed entries are packed into a ReadSlab on the way in and handed back to
+// their reader soon after, so the buffer holds a few hundred bytes less per
+// read than the full records, and piling up reads them from one place.
 class PileupBuffer {
 public:
+    // a vector rather than a deque: it stops allocating once it has grown to
+    // the largest pileup seen
+    typedef std::vector<const PackedRead*> Buffer;
+
     PileupBuffer();
     ~PileupBuffer();
 
+    // qualities below minQual are set to 0 as reads are pushed
+    void setMinQuality(int minQual);
+
     uint32_t size() const;
     bool empty() const;
 
-    const BamEntry* front() const {
-        return _buf.front();
+    const PackedRead* front() const {
+        return _buf[_head];
     }
 
     int tid() const;
     int32_t start() const;
     uint32_t end() const;
 
+    // call f(read) for each buffered read overlapping [begin, end), in order
+    // of start
+    template<typename Func>
+    void forEachOverlapping(uint32_t begin, uint32_t end, Func f) const;
+
+    // set diff to the difference counts of the reads spanning [begin, end):
+    // the sum of diff[0..i] is the number spanning begin + i. no cigars are
+    // looked at, so entries in a deletion or skipped region count too.
+    void countSpans(uint32_t begin, uint32_t end, std::vector<int32_t>& diff) const;
+
+    // the pileup at a single position. PileupWindow is much faster for runs
+    // of positions.
     Pileup* pileup(uint32_t pos) const;
 
+    // a pushed entry belongs to the buffer, which releases it; one that is
+    // not pushed still belongs to the caller
     bool push(const BamEntry* b);
+    // push b if it is on the same sequence as the buffer and starts before
+    // limit, even when it doesn't overlap the first read
+    bool pushBefore(const BamEntry* b, uint32_t limit);
     void clear();
     void clearBefore(int tid, uint32_t pos);
 
     PosCompare cmp(const PileupBuffer& other, int32_t* xstart, uint32_t* xend) const;
 
 protected:
-    std::deque<const BamEntry*> _buf;
+    // an entry of the end ordered heap, pointing at a slot of _buf
+    struct EndSlot {
+        uint32_t end;
+        uint32_t slot;
+
+        bool operator>(EndSlot const& rhs) const {
+            return end > rhs.end;
+        }
+    };
+
+    void append(const BamEntry* b);
+    void releaseTaken();
+    void compact();
+
+protected:
+    Buffer _buf;
+    // index of the first live slot in _buf
+    size_t _head;
+    uint32_t _live;
+    std::vector<EndSlot> _ends;
     uint32_t _end;
+
+    ReadSlab _slab;
+    int _minQual;
+    // pushed entries, already packed, waiting to be released in one batch
+    std::vector<const BamEntry*> _taken;
 };
 
 inline uint32_t PileupBuffer::size() const {
-    return _buf.size();
+    return _live;
 }
 
 inline bool PileupBuffer::empty() const {
-    return _buf.empty();
+    return _live == 0;
+}
+
+template<typename Func>
+inline void PileupBuffer::forEachOverlapping(uint32_t begin, uint32_t end, Func f) const {
+    for (size_t i = _head; i < _buf.size(); ++i) {
+        PackedRead const* read = _buf[i];
+        if (!read)
+            continue;
+        if (uint32_t(read->start()) >= end)
+            break;
+        if (read->end() > begin)
+            f(*read);
+    }
 }
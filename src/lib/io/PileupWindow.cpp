@@ -0,0 +1,124 @@
+#include "PileupWindow.hpp"
+#include "PileupBuffer.hpp"
+#include "ReadSlab.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+uint32_t const PileupWindow::DEFAULT_WIDTH;
+
+PileupWindow::PileupWindow()
+    : _tid(-1)
+    , _begin(0)
+    , _columns(0)
+{
+}
+
+void PileupWindow::addSegments(PackedRead const& read) {
+    uint32_t const end = _begin + _columns;
+    PackedRead::Segment const* seg = read.segments();
+    PackedRead::Segment const* last = seg + read.nSegments();
+
+    for (; seg != last; ++seg) {
+        uint32_t refPos = read.start() + seg->refOffset;
+        if (refPos >= end)
+            break;
+        if (refPos + seg->length <= _begin)
+            continue;
+
+        uint32_t first = max(refPos, _begin);
+        uint32_t stop = min(refPos + seg->length, end);
+        Segment s = { &read, first - _begin, seg->readPos + (first - refPos), stop - first, seg->minQuality };
+        _segments.push_back(s);
+        // difference counts, summed up into depths in fill()
+        ++_offsets[s.column];
+        --_offsets[s.column + s.length];
+    }
+}
+
+void PileupWindow::fill(PileupBuffer const& buf, uint32_t begin, uint32_t end) {
+    collect(buf, begin, end);
+    build(0);
+}
+
+void PileupWindow::collect(PileupBuffer const& buf, uint32_t begin, uint32_t end) {
+    assert(begin <= end);
+    _tid = buf.tid();
+    _begin = begin;
+    _columns = end - begin;
+    _segments.clear();
+    _offsets.assign(_columns + 1, 0);
+
+    buf.forEachOverlapping(begin, end, [this](PackedRead const& read) {
+        addSegments(read);
+    });
+}
+
+void PileupWindow::markCandidates(uint8_t const* ref, uint32_t refLen, int minQual, uint8_t* candidates) const {
+    for (uint32_t c = min(refLen, _columns); c < _columns; ++c)
+        candidates[c] = 1;
+
+    for (auto s = _segments.begin(); s != _segments.end(); ++s) {
+        uint8_t const* seq = s->read->bases();
+        uint32_t length = s->column < refLen ? min(s->length, refLen - s->column) : 0;
+        if (s->minQuality >= uint32_t(max(minQual, 0))) {
+            // the common case: every quality in the block passes
+            for (uint32_t k = 0; k < length; ++k) {
+                uint32_t c = s->column + k;
+                candidates[c] |= bam1_seqi(seq, s->readPos + k) != ref[c];
+            }
+            continue;
+        }
+
+        uint8_t const* qual = s->read->qualities();
+        for (uint32_t k = 0; k < length; ++k) {
+            uint32_t readPos = s->readPos + k;
+            uint32_t c = s->column + k;
+            candidates[c] |= (bam1_seqi(seq, readPos) != ref[c]) | (qual[readPos] < minQual);
+        }
+    }
+}
+
+void PileupWindow::build(uint8_t const* mask) {
+    // differences -> depths -> offsets of each column in the arrays. masked
+    // out columns take up no space.
+    uint32_t depth = 0;
+    uint32_t total = 0;
+    for (uint32_t c = 0; c <= _columns; ++c) {
+        depth += _offsets[c];
+        _offsets[c] = total;
+        if (!mask || (c < _columns && mask[c]))
+            total += depth;
+    }
+
+    _bases.resize(total);
+    _qualities.resize(total);
+    _cursor.assign(_offsets.begin(), _offsets.end() - 1);
+
+    // segments are in buffer order, so each column is too
+    for (auto s = _segments.begin(); s != _segments.end(); ++s) {
+        uint8_t const* seq = s->read->bases();
+        uint8_t const* qual = s->read->qualities();
+        for (uint32_t k = 0; k < s->length; ++k) {
+            uint32_t c = s->column + k;
+            if (mask && !mask[c])
+                continue;
+            uint32_t readPos = s->readPos + k;
+            uint32_t& out = _cursor[c];
+            _bases[out] = bam1_seqi(seq, readPos);
+            _qualities[out] = qual[readPos];
+            ++out;
+        }
+    }
+}
+
+Pileup const& PileupWindow::column(uint32_t pos) const {
+    assert(pos >= _begin && pos < end());
+    uint32_t c = pos - _begin;
+    uint32_t first = _offsets[c];
+    uint32_t n = _offsets[c + 1] - first;
+    _view.view(_tid, _bases.data() + first, _qualities.data() + first, n);
+    return _view;
+}
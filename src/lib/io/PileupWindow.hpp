@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Pileup.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class PackedRead;
+class PileupBuffer;
+
+// Piles up the reads of a PileupBuffer over a window of reference positions
+// at once. Each read's cigar is walked a single time and its aligned bases and
+// qualities are scattered into per column arrays, rather than resolving the
+// cigar of every buffered read again at every position. Within a column, the
+// reads keep their order in the buffer.
+class PileupWindow {
+public:
+    static uint32_t const DEFAULT_WIDTH = 1024;
+
+    PileupWindow();
+
+    // pile up the reads in buf over the positions [begin, end)
+    void fill(PileupBuffer const& buf, uint32_t begin, uint32_t end);
+
+    // fill() in two steps, so that only some of the columns need be built.
+    // collect() finds the parts of the reads that fall in the window.
+    // build() piles them up, leaving the columns that are 0 in mask empty;
+    // mask may be null to build every column.
+    void collect(PileupBuffer const& buf, uint32_t begin, uint32_t end);
+    void build(uint8_t const* mask);
+
+    // set candidates[c] for each column c of a collected window that has a
+    // base differing from ref[c], which holds nt16 codes, or a quality below
+    // minQual. columns at or past refLen have no reference and are always
+    // marked.
+    void markCandidates(uint8_t const* ref, uint32_t refLen, int minQual, uint8_t* candidates) const;
+
+    uint32_t begin() const {
+        return _begin;
+    }
+
+    uint32_t end() const {
+        return _begin + _columns;
+    }
+
+    // the pileup at pos, which must be inside the window. the result is a
+    // view that stays valid until the next call to column() or fill().
+    Pileup const& column(uint32_t pos) const;
+
+    // record n reads as left out of the column last returned by column()
+    void setDropped(uint32_t n) const {
+        _view.setDropped(n);
+    }
+
+protected:
+    // an aligned block of a read that falls inside the window
+    struct Segment {
+        PackedRead const* read;
+        uint32_t column;
+        uint32_t readPos;
+        uint32_t length;
+        // no base in the block has a lower quality
+        uint32_t minQuality;
+    };
+
+    void addSegments(PackedRead const& read);
+
+protected:
+    int _tid;
+    uint32_t _begin;
+    uint32_t _columns;
+
+    std::vector<Segment> _segments;
+    // column i's reads are at [_offsets[i], _offsets[i + 1]) in the arrays
+    std::vector<uint32_t> _offsets;
+    std::vector<uint32_t> _cursor;
+    std::vector<uint8_t> _bases;
+    std::vector<uint8_t> _qualities;
+
+    mutable Pileup _view;
+};
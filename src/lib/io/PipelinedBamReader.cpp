@@ -0,0 +1,128 @@
+#include "PipelinedBamReader.hpp"
+#include "BamEntry.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+    void deleteBatch(vector<BamEntry*>* batch) {
+        if (!batch->empty())
+            BamEntry::release(&(*batch)[0], batch->size());
+        delete batch;
+    }
+}
+
+PipelinedBamReader::PipelinedBamReader(BamReaderBase& source, size_t batchSize, size_t queueSize)
+    : source_(source)
+    , batchSize_(batchSize)
+    , queue_(queueSize)
+    , started_(false)
+    , current_(0)
+    , currentIdx_(0)
+{
+    if (batchSize_ == 0 || queueSize == 0)
+        throw invalid_argument("PipelinedBamReader: batch and queue sizes must be positive");
+}
+
+PipelinedBamReader::~PipelinedBamReader() {
+    // the consumer may stop before the end of input, leaving the decode
+    // thread blocked on a full queue.
+    queue_.cancel();
+    if (thread_.joinable())
+        thread_.join();
+
+    Batch* batch;
+    while (queue_.tryPop(batch))
+        deleteBatch(batch);
+
+    if (current_) {
+        current_->erase(current_->begin(), current_->begin() + currentIdx_);
+        deleteBatch(current_);
+    }
+}
+
+bam_header_t* PipelinedBamReader::header() const {
+    return source_.header();
+}
+
+string const& PipelinedBamReader::path() const {
+    return source_.path();
+}
+
+Region const* PipelinedBamReader::region() const {
+    return source_.region();
+}
+
+QueueStats PipelinedBamReader::queueStats() const {
+    return queue_.stats();
+}
+
+void PipelinedBamReader::start() {
+    // the source isn't touched until the first entry is requested, so it
+    // can still be configured after being wrapped.
+    started_ = true;
+    thread_ = thread(&PipelinedBamReader::decode, this);
+}
+
+void PipelinedBamReader::decode() {
+    try {
+        bool more = true;
+        while (more) {
+            Batch* batch = new Batch;
+            batch->reserve(batchSize_);
+            more = source_.take(*batch, batchSize_) == batchSize_;
+
+            if (batch->empty()) {
+                delete batch;
+            } else if (!queue_.push(batch)) {
+                deleteBatch(batch);
+                return;
+            }
+        }
+    } catch (...) {
+        error_ = current_exception();
+    }
+    queue_.close();
+}
+
+bool PipelinedBamReader::fetch() {
+    if (!started_)
+        start();
+
+    while (!current_ || currentIdx_ == current_->size()) {
+        delete current_;
+        current_ = 0;
+        currentIdx_ = 0;
+
+        if (!queue_.pop(current_)) {
+            current_ = 0;
+            // the decode thread has finished; rethrow whatever stopped it
+            if (thread_.joinable())
+                thread_.join();
+            if (error_)
+                rethrow_exception(error_);
+            return false;
+        }
+    }
+    return true;
+}
+
+BamEntry* PipelinedBamReader::next() {
+    if (!fetch())
+        return 0;
+    return (*current_)[currentIdx_++];
+}
+
+size_t PipelinedBamReader::nextBatch(vector<BamEntry*>& out, size_t n) {
+    size_t rv = 0;
+    while (rv < n && fetch()) {
+        size_t count = min(n - rv, current_->size() - currentIdx_);
+        Batch::iterator first = current_->begin() + currentIdx_;
+        out.insert(out.end(), first, first + count);
+        currentIdx_ += count;
+        rv += count;
+    }
+    return rv;
+}
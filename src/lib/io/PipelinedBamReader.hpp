@@ -0,0 +1,52 @@
+#pragma once
+
+#include "BamReaderBase.hpp"
+#include "utility/BoundedQueue.hpp"
+
+#include <cstddef>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Decodes entries from another reader on a background thread and hands them
+// over in batches through a bounded queue, so that bam decompression and
+// parsing overlap with whatever the consumer does with the entries. The
+// source reader applies the filter; setFilter() on this object has no effect.
+// The source must outlive this object and must not be used directly while it
+// exists.
+class PipelinedBamReader : public BamReaderBase {
+public:
+    // up to queueSize batches of batchSize entries are decoded ahead of the
+    // consumer.
+    PipelinedBamReader(BamReaderBase& source, std::size_t batchSize, std::size_t queueSize);
+    ~PipelinedBamReader();
+
+    bam_header_t* header() const;
+    std::string const& path() const;
+    Region const* region() const;
+
+    QueueStats queueStats() const;
+
+protected:
+    typedef std::vector<BamEntry*> Batch;
+
+    BamEntry* next();
+    std::size_t nextBatch(std::vector<BamEntry*>& out, std::size_t n);
+
+    void start();
+    // make sure current_ has an unread entry; false at the end of input
+    bool fetch();
+    void decode();
+
+protected:
+    BamReaderBase& source_;
+    std::size_t batchSize_;
+    BoundedQueue<Batch*> queue_;
+    std::thread thread_;
+    bool started_;
+    std::exception_ptr error_;
+
+    Batch* current_;
+    std::size_t currentIdx_;
+};
@@ -0,0 +1,190 @@
+#include "ReadSlab.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+namespace {
+    uint32_t const NO_BLOCK = ~0u;
+
+    // see CigarParser.cpp
+    static int const BAM_CONSUME_QUERY = 1;
+    static int const BAM_CONSUME_REFERENCE = 2;
+
+    inline bool isAlignedBase(int op) {
+        return op == BAM_CMATCH || op == BAM_CEQUAL || op == BAM_CDIFF;
+    }
+
+    // dst must be zeroed
+    inline void setBase(uint8_t* dst, uint32_t i, int base) {
+        dst[i >> 1] |= base << ((~i & 1) << 2);
+    }
+
+    // copy n packed bases from src, starting at base from, to dst, starting
+    // at base to
+    void copyBases(uint8_t* dst, uint32_t to, uint8_t const* src, uint32_t from, uint32_t n) {
+        if (((to ^ from) & 1) == 0) {
+            // the same half of a byte: all but the ends are whole bytes
+            if ((from & 1) && n) {
+                setBase(dst, to++, bam1_seqi(src, from));
+                ++from;
+                --n;
+            }
+            memcpy(dst + to / 2, src + from / 2, n / 2);
+            to += n & ~1u;
+            from += n & ~1u;
+            n &= 1;
+        }
+        // bam1_seqi evaluates its index twice
+        for (; n > 0; --n, ++from)
+            setBase(dst, to++, bam1_seqi(src, from));
+    }
+}
+
+uint32_t const ReadSlab::DEFAULT_BLOCK_SIZE;
+
+ReadSlab::ReadSlab(uint32_t blockSize)
+    : _blockSize(blockSize)
+    , _current(NO_BLOCK)
+{
+}
+
+PackedRead const* ReadSlab::add(BamEntry const& entry, int minQual) {
+    bam1_t const* b = entry.rawData();
+    uint32_t const* cigar = bam1_cigar(b);
+    uint32_t nCigar = b->core.n_cigar;
+
+    uint32_t nSegments = 0;
+    uint32_t length = 0;
+    for (uint32_t i = 0; i < nCigar; ++i) {
+        if (isAlignedBase(bam_cigar_op(cigar[i]))) {
+            ++nSegments;
+            length += bam_cigar_oplen(cigar[i]);
+        }
+    }
+
+    size_t bytes = sizeof(PackedRead) + nSegments * sizeof(PackedRead::Segment) + (length + 1) / 2 + length;
+    bytes = (bytes + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+    uint32_t block;
+    PackedRead* rv = new (allocate(bytes, block)) PackedRead;
+    rv->_tid = entry.tid();
+    rv->_start = entry.start();
+    rv->_end = entry.end();
+    rv->_nSegments = nSegments;
+    rv->_length = length;
+    rv->_block = block;
+
+    PackedRead::Segment* seg = const_cast<PackedRead::Segment*>(rv->segments());
+    uint8_t* bases = const_cast<uint8_t*>(rv->bases());
+    uint8_t* qualities = const_cast<uint8_t*>(rv->qualities());
+    memset(bases, 0, (length + 1) / 2);
+
+    uint8_t const* seq = bam1_seq(b);
+    uint8_t const* qual = bam1_qual(b);
+    uint32_t refPos = 0;
+    uint32_t readPos = 0;
+    uint32_t out = 0;
+    for (uint32_t i = 0; i < nCigar; ++i) {
+        int op = bam_cigar_op(cigar[i]);
+        uint32_t len = bam_cigar_oplen(cigar[i]);
+        int type = bam_cigar_type(op);
+
+        if (isAlignedBase(op)) {
+            copyBases(bases, out, seq, readPos, len);
+            uint8_t lowest = 0xff;
+            for (uint32_t k = 0; k < len; ++k) {
+                uint8_t q = qual[readPos + k];
+                if (q < minQual)
+                    q = 0;
+                qualities[out + k] = q;
+                lowest = min(lowest, q);
+            }
+
+            seg->refOffset = refPos;
+            seg->readPos = out;
+            seg->length = len;
+            seg->minQuality = lowest;
+            ++seg;
+            out += len;
+        }
+
+        if (type & BAM_CONSUME_REFERENCE)
+            refPos += len;
+        if (type & BAM_CONSUME_QUERY)
+            readPos += len;
+    }
+
+    return rv;
+}
+
+uint8_t* ReadSlab::allocate(size_t bytes, uint32_t& block) {
+    if (_current != NO_BLOCK) {
+        Block& b = _blocks[_current];
+        if (b.used + bytes <= b.capacity()) {
+            uint8_t* rv = reinterpret_cast<uint8_t*>(b.storage.data()) + b.used;
+            b.used += bytes;
+            ++b.live;
+            block = _current;
+            return rv;
+        }
+
+        // full; it is freed by remove() once its records are gone
+        if (b.live == 0)
+            _free.push_back(_current);
+        _current = NO_BLOCK;
+    }
+
+    if (_free.empty())
+        grow();
+    _current = _free.back();
+    _free.pop_back();
+
+    Block& b = _blocks[_current];
+    if (b.capacity() < bytes)
+        b.storage.resize((max<size_t>(_blockSize, bytes) + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+    b.used = bytes;
+    b.live = 1;
+    block = _current;
+    return reinterpret_cast<uint8_t*>(b.storage.data());
+}
+
+void ReadSlab::grow() {
+    size_t n = _blocks.size() * _blockSize < WARM_SIZE ? 1 : _blocks.size();
+    size_t first = _blocks.size();
+    _blocks.resize(first + n);
+    _free.reserve(_blocks.size());
+    // the first new block is handed out right away, and allocate() sizes
+    // it; the rest are sized now
+    for (size_t i = _blocks.size(); i-- > first;) {
+        Block& b = _blocks[i];
+        if (i != first)
+            b.storage.resize((_blockSize + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+        b.used = 0;
+        b.live = 0;
+        _free.push_back(uint32_t(i));
+    }
+}
+
+void ReadSlab::remove(PackedRead const* read) {
+    uint32_t i = read->_block;
+    Block& b = _blocks[i];
+    if (--b.live > 0)
+        return;
+
+    if (i == _current)
+        b.used = 0;
+    else
+        _free.push_back(i);
+}
+
+void ReadSlab::clear() {
+    _free.clear();
+    for (uint32_t i = 0; i < _blocks.size(); ++i) {
+        _blocks[i].used = 0;
+        _blocks[i].live = 0;
+        _free.push_back(i);
+    }
+    _current = NO_BLOCK;
+}
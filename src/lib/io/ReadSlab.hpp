@@ -0,0 +1,143 @@
+#pragma once
+
+#include "BamEntry.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A buffered read cut down to what piling up needs: where it aligns, its
+// aligned blocks, and the bases and qualities of those blocks. Names, aux
+// tags, clipped and inserted bases are not kept. Records live in a ReadSlab,
+// laid out as this header, the segments, the bases packed two to a byte as in
+// bam1_seq, then one quality byte per base.
+class PackedRead {
+public:
+    // a run of bases aligned to consecutive reference positions
+    struct Segment {
+        // reference offset from start()
+        uint32_t refOffset;
+        // offset of the first base in bases() and qualities()
+        uint32_t readPos;
+        uint32_t length;
+        // the lowest quality in the run, after masking
+        uint32_t minQuality;
+    };
+
+    int32_t tid() const {
+        return _tid;
+    }
+
+    int32_t start() const {
+        return _start;
+    }
+
+    uint32_t end() const {
+        return _end;
+    }
+
+    uint32_t nSegments() const {
+        return _nSegments;
+    }
+
+    Segment const* segments() const {
+        return reinterpret_cast<Segment const*>(this + 1);
+    }
+
+    // the number of aligned bases
+    uint32_t length() const {
+        return _length;
+    }
+
+    uint8_t const* bases() const {
+        return reinterpret_cast<uint8_t const*>(segments() + _nSegments);
+    }
+
+    uint8_t const* qualities() const {
+        return bases() + (_length + 1) / 2;
+    }
+
+    int base(uint32_t readPos) const {
+        return bam1_seqi(bases(), readPos);
+    }
+
+    PosCompare cmp(PackedRead const& rhs) const;
+
+protected:
+    friend class ReadSlab;
+
+    int32_t _tid;
+    int32_t _start;
+    uint32_t _end;
+    uint32_t _nSegments;
+    uint32_t _length;
+    // the slab block holding the record
+    uint32_t _block;
+};
+
+// Storage for PackedReads. Records are carved out of large blocks, each of
+// which counts the records still alive in it and is reused once they are all
+// removed. Since reads are added in order of start and mostly removed in the
+// same order, blocks come free soon after they fill up and, in steady state,
+// adding a read allocates nothing. A long read keeps its whole block alive.
+// Once it holds WARM_SIZE bytes, the slab doubles when it needs another
+// block, so that coverage somewhat deeper than any seen before doesn't
+// allocate again.
+class ReadSlab {
+public:
+    static uint32_t const DEFAULT_BLOCK_SIZE = 1 << 15;
+    static std::size_t const WARM_SIZE = 1 << 18;
+
+    explicit ReadSlab(uint32_t blockSize = DEFAULT_BLOCK_SIZE);
+
+    // copy the parts of entry that pileups use. qualities below minQual are
+    // set to 0.
+    PackedRead const* add(BamEntry const& entry, int minQual);
+    void remove(PackedRead const* read);
+    // remove every record, keeping the blocks
+    void clear();
+
+    // the number of blocks allocated so far
+    std::size_t blocks() const {
+        return _blocks.size();
+    }
+
+protected:
+    struct Block {
+        // uint64_t keeps the records aligned
+        std::vector<uint64_t> storage;
+        std::size_t used;
+        uint32_t live;
+
+        std::size_t capacity() const {
+            return storage.size() * sizeof(uint64_t);
+        }
+    };
+
+    // space for a record of bytes bytes, and the block it is in
+    uint8_t* allocate(std::size_t bytes, uint32_t& block);
+    // add blocks to the free list
+    void grow();
+
+protected:
+    uint32_t _blockSize;
+    std::vector<Block> _blocks;
+    // blocks with no live records, other than _current
+    std::vector<uint32_t> _free;
+    uint32_t _current;
+};
+
+inline
+PosCompare PackedRead::cmp(PackedRead const& rhs) const {
+    if (_tid < rhs._tid)
+        return BEFORE;
+    if (rhs._tid < _tid)
+        return AFTER;
+
+    if (_end <= uint32_t(rhs._start))
+        return BEFORE;
+    if (rhs._end <= uint32_t(_start))
+        return AFTER;
+
+    return OVERLAP;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Reference counted block of decoded bam data. Readers that hand out entries
+// pointing into their buffers (see MappedBamReader) keep one reference and
+// each live entry holds another; whoever drops the last one frees the
+// buffer. A reader may refill a buffer once it is the only holder.
+class RecordBuffer {
+public:
+    explicit RecordBuffer(std::size_t capacity)
+        : bytes_(capacity)
+        , refs_(1)
+    {
+    }
+
+    void ref() {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void unref() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete this;
+    }
+
+    // true when no entries point into the buffer any more
+    bool unique() const {
+        return refs_.load(std::memory_order_acquire) == 1;
+    }
+
+    uint8_t* data() {
+        return bytes_.empty() ? 0 : &bytes_[0];
+    }
+
+    std::size_t capacity() const {
+        return bytes_.size();
+    }
+
+    // only allowed while unique()
+    void reserve(std::size_t capacity) {
+        if (capacity > bytes_.size())
+            bytes_.resize(capacity);
+    }
+
+private:
+    ~RecordBuffer() {}
+
+private:
+    std::vector<uint8_t> bytes_;
+    std::atomic<uint32_t> refs_;
+};
@@ -0,0 +1,24 @@
+#include "RegionChunker.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+vector<Region> chunkRegions(vector<Region> const& regions, int32_t chunkSize) {
+    if (chunkSize <= 0)
+        throw invalid_argument("chunkRegions: chunk size must be positive");
+
+    vector<Region> rv;
+    for (auto i = regions.begin(); i != regions.end(); ++i) {
+        for (int32_t beg = i->beg; beg < i->end; ) {
+            Region r;
+            r.tid = i->tid;
+            r.beg = beg;
+            r.end = int32_t(min(int64_t(beg) + chunkSize, int64_t(i->end)));
+            rv.push_back(r);
+            beg = r.end;
+        }
+    }
+    return rv;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "BamReaderBase.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Split each region into consecutive pieces of at most chunkSize bases.
+// The output preserves the order of the input regions.
+std::vector<Region> chunkRegions(std::vector<Region> const& regions, int32_t chunkSize);
@@ -1,58 +1,198 @@
-#include "BamReaderBase.hpp"
+#pragma once
+
+#include "BamIndexChunks.hpp"
+#include "BamReader.hpp"
+#include "TargetRegions.hpp"
 
 #include <boost/format.hpp>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 class RegionLimitedBamReader : public BamReader {
 public:
-    RegionLimitedBamReader(std::string const& path, char const* region);
+    RegionLimitedBamReader(std::string const& path, char const* region, ThreadPool* inflatePool = 0);
+    RegionLimitedBamReader(std::string const& path, Region const& region, ThreadPool* inflatePool = 0);
     ~RegionLimitedBamReader();
 
     Region const* region() const;
 
+    // reposition the reader at the start of a new region. any entry
+    // buffered by peek() is discarded.
+    void setRegion(Region const& region);
+
+    // the index queries for all targets are coalesced into one list of
+    // chunks, which is walked with either bgzf stream
+    void setTargets(std::vector<Region> const& targets);
+
+    // skips within the region, which doesn't change. there is nothing to
+    // skip when reading targets: their chunks hold nothing else.
+    bool skipTo(int tid, int pos);
+
 protected:
+    // the index chunks are walked here the same way bam_iter_read does, but
+    // with records that fall outside the region or fail the filter passed
+    // over as soon as their core says so.
     bool takeImpl(bam1_t* entry);
+    void loadIndex();
+    void setChunks(std::vector<BgzfChunk>& chunks);
 
 protected:
     std::string regionString_;
     bam_index_t* index_;
-    bam_iter_t iter_;
     Region region_;
+
+    std::vector<BgzfChunk> chunks_;
+    std::size_t chunkIdx_;
+    bool finished_;
+
+    bool targeted_;
+    std::vector<Region> targets_;
+    RegionCursor targetCursor_;
 };
 
 inline
-RegionLimitedBamReader::RegionLimitedBamReader(std::string const& path, char const* region)
-    : BamReader(path)
-    , regionString_(region)
-    , index_(bam_index_load(path.c_str()))
+RegionLimitedBamReader::RegionLimitedBamReader(std::string const& path, char const* region, ThreadPool* inflatePool)
+    : BamReader(path, inflatePool)
+    , index_(0)
+    , chunkIdx_(0)
+    , finished_(true)
+    , targeted_(false)
 {
     using boost::format;
-    if (!index_)
-        throw std::runtime_error(str(format("Failed to load bam index for %1%") % path));
+    loadIndex();
 
-    if (bam_parse_region(header(), region, &region_.tid, &region_.beg, &region_.end) < 0) {
+    Region r;
+    if (bam_parse_region(header(), region, &r.tid, &r.beg, &r.end) < 0) {
         throw std::runtime_error(str(format(
             "Failed to parse bam region '%1%' in file %2%. ")
             % region % path));
     }
 
-    iter_ = bam_iter_query(index_, region_.tid, region_.beg, region_.end);
+    setRegion(r);
+}
+
+inline
+RegionLimitedBamReader::RegionLimitedBamReader(std::string const& path, Region const& region, ThreadPool* inflatePool)
+    : BamReader(path, inflatePool)
+    , index_(0)
+    , chunkIdx_(0)
+    , finished_(true)
+    , targeted_(false)
+{
+    loadIndex();
+    setRegion(region);
+}
+
+inline
+void RegionLimitedBamReader::loadIndex() {
+    using boost::format;
+    index_ = bam_index_load(path_.c_str());
+    if (!index_)
+        throw std::runtime_error(str(format("Failed to load bam index for %1%") % path_));
 }
 
 inline
 Region const* RegionLimitedBamReader::region() const {
-    return &region_;
+    return targeted_ ? 0 : &region_;
+}
+
+inline
+void RegionLimitedBamReader::setRegion(Region const& region) {
+    using boost::format;
+    if (region.tid < 0 || region.tid >= header()->n_targets) {
+        throw std::runtime_error(str(format(
+            "Invalid target id %1% for bam region in file %2%")
+            % region.tid % path_));
+    }
+
+    discardPeeked();
+    targeted_ = false;
+    region_ = region;
+    regionString_ = str(format("%1%:%2%-%3%")
+        % header()->target_name[region.tid] % (region.beg + 1) % region.end);
+
+    std::vector<BgzfChunk> chunks = bamIndexChunks(index_, region_.tid, region_.beg, region_.end);
+    setChunks(chunks);
+}
+
+inline
+void RegionLimitedBamReader::setChunks(std::vector<BgzfChunk>& chunks) {
+    chunks_.swap(chunks);
+    chunkIdx_ = 0;
+    finished_ = chunks_.empty();
+    if (!finished_)
+        seek(chunks_[0].beg);
+}
+
+inline
+void RegionLimitedBamReader::setTargets(std::vector<Region> const& targets) {
+    discardPeeked();
+    targeted_ = true;
+    targets_ = targets;
+    targetCursor_.reset(&targets_);
+
+    std::vector<BgzfChunk> chunks = bamIndexChunks(index_, targets_);
+    setChunks(chunks);
+}
+
+inline
+bool RegionLimitedBamReader::skipTo(int tid, int pos) {
+    if (targeted_ || tid != region_.tid || pos >= region_.end)
+        return false;
+
+    // never go back: that would read entries a second time
+    std::vector<BgzfChunk> chunks = bamIndexChunks(index_, tid, pos, region_.end);
+    if (!chunks.empty() && chunks[0].beg <= tell())
+        return false;
+
+    discardPeeked();
+    setChunks(chunks);
+    return true;
 }
 
 inline
 RegionLimitedBamReader::~RegionLimitedBamReader() {
-    bam_iter_destroy(iter_);
     bam_index_destroy(index_);
     index_ = 0;
 }
 
 inline
 bool RegionLimitedBamReader::takeImpl(bam1_t* entry) {
-    return bam_iter_read(BamReader::fp_->x.bam, iter_, entry) > 0;
+    while (!finished_) {
+        if (tell() >= chunks_[chunkIdx_].end) {
+            if (++chunkIdx_ == chunks_.size())
+                break;
+            // adjacent chunks need no seek
+            if (chunks_[chunkIdx_].beg != chunks_[chunkIdx_ - 1].end)
+                seek(chunks_[chunkIdx_].beg);
+        }
+
+        if (!readCore(entry))
+            break;
+
+        bam1_core_t const& c = entry->core;
+        if (!targeted_ && (c.tid != region_.tid || c.pos >= region_.end))
+            break; // past the region, no need to go on
+
+        if (!accepts(c)) {
+            skipData(entry);
+            continue;
+        }
+        readData(entry);
+
+        uint32_t end = c.n_cigar ? bam_calend(&c, bam1_cigar(entry)) : c.pos + 1;
+        if (targeted_) {
+            if (targetCursor_.overlaps(c.tid, c.pos, end))
+                return true;
+            if (targetCursor_.done())
+                break; // past the last target
+            continue;
+        }
+
+        if (end > uint32_t(region_.beg))
+            return true;
+    }
+    finished_ = true;
+    return false;
 }
@@ -1,13 +1,17 @@
 #include "SamConvert.hpp"
 #include "BamEntry.hpp"
 #include "BamReader.hpp"
+#include "utility/TempFile.hpp"
 
 #include <bam.h>
 
 #include <boost/format.hpp>
 
+#include <fstream>
 #include <stdexcept>
 
+#include <unistd.h>
+
 using boost::format;
 
 void samToIndexedBam(std::string const& samPath, std::string const& bamPath) {
@@ -20,7 +24,7 @@ void samToIndexedBam(std::string const& samPath, std::string const& bamPath) {
     }
     while (auto e = in.take()) {
         int rv = samwrite(fp, e->rawData());
-        delete e;
+        BamEntry::release(e);
         if (rv < 0) {
             throw std::runtime_error(str(format(
                 "Failed to write bam entry to %1%"
@@ -30,3 +34,24 @@ void samToIndexedBam(std::string const& samPath, std::string const& bamPath) {
     samclose(fp);
     bam_index_build(bamPath.c_str());
 }
+
+std::string makeIndexedBam(TempDir& dir, std::string const& sam) {
+    // not a TempFile, which would give the name back while the bam named
+    // after it is still there
+    std::string samPath = dir.subpath("sam.XXXXXX");
+    int fd = mkstemp(&samPath[0]);
+    if (fd < 0) {
+        throw std::runtime_error(str(format(
+            "Failed to create temporary file in %1%"
+            ) % dir.path()));
+    }
+    close(fd);
+    {
+        std::ofstream out(samPath.c_str());
+        out << sam;
+    }
+
+    std::string bamPath = samPath + ".bam";
+    samToIndexedBam(samPath, bamPath);
+    return bamPath;
+}
@@ -2,4 +2,11 @@
 
 #include <string>
 
+class TempDir;
+
 void samToIndexedBam(std::string const& samPath, std::string const& bamPath);
+
+// write sam text to a new file in dir, convert it to an indexed bam and
+// return the bam's path. the sam file stays beside it, at the same path less
+// the .bam. both go away with dir.
+std::string makeIndexedBam(TempDir& dir, std::string const& sam);
@@ -0,0 +1,43 @@
+#include "SiteSummary.hpp"
+
+#include <cstring>
+
+SiteSummary::SiteSummary()
+    : depth(0)
+    , supporting(0)
+    , qualified(0)
+{
+    memset(baseCounts, 0, sizeof(baseCounts));
+    memset(qualityHistogram, 0, sizeof(qualityHistogram));
+}
+
+void SiteSummary::summarize(Pileup const& pileup, int ref, int minQual) {
+    uint8_t const* bases = pileup.bases();
+    uint8_t const* qualities = pileup.qualities();
+    uint32_t n = pileup.size();
+
+    memset(qualityHistogram, 0, sizeof(qualityHistogram));
+    uint32_t a = 0, c = 0, g = 0, t = 0;
+    uint32_t matching = 0;
+    uint32_t passing = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t base = bases[i];
+        uint32_t pass = qualities[i] >= minQual;
+        // ambiguity codes count towards every base they allow
+        a += base & 1;
+        c += base >> 1 & 1;
+        g += base >> 2 & 1;
+        t += base >> 3 & 1;
+        matching += (int(base) == ref) & pass;
+        passing += pass;
+        qualityHistogram[qualities[i]] += pass;
+    }
+
+    depth = n;
+    supporting = matching;
+    qualified = passing;
+    baseCounts[0] = a;
+    baseCounts[1] = c;
+    baseCounts[2] = g;
+    baseCounts[3] = t;
+}
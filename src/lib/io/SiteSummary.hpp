@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Pileup.hpp"
+
+#include <cstdint>
+
+// Everything the model needs from one sample's pileup at a site, gathered in
+// a single pass over the column: base counts, the number of reads supporting
+// the reference and a histogram of the base qualities that pass the minimum.
+struct SiteSummary {
+    SiteSummary();
+
+    void summarize(Pileup const& pileup, int ref, int minQual);
+
+    // all reads at the site
+    uint32_t depth;
+    // reads with the reference base and a quality of at least minQual
+    uint32_t supporting;
+    // reads with a quality of at least minQual
+    uint32_t qualified;
+    int baseCounts[4];
+    // qualified reads by base quality
+    uint32_t qualityHistogram[256];
+};
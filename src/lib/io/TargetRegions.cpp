@@ -0,0 +1,129 @@
+#include "TargetRegions.hpp"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+// exported by libbam, but not declared in its headers
+extern "C" void bam_init_header_hash(bam_header_t* header);
+
+using boost::format;
+using namespace std;
+
+namespace {
+    bool startsBefore(Region const& a, Region const& b) {
+        return a.tid < b.tid || (a.tid == b.tid && a.beg < b.beg);
+    }
+
+    // orders regions against a position by where they end
+    bool endsAtOrBefore(Region const& r, pair<int, int> const& pos) {
+        return r.tid < pos.first || (r.tid == pos.first && r.end <= pos.second);
+    }
+}
+
+vector<Region> mergeRegions(vector<Region> regions) {
+    stable_sort(regions.begin(), regions.end(), startsBefore);
+
+    vector<Region> rv;
+    for (auto i = regions.begin(); i != regions.end(); ++i) {
+        if (i->end <= i->beg)
+            continue;
+        if (!rv.empty() && rv.back().tid == i->tid && i->beg <= rv.back().end)
+            rv.back().end = max(rv.back().end, i->end);
+        else
+            rv.push_back(*i);
+    }
+    return rv;
+}
+
+vector<Region> readBedRegions(istream& in, bam_header_t* header, string const& name) {
+    bam_init_header_hash(header);
+
+    vector<Region> rv;
+    string line;
+    for (size_t lineNo = 1; getline(in, line); ++lineNo) {
+        if (line.empty() || line[0] == '#'
+            || line.compare(0, 5, "track") == 0
+            || line.compare(0, 7, "browser") == 0)
+        {
+            continue;
+        }
+
+        istringstream fields(line);
+        string seq;
+        int64_t beg;
+        int64_t end;
+        if (!(fields >> seq >> beg >> end) || beg < 0 || end < beg || end > (1 << 29)) {
+            throw runtime_error(str(format(
+                "Invalid bed interval at line %1% of %2%: '%3%'")
+                % lineNo % name % line));
+        }
+
+        Region r;
+        r.tid = bam_get_tid(header, seq.c_str());
+        if (r.tid < 0) {
+            throw runtime_error(str(format(
+                "Unknown sequence '%1%' at line %2% of %3%")
+                % seq % lineNo % name));
+        }
+        r.beg = int(beg);
+        r.end = int(end);
+        rv.push_back(r);
+    }
+    return mergeRegions(rv);
+}
+
+vector<Region> readBedRegions(string const& path, bam_header_t* header) {
+    ifstream in(path.c_str());
+    if (!in)
+        throw runtime_error(str(format("Failed to open bed file %1%") % path));
+    return readBedRegions(in, header, path);
+}
+
+void maskOutsideRegions(
+        vector<Region> const& regions,
+        int tid,
+        uint32_t begin,
+        uint32_t end,
+        uint8_t* mask
+        )
+{
+    // the first region ending past begin
+    auto r = lower_bound(regions.begin(), regions.end(), make_pair(tid, int(begin)), endsAtOrBefore);
+
+    uint32_t pos = begin;
+    for (; pos < end && r != regions.end() && r->tid == tid; ++r) {
+        uint32_t inside = max<uint32_t>(pos, r->beg);
+        if (inside >= end)
+            break;
+        fill(mask + (pos - begin), mask + (inside - begin), 0);
+        pos = min<uint32_t>(end, r->end);
+    }
+    fill(mask + (pos - begin), mask + (end - begin), 0);
+}
+
+RegionCursor::RegionCursor()
+    : _regions(0)
+    , _idx(0)
+{
+}
+
+void RegionCursor::reset(vector<Region> const* regions) {
+    _regions = regions;
+    _idx = 0;
+}
+
+bool RegionCursor::overlaps(int tid, int beg, int end) {
+    if (!_regions)
+        return false;
+
+    vector<Region> const& r = *_regions;
+    while (_idx < r.size() && (r[_idx].tid < tid || (r[_idx].tid == tid && r[_idx].end <= beg)))
+        ++_idx;
+
+    // later regions start later still
+    return _idx < r.size() && r[_idx].tid == tid && r[_idx].beg < end;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "BamReaderBase.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+// Sort regions by sequence and start, and merge those that overlap or abut.
+// Empty regions are dropped.
+std::vector<Region> mergeRegions(std::vector<Region> regions);
+
+// Read the intervals of a bed file (0 based, end exclusive), naming their
+// sequences as in header, and merge them. name identifies the input in error
+// messages. track, browser and comment lines are skipped.
+std::vector<Region> readBedRegions(std::istream& in, bam_header_t* header, std::string const& name);
+std::vector<Region> readBedRegions(std::string const& path, bam_header_t* header);
+
+// Zero mask[i] for each position begin + i of sequence tid in [begin, end)
+// that is outside all of regions, which must be merged.
+void maskOutsideRegions(
+    std::vector<Region> const& regions,
+    int tid,
+    uint32_t begin,
+    uint32_t end,
+    uint8_t* mask
+    );
+
+// Follows a merged list of regions along a stream of intervals sorted by
+// sequence and start, like the entries of a sorted bam.
+class RegionCursor {
+public:
+    RegionCursor();
+
+    void reset(std::vector<Region> const* regions);
+
+    // whether [beg, end) on sequence tid overlaps any of the regions. calls
+    // must come in order of tid, then beg.
+    bool overlaps(int tid, int beg, int end);
+
+    // true once the intervals have gone past the last region
+    bool done() const {
+        return !_regions || _idx == _regions->size();
+    }
+
+private:
+    std::vector<Region> const* _regions;
+    std::size_t _idx;
+};
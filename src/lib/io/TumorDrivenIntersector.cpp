@@ -0,0 +1,170 @@
+#include "TumorDrivenIntersector.hpp"
+#include "TargetRegions.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+uint32_t const TumorDrivenIntersector::COALESCE_GAP;
+
+TumorDrivenIntersector::TumorDrivenIntersector(
+        BamReaderBase& readerN,
+        BamReaderBase& readerT,
+        callback_t cb,
+        reference_t reference,
+        int minQual
+        )
+    : _readerN(readerN)
+    , _readerT(readerT)
+    , _cb(cb)
+    , _reference(reference)
+    , _minQual(minQual)
+    , _minNormalDepth(1)
+    , _minTumorDepth(1)
+    , _tid(0)
+    , _pos(0)
+    , _region(readerT.region())
+    , _window(PileupWindow::DEFAULT_WIDTH)
+    , _normalQueries(0)
+    , _targets(0)
+{
+    _pn.setMinQuality(minQual);
+    _pt.setMinQuality(minQual);
+}
+
+void TumorDrivenIntersector::setMinDepth(uint32_t normal, uint32_t tumor) {
+    _minNormalDepth = max(normal, 1u);
+    _minTumorDepth = max(tumor, 1u);
+}
+
+void TumorDrivenIntersector::setTargets(vector<Region> const& targets) {
+    _targets = &targets;
+}
+
+void TumorDrivenIntersector::run() {
+    _pt.push(_readerT.take());
+
+    try {
+        while (!_pt.empty()) {
+            doPileup();
+            if (_pt.empty()) _pt.push(_readerT.take());
+        }
+    } catch (...) {
+        cerr << "Error:\n";
+        cerr << "Tumor pileup buffer position: #" << _pt.tid() << ", pos " << _pt.start() << " -> " << _pt.end() << "\n";
+        throw;
+    }
+}
+
+void TumorDrivenIntersector::doPileup() {
+    while (_pt.push(_readerT.peek())) _readerT.take();
+
+    if (_tid != _pt.tid()) // new chromosome, reset _pos
+        _pos = 0;
+    _tid = _pt.tid();
+
+    _pos = max(_pt.start(), _pos);
+    uint32_t end = _pt.front()->end();
+
+    if (_region) {
+        _pos = max(int(_region->beg), _pos);
+        end = min(unsigned(_region->end), end);
+        if (_pos >= _region->end) {
+            _pt.clear();
+            return;
+        }
+    }
+
+    // as in BamIntersector, go on past the end of the first read to fill a
+    // whole window
+    uint32_t limit = _pos + _window;
+    if (_region)
+        limit = min(unsigned(_region->end), limit);
+    if (limit > end) {
+        while (_pt.pushBefore(_readerT.peek(), limit)) _readerT.take();
+        end = limit;
+    }
+
+    while (uint32_t(_pos) < end) {
+        uint32_t stop = min(end, _pos + _window);
+        doWindow(_pos, stop);
+        _pos = stop;
+    }
+    _pt.clearBefore(_pt.tid(), _pos);
+}
+
+void TumorDrivenIntersector::doWindow(uint32_t begin, uint32_t end) {
+    uint32_t columns = end - begin;
+    _candidates.assign(columns, 0);
+    _ref.resize(columns);
+
+    _wt.collect(_pt, begin, end);
+    uint32_t refLen = _reference(_tid, begin, end, _ref.data());
+    _wt.markCandidates(_ref.data(), refLen, _minQual, _candidates.data());
+
+    // too few tumor reads span the position to call it
+    _pt.countSpans(begin, end, _spanT);
+    int32_t depth = 0;
+    for (uint32_t c = 0; c < columns; ++c) {
+        depth += _spanT[c];
+        _candidates[c] &= uint32_t(depth) >= _minTumorDepth;
+    }
+    if (_targets)
+        maskOutsideRegions(*_targets, _tid, begin, end, _candidates.data());
+
+    uint32_t c = find(_candidates.begin(), _candidates.end(), 1) - _candidates.begin();
+    if (c == columns)
+        return;
+
+    _wt.build(_candidates.data());
+
+    // runs of candidates no more than COALESCE_GAP apart
+    while (c < columns) {
+        uint32_t last = c;
+        uint32_t next = c + 1;
+        for (; next < columns && next - last <= COALESCE_GAP; ++next) {
+            if (_candidates[next])
+                last = next;
+        }
+        callRange(begin, begin + c, begin + last + 1);
+
+        c = last + 1;
+        while (c < columns && !_candidates[c])
+            ++c;
+    }
+}
+
+void TumorDrivenIntersector::callRange(uint32_t windowBegin, uint32_t begin, uint32_t end) {
+    Region r;
+    r.tid = _tid;
+    r.beg = begin;
+    r.end = end;
+    _readerN.setRegion(r);
+    ++_normalQueries;
+
+    // the index query gives back every read overlapping the range, sorted
+    // by start
+    _pn.push(_readerN.take());
+    while (BamEntry* e = _readerN.take()) {
+        if (!_pn.pushBefore(e, end))
+            BamEntry::release(e);
+    }
+
+    uint8_t const* mask = _candidates.data() + (begin - windowBegin);
+    _wn.collect(_pn, begin, end);
+    _wn.build(mask);
+
+    for (uint32_t pos = begin; pos < end; ++pos) {
+        if (!mask[pos - begin])
+            continue;
+        Pileup const& normal = _wn.column(pos);
+        Pileup const& tumor = _wt.column(pos);
+        if (normal.size() >= _minNormalDepth && tumor.size() >= _minTumorDepth) {
+            _wn.setDropped(_readerN.droppedAt(_tid, pos));
+            _wt.setDropped(_readerT.droppedAt(_tid, pos));
+            _cb(pos, normal, tumor);
+        }
+    }
+    _pn.clear();
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "BamIntersector.hpp"
+#include "BamReaderBase.hpp"
+#include "Pileup.hpp"
+#include "PileupBuffer.hpp"
+#include "PileupWindow.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Like BamIntersector, but only the tumor bam is read from start to end.
+// Positions where a tumor read differs from the reference (or has a base
+// quality below minQual) are candidates, and the normal reads are fetched
+// through the normal bam's index for just those. Candidates close to each
+// other share an index query. Sites where only the normal reads differ from
+// the reference are never looked at. The normal reader must support
+// setRegion().
+class TumorDrivenIntersector {
+public:
+    typedef BamIntersector::callback_t callback_t;
+    typedef BamIntersector::reference_t reference_t;
+
+    // candidates at most this far apart are fetched with one query
+    static uint32_t const COALESCE_GAP = 512;
+
+    TumorDrivenIntersector(
+        BamReaderBase& readerN,
+        BamReaderBase& readerT,
+        callback_t cb,
+        reference_t reference,
+        int minQual
+        );
+
+    // see BamIntersector::setMinDepth
+    void setMinDepth(uint32_t normal, uint32_t tumor);
+
+    // see BamIntersector::setTargets. the tumor reader is the one to limit
+    // to the targets; the normal one is repositioned for each query.
+    void setTargets(std::vector<Region> const& targets);
+
+    void run();
+    void doPileup();
+
+    // number of index queries made on the normal bam
+    uint64_t normalQueries() const {
+        return _normalQueries;
+    }
+
+protected:
+    // find the candidates in [begin, end) and call them
+    void doWindow(uint32_t begin, uint32_t end);
+    // fetch the normal reads for the candidates in [begin, end) and make
+    // the callbacks
+    void callRange(uint32_t windowBegin, uint32_t begin, uint32_t end);
+
+protected:
+    BamReaderBase& _readerN;
+    BamReaderBase& _readerT;
+    callback_t _cb;
+    reference_t _reference;
+    int _minQual;
+    uint32_t _minNormalDepth;
+    uint32_t _minTumorDepth;
+    int _tid;
+    int32_t _pos;
+    Region const* _region;
+    uint32_t _window;
+    uint64_t _normalQueries;
+    std::vector<Region> const* _targets;
+
+    PileupBuffer _pn;
+    PileupBuffer _pt;
+    PileupWindow _wn;
+    PileupWindow _wt;
+
+    std::vector<uint8_t> _ref;
+    std::vector<uint8_t> _candidates;
+    std::vector<int32_t> _spanT;
+};
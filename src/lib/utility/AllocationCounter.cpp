@@ -0,0 +1,64 @@
+#include "AllocationCounter.hpp"
+
+#ifdef BASSOVAC_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    std::atomic<uint64_t> allocations(0);
+
+    void* countedAlloc(std::size_t size) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        if (void* rv = std::malloc(size ? size : 1))
+            return rv;
+        throw std::bad_alloc();
+    }
+}
+
+// replacing these in the same translation unit as count() ensures they are
+// linked into any program that reports the count
+void* operator new(std::size_t size) {
+    return countedAlloc(size);
+}
+
+void* operator new[](std::size_t size) {
+    return countedAlloc(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+bool AllocationCounter::enabled() {
+    return true;
+}
+
+uint64_t AllocationCounter::count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool AllocationCounter::enabled() {
+    return false;
+}
+
+uint64_t AllocationCounter::count() {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts heap allocations made through operator new, for checking that hot
+// paths don't allocate. Counting is only compiled in when the build is
+// configured with -DCOUNT_ALLOCATIONS=ON; otherwise count() is always 0.
+namespace AllocationCounter {
+    bool enabled();
+    // allocations made by all threads since the program started
+    uint64_t count();
+}
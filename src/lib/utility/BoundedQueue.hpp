@@ -0,0 +1,201 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Occupancy counters for a BoundedQueue. Every push records how many items
+// were already waiting, so a queue that is usually full points at a slow
+// consumer and one that is usually empty at a slow producer.
+struct QueueStats {
+    QueueStats()
+        : capacity(0)
+        , pushes(0)
+        , occupancySum(0)
+        , maxOccupancy(0)
+        , fullWaits(0)
+        , emptyWaits(0)
+    {}
+
+    double meanOccupancy() const {
+        return pushes ? occupancySum / double(pushes) : 0.0;
+    }
+
+    std::size_t capacity;
+    uint64_t pushes;
+    uint64_t occupancySum;
+    std::size_t maxOccupancy;
+    // number of times the producer found the queue full / the consumer
+    // found it empty and had to wait
+    uint64_t fullWaits;
+    uint64_t emptyWaits;
+};
+
+// Lock free single producer, single consumer ring buffer of fixed capacity.
+// push() and pop() block (spinning, then sleeping) when the queue is full or
+// empty. The producer calls close() after its last push; the consumer can
+// cancel() to make a blocked producer give up.
+template<typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(std::size_t capacity);
+
+    // return false if the item could not be queued (full, or cancelled)
+    bool tryPush(T& item);
+    bool push(T& item);
+
+    // return false if there is nothing to pop right now / ever again
+    bool tryPop(T& item);
+    bool pop(T& item);
+
+    void close();
+    void cancel();
+
+    std::size_t size() const;
+    std::size_t capacity() const {
+        return _slots.size() - 1;
+    }
+
+    QueueStats stats() const;
+
+private:
+    static void backoff(unsigned& spins);
+
+private:
+    std::vector<T> _slots;
+    std::atomic<std::size_t> _head; // next slot to pop, owned by consumer
+    std::atomic<std::size_t> _tail; // next slot to fill, owned by producer
+    std::atomic<bool> _closed;
+    std::atomic<bool> _cancelled;
+
+    std::atomic<uint64_t> _pushes;
+    std::atomic<uint64_t> _occupancySum;
+    std::atomic<std::size_t> _maxOccupancy;
+    std::atomic<uint64_t> _fullWaits;
+    std::atomic<uint64_t> _emptyWaits;
+};
+
+template<typename T>
+inline
+BoundedQueue<T>::BoundedQueue(std::size_t capacity)
+    : _slots(capacity + 1)
+    , _head(0)
+    , _tail(0)
+    , _closed(false)
+    , _cancelled(false)
+    , _pushes(0)
+    , _occupancySum(0)
+    , _maxOccupancy(0)
+    , _fullWaits(0)
+    , _emptyWaits(0)
+{
+}
+
+template<typename T>
+inline
+void BoundedQueue<T>::backoff(unsigned& spins) {
+    if (++spins < 64)
+        std::this_thread::yield();
+    else
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+template<typename T>
+inline
+bool BoundedQueue<T>::tryPush(T& item) {
+    std::size_t tail = _tail.load(std::memory_order_relaxed);
+    std::size_t next = tail + 1 == _slots.size() ? 0 : tail + 1;
+    std::size_t head = _head.load(std::memory_order_acquire);
+    if (next == head || _cancelled.load(std::memory_order_relaxed))
+        return false;
+
+    std::size_t occupied = tail >= head ? tail - head : tail + _slots.size() - head;
+    _pushes.fetch_add(1, std::memory_order_relaxed);
+    _occupancySum.fetch_add(occupied, std::memory_order_relaxed);
+    if (occupied > _maxOccupancy.load(std::memory_order_relaxed))
+        _maxOccupancy.store(occupied, std::memory_order_relaxed);
+
+    _slots[tail] = std::move(item);
+    _tail.store(next, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+inline
+bool BoundedQueue<T>::push(T& item) {
+    unsigned spins = 0;
+    while (!tryPush(item)) {
+        if (_cancelled.load(std::memory_order_acquire))
+            return false;
+        if (spins == 0)
+            _fullWaits.fetch_add(1, std::memory_order_relaxed);
+        backoff(spins);
+    }
+    return true;
+}
+
+template<typename T>
+inline
+bool BoundedQueue<T>::tryPop(T& item) {
+    std::size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire))
+        return false;
+
+    item = std::move(_slots[head]);
+    _head.store(head + 1 == _slots.size() ? 0 : head + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename T>
+inline
+bool BoundedQueue<T>::pop(T& item) {
+    unsigned spins = 0;
+    while (!tryPop(item)) {
+        if (_cancelled.load(std::memory_order_acquire))
+            return false;
+        // the producer may have pushed its last item just before closing
+        if (_closed.load(std::memory_order_acquire))
+            return tryPop(item);
+        if (spins == 0)
+            _emptyWaits.fetch_add(1, std::memory_order_relaxed);
+        backoff(spins);
+    }
+    return true;
+}
+
+template<typename T>
+inline
+void BoundedQueue<T>::close() {
+    _closed.store(true, std::memory_order_release);
+}
+
+template<typename T>
+inline
+void BoundedQueue<T>::cancel() {
+    _cancelled.store(true, std::memory_order_release);
+}
+
+template<typename T>
+inline
+std::size_t BoundedQueue<T>::size() const {
+    std::size_t head = _head.load(std::memory_order_acquire);
+    std::size_t tail = _tail.load(std::memory_order_acquire);
+    return tail >= head ? tail - head : tail + _slots.size() - head;
+}
+
+template<typename T>
+inline
+QueueStats BoundedQueue<T>::stats() const {
+    QueueStats rv;
+    rv.capacity = capacity();
+    rv.pushes = _pushes.load(std::memory_order_relaxed);
+    rv.occupancySum = _occupancySum.load(std::memory_order_relaxed);
+    rv.maxOccupancy = _maxOccupancy.load(std::memory_order_relaxed);
+    rv.fullWaits = _fullWaits.load(std::memory_order_relaxed);
+    rv.emptyWaits = _emptyWaits.load(std::memory_order_relaxed);
+    return rv;
+}
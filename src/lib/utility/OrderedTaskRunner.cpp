@@ -0,0 +1,97 @@
+#include "OrderedTaskRunner.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+OrderedTaskRunner::OrderedTaskRunner(uint32_t nThreads, uint32_t maxPending)
+    : _nThreads(max(nThreads, 1u))
+    , _maxPending(max(maxPending, _nThreads))
+{
+}
+
+void OrderedTaskRunner::run(size_t nTasks, task_t const& task, sink_t const& sink) {
+    mutex m;
+    condition_variable cv;
+    size_t nextTask = 0;
+    size_t nextOut = 0;
+    vector<string> results(nTasks);
+    vector<char> done(nTasks, 0);
+    exception_ptr error;
+    bool abort = false;
+
+    auto fail = [&]() {
+        lock_guard<mutex> lock(m);
+        if (!error)
+            error = current_exception();
+        abort = true;
+    };
+
+    auto worker = [&](uint32_t id) {
+        for (;;) {
+            size_t idx;
+            {
+                unique_lock<mutex> lock(m);
+                cv.wait(lock, [&]() {
+                    return abort || nextTask >= nTasks || nextTask < nextOut + _maxPending;
+                });
+                if (abort || nextTask >= nTasks)
+                    return;
+                idx = nextTask++;
+            }
+
+            string out;
+            try {
+                task(id, idx, out);
+            } catch (...) {
+                fail();
+                cv.notify_all();
+                return;
+            }
+
+            {
+                lock_guard<mutex> lock(m);
+                results[idx].swap(out);
+                done[idx] = 1;
+            }
+            cv.notify_all();
+        }
+    };
+
+    vector<thread> threads;
+    for (uint32_t i = 0; i < _nThreads; ++i)
+        threads.push_back(thread(worker, i));
+
+    for (;;) {
+        string out;
+        {
+            unique_lock<mutex> lock(m);
+            cv.wait(lock, [&]() {
+                return abort || nextOut >= nTasks || done[nextOut];
+            });
+            if (abort || nextOut >= nTasks)
+                break;
+            out.swap(results[nextOut++]);
+        }
+        cv.notify_all();
+
+        try {
+            sink(out);
+        } catch (...) {
+            fail();
+            cv.notify_all();
+            break;
+        }
+    }
+
+    for (auto i = threads.begin(); i != threads.end(); ++i)
+        i->join();
+
+    if (error)
+        rethrow_exception(error);
+}
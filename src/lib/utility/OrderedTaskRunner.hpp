@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Runs a numbered set of tasks on a pool of worker threads. Each task renders
+// its output into a string, and the strings are handed to the sink strictly
+// in task order as soon as all earlier tasks have finished. The sink sees the
+// same stream a sequential loop over the tasks would have produced.
+class OrderedTaskRunner {
+public:
+    // task(worker, taskIndex, output). worker is in [0, nThreads) and never
+    // runs two tasks at once, so it can be used to index per-thread state.
+    typedef std::function<void(uint32_t, std::size_t, std::string&)> task_t;
+    typedef std::function<void(std::string const&)> sink_t;
+
+    // at most maxPending tasks are allowed to run ahead of the sink. this
+    // bounds the memory held by finished results that can't be written yet.
+    OrderedTaskRunner(uint32_t nThreads, uint32_t maxPending);
+
+    // the first exception thrown by a task or the sink stops the run and is
+    // rethrown here once all workers have finished.
+    void run(std::size_t nTasks, task_t const& task, sink_t const& sink);
+
+    uint32_t threads() const {
+        return _nThreads;
+    }
+
+private:
+    uint32_t _nThreads;
+    uint32_t _maxPending;
+};
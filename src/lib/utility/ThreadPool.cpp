@@ -0,0 +1,50 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+using namespace std;
+
+ThreadPool::ThreadPool(uint32_t nThreads)
+    : _stop(false)
+{
+    nThreads = max(nThreads, 1u);
+    for (uint32_t i = 0; i < nThreads; ++i)
+        _threads.push_back(thread(&ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cv.notify_all();
+    for (auto i = _threads.begin(); i != _threads.end(); ++i)
+        i->join();
+}
+
+future<void> ThreadPool::submit(function<void()> job) {
+    packaged_task<void()> task(move(job));
+    future<void> rv = task.get_future();
+    {
+        lock_guard<mutex> lock(_mutex);
+        _jobs.push_back(move(task));
+    }
+    _cv.notify_one();
+    return rv;
+}
+
+void ThreadPool::work() {
+    for (;;) {
+        packaged_task<void()> task;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _cv.wait(lock, [this]() { return _stop || !_jobs.empty(); });
+            if (_jobs.empty())
+                return;
+            task = move(_jobs.front());
+            _jobs.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads running jobs in submission order. A pool can
+// be shared by any number of clients; each waits on the futures of its own
+// jobs. Exceptions thrown by a job are delivered through its future.
+class ThreadPool {
+public:
+    explicit ThreadPool(uint32_t nThreads);
+    // waits for queued jobs to finish
+    ~ThreadPool();
+
+    std::future<void> submit(std::function<void()> job);
+
+    uint32_t threads() const {
+        return _threads.size();
+    }
+
+private:
+    void work();
+
+private:
+    std::vector<std::thread> _threads;
+    std::deque<std::packaged_task<void()>> _jobs;
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stop;
+};
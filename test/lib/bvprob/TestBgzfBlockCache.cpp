@@ -0,0 +1,238 @@
+#include "bvprob/BgzfBlockCache.hpp"
+#include "bvprob/Fasta.hpp"
+#include "utility/TempFile.hpp"
+
+#include <bgzf.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    string readFile(string const& path) {
+        ifstream in(path.c_str(), ios::binary);
+        return string((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    }
+
+    string fastaText(size_t nSeqs, size_t len) {
+        stringstream ss;
+        for (size_t i = 0; i < nSeqs; ++i) {
+            ss << ">" << i + 1 << "\n";
+            for (size_t pos = 0; pos < len; ++pos) {
+                ss << "ACGTNacgt"[(pos * 7 + i + pos / 11) % 9];
+                if (pos % 60 == 59 || pos + 1 == len)
+                    ss << "\n";
+            }
+        }
+        return ss.str();
+    }
+}
+
+class TestBgzfBlockCache : public testing::Test {
+public:
+    // bgzip text to path in blocks of blockSize bytes, and write its .gzi to
+    // path.gzi as bgzip -i does
+    void bgzip(string const& path, string const& text, size_t blockSize) {
+        BGZF* fp = bgzf_open(path.c_str(), "w");
+        ASSERT_TRUE(fp != 0);
+        vector<uint64_t> index;
+        for (size_t pos = 0; pos < text.size(); pos += blockSize) {
+            if (pos) {
+                index.push_back(bgzf_tell(fp) >> 16);
+                index.push_back(pos);
+            }
+            size_t n = min(blockSize, text.size() - pos);
+            ASSERT_EQ(ssize_t(n), bgzf_write(fp, text.data() + pos, n));
+            ASSERT_EQ(0, bgzf_flush(fp));
+        }
+        ASSERT_EQ(0, bgzf_close(fp));
+
+        ofstream gzi((path + ".gzi").c_str(), ios::binary);
+        uint64_t count = index.size() / 2;
+        gzi.write(reinterpret_cast<char const*>(&count), sizeof(count));
+        gzi.write(reinterpret_cast<char const*>(index.data()), index.size() * sizeof(uint64_t));
+    }
+
+    void SetUp() {
+        for (size_t i = 0; i < 10000; ++i)
+            text += char('a' + (i * 7 + i / 13) % 26);
+        path = tmpdir.path() + "/text.gz";
+        bgzip(path, text, 333);
+        compressed = readFile(path);
+    }
+
+protected:
+    TempDir tmpdir;
+    string text;
+    string path;
+    string compressed;
+};
+
+TEST_F(TestBgzfBlockCache, read) {
+    BgzfBlockCache scanned(compressed.data(), compressed.size(), path, "");
+    BgzfBlockCache indexed(compressed.data(), compressed.size(), path, path + ".gzi");
+    EXPECT_EQ(text.size(), scanned.size());
+    EXPECT_EQ(text.size(), indexed.size());
+    // the end of file marker is not counted
+    EXPECT_EQ((text.size() + 332) / 333, scanned.blockCount());
+    EXPECT_EQ(scanned.blockCount(), indexed.blockCount());
+
+    BgzfBlockCache* caches[] = {&scanned, &indexed};
+    for (size_t c = 0; c < 2; ++c) {
+        BgzfBlockCache& cache = *caches[c];
+        vector<char> buf(text.size());
+        for (size_t begin = 0; begin < text.size(); begin += 97) {
+            for (size_t len = 0; begin + len <= text.size() && len < 1500; len += 1 + len) {
+                cache.read(begin, len, buf.data());
+                ASSERT_EQ(text.substr(begin, len), string(buf.data(), len)) << begin << "+" << len;
+            }
+        }
+
+        auto b = cache.block(666);
+        ASSERT_TRUE(b != 0);
+        EXPECT_EQ(666u, b->begin);
+        EXPECT_EQ(text.substr(666, 333), string(b->data.begin(), b->data.end()));
+        EXPECT_TRUE(cache.block(text.size()) == 0);
+
+        EXPECT_THROW(cache.read(text.size() - 1, 2, buf.data()), runtime_error);
+        EXPECT_NO_THROW(cache.read(text.size(), 0, buf.data()));
+    }
+}
+
+TEST_F(TestBgzfBlockCache, evictsLeastRecentlyUsed) {
+    BgzfBlockCache cache(compressed.data(), compressed.size(), path, "", 4);
+    vector<char> buf(text.size());
+    cache.read(0, text.size(), buf.data());
+    EXPECT_EQ(text, string(buf.begin(), buf.end()));
+    EXPECT_EQ(4u, cache.cached());
+    EXPECT_EQ(cache.blockCount(), cache.inflated());
+
+    // the last blocks are still there, the first is not
+    uint64_t inflated = cache.inflated();
+    cache.block(text.size() - 1);
+    cache.block(text.size() - 1 - 333 * 3);
+    EXPECT_EQ(inflated, cache.inflated());
+    auto held = cache.block(0);
+    EXPECT_EQ(inflated + 1, cache.inflated());
+    EXPECT_EQ(4u, cache.cached());
+
+    // blocks stay valid while held
+    for (size_t pos = 333; pos < text.size(); pos += 333)
+        cache.block(pos);
+    EXPECT_EQ(text.substr(0, 333), string(held->data.begin(), held->data.end()));
+}
+
+TEST_F(TestBgzfBlockCache, threads) {
+    BgzfBlockCache cache(compressed.data(), compressed.size(), path, "", 2);
+    vector<int> ok(4, 0);
+    vector<thread> threads;
+    for (size_t t = 0; t < ok.size(); ++t) {
+        threads.push_back(thread([&, t]() {
+            vector<char> buf(1000);
+            int& rv = ok[t];
+            rv = 1;
+            for (size_t i = 0; i < 500; ++i) {
+                size_t begin = (i * 7919 + t * 104729) % (text.size() - buf.size());
+                cache.read(begin, buf.size(), buf.data());
+                if (text.compare(begin, buf.size(), buf.data(), buf.size()) != 0)
+                    rv = 0;
+            }
+        }));
+    }
+    for (auto i = threads.begin(); i != threads.end(); ++i)
+        i->join();
+    for (size_t t = 0; t < ok.size(); ++t)
+        EXPECT_EQ(1, ok[t]) << t;
+    EXPECT_LE(cache.cached(), 2u);
+}
+
+TEST_F(TestBgzfBlockCache, rejectsInvalidData) {
+    // gzip without the bgzf extra field
+    string const gzip("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03\x03\x00\x00\x00\x00\x00\x00\x00\x00\x00", 20);
+    EXPECT_THROW(BgzfBlockCache(gzip.data(), gzip.size(), "plain.gz", ""), runtime_error);
+
+    string truncated = compressed.substr(0, compressed.size() - 30);
+    EXPECT_THROW(BgzfBlockCache(truncated.data(), truncated.size(), path, ""), runtime_error);
+    EXPECT_THROW(BgzfBlockCache(truncated.data(), truncated.size(), path, path + ".gzi"), runtime_error);
+
+    auto badIndex = tmpdir.tempFile(string(4, '\0'));
+    EXPECT_THROW(BgzfBlockCache(compressed.data(), compressed.size(), path, badIndex->path()), runtime_error);
+}
+
+TEST_F(TestBgzfBlockCache, fasta) {
+    string const fa = fastaText(3, 2000);
+    Fasta plain("mem", fa.data(), fa.size());
+
+    for (int withIndex = 0; withIndex < 2; ++withIndex) {
+        SCOPED_TRACE(withIndex);
+        string faPath = str(boost::format("%1%/ref%2%.fa.gz") % tmpdir.path() % withIndex);
+        bgzip(faPath, fa, 1000);
+        if (!withIndex)
+            boost::filesystem::remove(faPath + ".gzi");
+
+        Fasta fasta(faPath);
+        EXPECT_TRUE(boost::filesystem::exists(faPath + ".fai"));
+        EXPECT_EQ(plain.sequenceNames(), fasta.sequenceNames());
+
+        for (int pass = 0; pass < 2; ++pass) {
+            // the second time the .fai is read
+            Fasta f(faPath);
+            vector<string> const& names = plain.sequenceNames();
+            for (auto name = names.begin(); name != names.end(); ++name) {
+                Fasta::Contig expected = plain.contig(*name);
+                Fasta::Contig c = f.contig(*name);
+                ASSERT_TRUE(c.valid());
+                ASSERT_EQ(expected.length(), c.length());
+                for (size_t pos = 0; pos <= c.length(); ++pos)
+                    ASSERT_EQ(expected.base(pos), c.base(pos)) << *name << ":" << pos;
+
+                vector<char> want(c.length()), got(c.length());
+                for (size_t begin = 0; begin < c.length(); begin += 131) {
+                    size_t end = begin + 1 + begin * 3 % 1700;
+                    size_t n = expected.bases(begin, end, want.data());
+                    ASSERT_EQ(n, c.bases(begin, end, got.data()));
+                    ASSERT_EQ(string(want.data(), n), string(got.data(), n)) << begin << "-" << end;
+                }
+            }
+            EXPECT_EQ(plain.sequence("2", 100, 500), f.sequence("2", 100, 500));
+        }
+    }
+}
+
+TEST_F(TestBgzfBlockCache, fastaIndex) {
+    // windows line endings, comments, uneven last lines and blank lines, with
+    // blocks small enough for names and line ends to straddle them
+    string fa = fastaText(4, 1234);
+    fa += ">5 a comment\r\nACGTACGT\r\nACGTACGT\r\nAC\r\n\r\n>6\nNNNN\n";
+    auto plainFile = tmpdir.tempFile(fa);
+    Fasta plain(plainFile->path());
+    string const expected = readFile(plainFile->path() + ".fai");
+    ASSERT_FALSE(expected.empty());
+
+    size_t const blockSizes[] = {7, 61, 1000, 65280};
+    for (size_t i = 0; i < sizeof(blockSizes) / sizeof(blockSizes[0]); ++i) {
+        SCOPED_TRACE(blockSizes[i]);
+        string faPath = str(boost::format("%1%/index%2%.fa.gz") % tmpdir.path() % i);
+        bgzip(faPath, fa, blockSizes[i]);
+
+        Fasta fasta(faPath);
+        EXPECT_EQ(expected, readFile(faPath + ".fai"));
+        EXPECT_EQ(plain.sequenceNames(), fasta.sequenceNames());
+        EXPECT_EQ(plain.sequence("5", 1, 18), fasta.sequence("5", 1, 18));
+        EXPECT_EQ(plain.sequence("6", 1, 4), fasta.sequence("6", 1, 4));
+    }
+
+    // errors are the same as for plain text
+    string faPath = tmpdir.path() + "/uneven.fa.gz";
+    bgzip(faPath, ">1\nACGT\nAC\nACGT\n", 5);
+    EXPECT_THROW(Fasta fasta(faPath), runtime_error);
+}
@@ -0,0 +1,77 @@
+#include "bvprob/Fasta.hpp"
+#include "bvprob/UnknownSequenceError.hpp"
+#include "utility/TempFile.hpp"
+
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+namespace {
+    // uneven last lines, and windows line endings on the second sequence
+    string const data =
+        ">1 the first\n"
+        "ACGTA\n"
+        "CCGTT\n"
+        "GGN\n"
+        ">2\r\n"
+        "TTTT\r\n"
+        "ACGT\r\n"
+        "a\r\n";
+}
+
+class TestFasta : public testing::Test {
+public:
+    TempDir tmpdir;
+};
+
+TEST_F(TestFasta, contigBases) {
+    auto file = tmpdir.tempFile(data);
+    Fasta fasta(file->path());
+
+    Fasta::Contig c1 = fasta.contig("1");
+    Fasta::Contig c2 = fasta.contig("2");
+    ASSERT_TRUE(c1.valid());
+    ASSERT_TRUE(c2.valid());
+    EXPECT_EQ(13u, c1.length());
+    EXPECT_EQ(9u, c2.length());
+
+    string const s1 = "ACGTACCGTTGGN";
+    string const s2 = "TTTTACGTa";
+    for (size_t i = 0; i < s1.size(); ++i) {
+        EXPECT_EQ(s1[i], c1.base(i)) << i;
+        EXPECT_EQ(s1[i], fasta.sequence("1", i + 1)) << i;
+    }
+    for (size_t i = 0; i < s2.size(); ++i)
+        EXPECT_EQ(s2[i], c2.base(i)) << i;
+
+    // past the end is a status, not an exception
+    EXPECT_EQ(0, c1.base(13));
+    EXPECT_EQ(0, c2.base(1000));
+
+    char buf[32];
+    for (size_t begin = 0; begin <= s1.size(); ++begin) {
+        for (size_t end = begin; end <= s1.size() + 3; ++end) {
+            size_t n = c1.bases(begin, end, buf);
+            size_t expected = min(end, s1.size()) - begin;
+            ASSERT_EQ(expected, n) << begin << "-" << end;
+            EXPECT_EQ(s1.substr(begin, n), string(buf, n)) << begin << "-" << end;
+        }
+    }
+    EXPECT_EQ(0u, c2.bases(20, 30, buf));
+    EXPECT_EQ(s2.substr(3), fasta.sequence("2", 4, 6));
+}
+
+TEST_F(TestFasta, unknownSequence) {
+    Fasta fasta("mem", data.data(), data.size());
+    Fasta::Contig c = fasta.contig("3");
+    EXPECT_FALSE(c.valid());
+    EXPECT_EQ(0u, c.length());
+    EXPECT_EQ(0, c.base(0));
+    EXPECT_EQ(0u, c.bases(0, 10, 0));
+
+    EXPECT_TRUE(fasta.contig("1").valid());
+    EXPECT_THROW(fasta.sequence("3", 1), UnknownSequenceError);
+    EXPECT_THROW(fasta.sequence("1", 14), length_error);
+}
@@ -74,3 +74,36 @@ TEST_F(TestFastaReader, readPastEndOfChromosome) {
     FastaReader reader(fasta->path());
     ASSERT_THROW(reader.sequence("1", 4), length_error);
 }
+
+TEST_F(TestFastaReader, window) {
+    string seq;
+    for (size_t i = 0; i < 5000; ++i)
+        seq += "ACGTN"[(i * 3 + i / 17) % 5];
+    string data = ">1\n";
+    for (size_t pos = 0; pos < seq.size(); pos += 60)
+        data += seq.substr(pos, 60) + "\n";
+    data += ">2\nTTGCA\n";
+
+    auto fasta = tmpdir.tempFile(data);
+    FastaReader reader(fasta->path(), 100);
+
+    // sweeping through, and back a little now and then
+    for (int32_t i = 0; i < int32_t(seq.size()); ++i) {
+        ASSERT_EQ(seq[i], reader.sequence("1", i)) << i;
+        if (i % 37 == 0 && i >= 10) {
+            ASSERT_EQ(seq[i - 10], reader.sequence("1", i - 10)) << i - 10;
+        }
+    }
+
+    // jumping about, and between sequences
+    for (int32_t i = 0; i < 200; ++i) {
+        int32_t pos = (i * 2729) % int32_t(seq.size());
+        ASSERT_EQ(seq[pos], reader.sequence("1", pos)) << pos;
+        ASSERT_EQ("TTGCA"[i % 5], reader.sequence("2", i % 5));
+    }
+
+    ASSERT_EQ(seq.back(), reader.sequence("1", int32_t(seq.size()) - 1));
+    ASSERT_THROW(reader.sequence("1", int32_t(seq.size())), length_error);
+    ASSERT_THROW(reader.sequence("1", -1), length_error);
+    ASSERT_EQ(seq[0], reader.sequence("1", 0));
+}
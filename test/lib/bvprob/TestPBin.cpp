@@ -103,3 +103,34 @@ TEST(TestPBin, binPValues) {
             << "in bin " << i;
     }
 }
+
+TEST(TestPBin, binPValuesHistogram) {
+    Lut::init();
+    srand(7);
+
+    for (int trial = 0; trial < 200; ++trial) {
+        // a few clusters of qualities, with plenty of duplicates and ties
+        // between gaps
+        vector<uint8_t> probs;
+        uint32_t histogram[256] = {0};
+        int n = 1 + rand() % 60;
+        for (int i = 0; i < n; ++i) {
+            uint8_t q = (rand() % 4) * 10 + rand() % 3;
+            probs.push_back(q);
+            ++histogram[q];
+        }
+        sort(probs.begin(), probs.end());
+
+        for (uint32_t requested = 1; requested <= 5; ++requested) {
+            vector<PBin> expected(5);
+            vector<PBin> actual(5);
+            uint32_t nExpected = binPValues(&probs[0], probs.size(), requested, expected);
+            uint32_t nActual = binPValues(histogram, requested, &actual[0]);
+            ASSERT_EQ(nExpected, nActual) << "trial " << trial << ", " << requested << " bins";
+            for (uint32_t i = 0; i < nActual; ++i) {
+                EXPECT_EQ(expected[i].size, actual[i].size);
+                EXPECT_EQ(expected[i].harmonicMean, actual[i].harmonicMean);
+            }
+        }
+    }
+}
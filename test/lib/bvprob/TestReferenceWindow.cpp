@@ -0,0 +1,104 @@
+#include "bvprob/Fasta.hpp"
+#include "bvprob/ReferenceWindow.hpp"
+
+#include <bam.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    string sequence(size_t len, size_t seed) {
+        string rv;
+        for (size_t i = 0; i < len; ++i)
+            rv += "ACGTNacgtnRY"[(i * 7 + seed + i / 13) % 12];
+        return rv;
+    }
+
+    string fastaText(vector<string> const& seqs, size_t lineLength) {
+        stringstream ss;
+        for (size_t i = 0; i < seqs.size(); ++i) {
+            ss << ">" << i + 1 << "\n";
+            for (size_t pos = 0; pos < seqs[i].size(); pos += lineLength)
+                ss << seqs[i].substr(pos, lineLength) << "\n";
+        }
+        return ss.str();
+    }
+}
+
+class TestReferenceWindow : public testing::Test {
+public:
+    void SetUp() {
+        seqs.push_back(sequence(1000, 0));
+        seqs.push_back(sequence(77, 5));
+        text = fastaText(seqs, 60);
+        fasta.reset(new Fasta("mem", text.data(), text.size()));
+        contigs.push_back(fasta->contig("1"));
+        contigs.push_back(fasta->contig("2"));
+        // in the bam, but not the fasta
+        contigs.push_back(fasta->contig("3"));
+    }
+
+    int code(int tid, size_t pos) const {
+        return bam_nt16_table[int(seqs[tid][pos])];
+    }
+
+protected:
+    vector<string> seqs;
+    string text;
+    unique_ptr<Fasta> fasta;
+    vector<Fasta::Contig> contigs;
+};
+
+TEST_F(TestReferenceWindow, base) {
+    // smaller than the sequences, so the window moves
+    ReferenceWindow window(contigs, 100);
+    for (int tid = 0; tid < 2; ++tid) {
+        for (size_t pos = 0; pos < seqs[tid].size(); ++pos)
+            ASSERT_EQ(code(tid, pos), window.base(tid, pos)) << tid << ":" << pos;
+        EXPECT_EQ(-1, window.base(tid, seqs[tid].size()));
+    }
+
+    // going back
+    EXPECT_EQ(code(0, 3), window.base(0, 3));
+    EXPECT_EQ(code(1, 76), window.base(1, 76));
+    EXPECT_EQ(code(0, 999), window.base(0, 999));
+
+    EXPECT_EQ(-1, window.base(2, 0));
+    EXPECT_EQ(-1, window.base(3, 0));
+    EXPECT_EQ(-1, window.base(-1, 0));
+}
+
+TEST_F(TestReferenceWindow, bases) {
+    ReferenceWindow window(contigs, 64);
+    vector<uint8_t> ref(1200);
+
+    uint32_t const ranges[][2] = {
+        { 0, 10 }, { 5, 64 }, { 60, 130 }, { 100, 1000 }, { 990, 1100 },
+        { 0, 1000 }, { 1000, 1010 }, { 2000, 2010 }, { 500, 500 },
+    };
+    for (size_t i = 0; i < sizeof(ranges) / sizeof(ranges[0]); ++i) {
+        uint32_t begin = ranges[i][0];
+        uint32_t end = ranges[i][1];
+        SCOPED_TRACE(testing::Message() << begin << "-" << end);
+        uint32_t expected = begin < 1000 ? min(end, 1000u) - begin : 0;
+        ASSERT_EQ(expected, window.bases(0, begin, end, ref.data()));
+        for (uint32_t k = 0; k < expected; ++k)
+            ASSERT_EQ(code(0, begin + k), ref[k]) << k;
+    }
+
+    // interleaved with single bases, on other sequences
+    ASSERT_EQ(7u, window.bases(1, 70, 90, ref.data()));
+    EXPECT_EQ(code(1, 70), ref[0]);
+    EXPECT_EQ(code(0, 400), window.base(0, 400));
+    EXPECT_EQ(code(1, 76), ref[6]);
+    EXPECT_EQ(0u, window.bases(2, 0, 10, ref.data()));
+
+    EXPECT_THROW(ReferenceWindow(contigs, 0), invalid_argument);
+}
@@ -0,0 +1,134 @@
+#include "bvprob/Fasta.hpp"
+#include "bvprob/TwoBit.hpp"
+#include "utility/TempFile.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    string sequence(size_t len, size_t seed) {
+        string rv;
+        for (size_t i = 0; i < len; ++i) {
+            // runs of N and of lower case, of various lengths
+            char c = "ACGT"[(i * 5 + seed + i / 7) % 4];
+            if ((i / 50) % 5 == 2)
+                c = 'N';
+            if ((i / 23) % 4 == 1)
+                c = char(tolower(c));
+            rv += c;
+        }
+        return rv;
+    }
+
+    string fastaText(vector<pair<string, string>> const& seqs) {
+        stringstream ss;
+        for (auto i = seqs.begin(); i != seqs.end(); ++i) {
+            ss << ">" << i->first << "\n";
+            for (size_t pos = 0; pos < i->second.size(); pos += 60)
+                ss << i->second.substr(pos, 60) << "\n";
+        }
+        return ss.str();
+    }
+}
+
+class TestTwoBit : public testing::Test {
+public:
+    void SetUp() {
+        seqs.push_back(make_pair("chr2", sequence(1001, 0)));
+        seqs.push_back(make_pair("chr1", sequence(7, 3)));
+        seqs.push_back(make_pair("chrM", string("NNNNacgtnACGT")));
+        seqs.push_back(make_pair("chrX", sequence(5000, 1)));
+        text = fastaText(seqs);
+    }
+
+    string twoBitFile(Fasta const& fasta) {
+        files.push_back(tmpdir.tempFile());
+        ofstream out(files.back()->path().c_str(), ios::binary);
+        writeTwoBit(fasta, out);
+        return files.back()->path();
+    }
+
+protected:
+    TempDir tmpdir;
+    vector<unique_ptr<TempFile>> files;
+    vector<pair<string, string>> seqs;
+    string text;
+};
+
+TEST_F(TestTwoBit, roundTrip) {
+    Fasta fasta("mem", text.data(), text.size());
+    Fasta packed(twoBitFile(fasta));
+
+    vector<string> names;
+    for (auto i = seqs.begin(); i != seqs.end(); ++i)
+        names.push_back(i->first);
+    EXPECT_EQ(names, packed.sequenceNames());
+
+    for (auto i = seqs.begin(); i != seqs.end(); ++i) {
+        SCOPED_TRACE(i->first);
+        string const& s = i->second;
+        Fasta::Contig c = packed.contig(i->first);
+        ASSERT_TRUE(c.valid());
+        ASSERT_EQ(s.size(), c.length());
+        EXPECT_EQ(s.size(), packed.seqlen(i->first));
+
+        for (size_t pos = 0; pos < s.size(); ++pos)
+            ASSERT_EQ(s[pos], c.base(pos)) << pos;
+        EXPECT_EQ(0, c.base(s.size()));
+
+        // ranges starting and ending at every offset in a byte
+        vector<char> buf(s.size() + 8);
+        for (size_t begin = 0; begin < min<size_t>(s.size(), 70); begin += 3) {
+            for (size_t end = begin; end <= s.size() + 2; end += 1 + end / 3) {
+                size_t n = c.bases(begin, end, buf.data());
+                ASSERT_EQ(min(end, s.size()) - begin, n) << begin << "-" << end;
+                ASSERT_EQ(s.substr(begin, n), string(buf.data(), n)) << begin << "-" << end;
+            }
+        }
+        EXPECT_EQ(s, packed.sequence(i->first, 1, s.size()));
+    }
+
+    EXPECT_FALSE(packed.contig("chr3").valid());
+}
+
+TEST_F(TestTwoBit, ambiguousBasesBecomeN) {
+    string const fa = ">1\nACRYKMacrykmSWBDHVN\n";
+    Fasta fasta("mem", fa.data(), fa.size());
+    Fasta packed(twoBitFile(fasta));
+    EXPECT_EQ("ACNNNNacnnnnNNNNNNN", packed.sequence("1", 1, 19));
+}
+
+TEST_F(TestTwoBit, detectsFormat) {
+    Fasta fasta("mem", text.data(), text.size());
+    string path = twoBitFile(fasta);
+    ifstream in(path.c_str(), ios::binary);
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+    EXPECT_TRUE(isTwoBit(data.data(), data.size()));
+    EXPECT_FALSE(isTwoBit(text.data(), text.size()));
+    EXPECT_FALSE(isTwoBit(data.data(), 3));
+
+    // no .fai is written for a 2bit file
+    Fasta packed(path);
+    EXPECT_FALSE(boost::filesystem::exists(path + ".fai"));
+
+    // cut short inside the last sequence
+    EXPECT_THROW(readTwoBit(data.data(), data.size() - 1, path), runtime_error);
+    EXPECT_NO_THROW(readTwoBit(data.data(), data.size(), path));
+
+    string swapped = data;
+    reverse(swapped.begin(), swapped.begin() + 4);
+    EXPECT_TRUE(isTwoBit(swapped.data(), swapped.size()));
+    EXPECT_THROW(readTwoBit(swapped.data(), swapped.size(), path), runtime_error);
+}
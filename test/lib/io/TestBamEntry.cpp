@@ -10,6 +10,7 @@
 #include <cstring>
 #include <iostream>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace {
@@ -146,3 +147,41 @@ TEST_F(TestBamEntry, resolveCigarSoftClipLeft) {
     EXPECT_TRUE(e.resolveCigar(204, x));
     EXPECT_EQ(4, x.base);
 }
+
+TEST_F(TestBamEntry, resolveCigarFromSeveralThreads) {
+    // the index is built by whichever thread gets there first
+    std::vector<BamEntry::PileupData> expected(20);
+    std::vector<int> found(20);
+    for (uint32_t i = 0; i < 20; ++i)
+        found[i] = entries[1]->resolveCigar(195 + i, expected[i]);
+
+    TempDir tmpdir;
+    auto samFile = tmpdir.tempFile(SAM_DATA);
+    BamReader reader(samFile->path());
+    // READ1's entry goes back to the pool with its index built, and comes
+    // back as READ2, whose index must not be the stale one
+    BamEntry* e = reader.take();
+    BamEntry::PileupData x;
+    ASSERT_TRUE(e->resolveCigar(105, x));
+    BamEntry::release(e);
+    e = reader.take();
+    ASSERT_STREQ("READ2", e->name());
+
+    std::vector<int> ok(8, 1);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < ok.size(); ++t) {
+        threads.push_back(std::thread([&, t]() {
+            for (uint32_t i = 0; i < 20; ++i) {
+                BamEntry::PileupData x;
+                bool rv = e->resolveCigar(195 + i, x);
+                if (rv != bool(found[i]) || (rv && !(x == expected[i])))
+                    ok[t] = 0;
+            }
+        }));
+    }
+    for (auto i = threads.begin(); i != threads.end(); ++i)
+        i->join();
+    for (size_t t = 0; t < ok.size(); ++t)
+        EXPECT_EQ(1, ok[t]) << t;
+    BamEntry::release(e);
+}
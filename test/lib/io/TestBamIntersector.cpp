@@ -1,16 +1,23 @@
 #include "io/BamIntersector.hpp"
 #include "io/BamReader.hpp"
+#include "io/MappedBamReader.hpp"
 #include "io/RegionLimitedBamReader.hpp"
 #include "io/Pileup.hpp"
 #include "io/SamConvert.hpp"
+#include "io/SiteSummary.hpp"
+#include "io/TargetRegions.hpp"
+#include "utility/AllocationCounter.hpp"
 #include "utility/TempFile.hpp"
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <deque>
 #include <functional>
+#include <iostream>
 #include <map>
 #include <set>
+#include <sstream>
 
 using namespace std;
 using namespace std::placeholders;
@@ -57,13 +64,8 @@ namespace {
 class TestBamIntersector : public ::testing::Test {
 public:
     void SetUp() {
-        auto normalFile(tmpdir.tempFile(normalSam));
-        auto tumorFile(tmpdir.tempFile(tumorSam));
-
-        normalBamPath = normalFile->path() + ".bam";
-        tumorBamPath = tumorFile->path() + ".bam";
-        samToIndexedBam(normalFile->path(), normalBamPath);
-        samToIndexedBam(tumorFile->path(), tumorBamPath);
+        normalBamPath = makeIndexedBam(tmpdir, normalSam);
+        tumorBamPath = makeIndexedBam(tmpdir, tumorSam);
     }
 
 protected:
@@ -144,3 +146,284 @@ TEST_F(TestBamIntersector, intersectRegionLimited) {
 }
 
 
+
+TEST_F(TestBamIntersector, intersectChunks) {
+    BamReader normalReader(normalBamPath);
+    BamReader tumorReader(tumorBamPath);
+    Collector whole;
+    BamIntersector(normalReader, tumorReader,
+        std::bind(&Collector::collect, &whole, _1, _2, _3)).run();
+
+    // chunk boundaries fall in the middle of reads. each chunk must report
+    // only its own positions, and together they must cover the whole run.
+    Region region;
+    region.tid = 0;
+    region.beg = 0;
+    region.end = 7;
+    RegionLimitedBamReader normalChunk(normalBamPath, region);
+    RegionLimitedBamReader tumorChunk(tumorBamPath, region);
+
+    Collector chunked;
+    for (; region.beg < 35; region.beg = region.end, region.end += 7) {
+        normalChunk.setRegion(region);
+        tumorChunk.setRegion(region);
+        Collector collector;
+        BamIntersector(normalChunk, tumorChunk,
+            std::bind(&Collector::collect, &collector, _1, _2, _3)).run();
+
+        for (auto iter = collector.results.begin(); iter != collector.results.end(); ++iter) {
+            ASSERT_GE(iter->first, region.beg);
+            ASSERT_LT(iter->first, region.end);
+            chunked.results[iter->first] = iter->second;
+        }
+    }
+
+    ASSERT_EQ(whole.results.size(), chunked.results.size());
+    for (auto iter = whole.results.begin(); iter != whole.results.end(); ++iter) {
+        ReadCounts const& counts = chunked.results[iter->first];
+        EXPECT_EQ(iter->second.normalCount, counts.normalCount) << "position " << iter->first;
+        EXPECT_EQ(iter->second.tumorCount, counts.tumorCount) << "position " << iter->first;
+    }
+}
+
+TEST_F(TestBamIntersector, candidateFilter) {
+    // the reference is all A, and ends at position 25
+    uint32_t const refLen = 25;
+    auto reference = [&](int tid, uint32_t begin, uint32_t end, uint8_t* ref) -> uint32_t {
+        uint32_t n = begin < refLen ? min(end, refLen) - begin : 0;
+        fill(ref, ref + n, bam_nt16_table[int('A')]);
+        return n;
+    };
+
+    for (int minQual = 0; minQual <= 28; minQual += 28) {
+        SCOPED_TRACE(minQual);
+
+        // the positions the filter should keep, from a run without it
+        map<int32_t, ReadCounts> expected;
+        auto keep = [&](int32_t pos, const Pileup& normal, const Pileup& tumor) {
+            SiteSummary n, t;
+            n.summarize(normal, bam_nt16_table[int('A')], minQual);
+            t.summarize(tumor, bam_nt16_table[int('A')], minQual);
+            if (uint32_t(pos) >= refLen || n.supporting < n.depth || t.supporting < t.depth)
+                expected[pos] = ReadCounts(normal.size(), tumor.size());
+        };
+        BamReader normalAll(normalBamPath);
+        BamReader tumorAll(tumorBamPath);
+        BamIntersector(normalAll, tumorAll, keep).run();
+        ASSERT_FALSE(expected.empty());
+
+        BamReader normalReader(normalBamPath);
+        BamReader tumorReader(tumorBamPath);
+        Collector collector;
+        BamIntersector intersector(normalReader, tumorReader,
+            std::bind(&Collector::collect, &collector, _1, _2, _3));
+        intersector.setCandidateFilter(reference, minQual);
+        intersector.run();
+
+        ASSERT_EQ(expected.size(), collector.results.size());
+        for (auto iter = expected.begin(); iter != expected.end(); ++iter) {
+            ASSERT_TRUE(collector.results.count(iter->first)) << "position " << iter->first;
+            ReadCounts const& counts = collector.results[iter->first];
+            EXPECT_EQ(iter->second.normalCount, counts.normalCount) << "position " << iter->first;
+            EXPECT_EQ(iter->second.tumorCount, counts.tumorCount) << "position " << iter->first;
+        }
+    }
+}
+
+TEST_F(TestBamIntersector, minDepth) {
+    BamReader normalAll(normalBamPath);
+    BamReader tumorAll(tumorBamPath);
+    Collector whole;
+    BamIntersector(normalAll, tumorAll,
+        std::bind(&Collector::collect, &whole, _1, _2, _3)).run();
+
+    for (uint32_t n = 0; n <= 3; ++n) {
+        for (uint32_t t = 0; t <= 3; ++t) {
+            BamReader normalReader(normalBamPath);
+            BamReader tumorReader(tumorBamPath);
+            Collector collector;
+            BamIntersector intersector(normalReader, tumorReader,
+                std::bind(&Collector::collect, &collector, _1, _2, _3));
+            intersector.setMinDepth(n, t);
+            intersector.run();
+
+            map<int32_t, ReadCounts> expected;
+            for (auto iter = whole.results.begin(); iter != whole.results.end(); ++iter) {
+                if (iter->second.normalCount >= n && iter->second.tumorCount >= t)
+                    expected.insert(*iter);
+            }
+
+            ASSERT_EQ(expected.size(), collector.results.size()) << "depths " << n << ", " << t;
+            for (auto iter = expected.begin(); iter != expected.end(); ++iter) {
+                ReadCounts const& counts = collector.results[iter->first];
+                EXPECT_EQ(iter->second.normalCount, counts.normalCount) << "position " << iter->first;
+                EXPECT_EQ(iter->second.tumorCount, counts.tumorCount) << "position " << iter->first;
+            }
+        }
+    }
+}
+
+TEST_F(TestBamIntersector, seekOverGaps) {
+    // the normal only has reads at the start and end of the sequence, like
+    // an exome against a genome. the tumor has them all the way through.
+    stringstream normal;
+    stringstream tumor;
+    normal << "@SQ\tSN:1\tLN:1000000\n@SQ\tSN:2\tLN:1000000\n";
+    tumor << "@SQ\tSN:1\tLN:1000000\n@SQ\tSN:2\tLN:1000000\n";
+    for (int tid = 1; tid <= 2; ++tid) {
+        for (int pos = 1; pos < 1000000; pos += 50) {
+            string read = "\t0\t" + to_string(tid) + "\t" + to_string(pos)
+                + "\t60\t100M\t*\t0\t0\t" + string(100, 'A') + "\t" + string(100, '<') + "\n";
+            tumor << "T" << pos << read;
+            if (pos < 1000 || pos > 900000)
+                normal << "N" << pos << read;
+        }
+    }
+    string normalPath = makeIndexedBam(tmpdir, normal.str());
+    string tumorPath = makeIndexedBam(tmpdir, tumor.str());
+
+    // the number of sites and the total depth at them
+    auto run = [&](BamReaderBase& n, BamReaderBase& t, uint32_t gap, uint64_t* seeks) {
+        size_t sites = 0;
+        size_t depth = 0;
+        BamIntersector intersector(n, t, [&](int32_t, const Pileup& normal, const Pileup& tumor) {
+            ++sites;
+            depth += normal.size() + tumor.size();
+        });
+        intersector.setSeekGap(gap);
+        intersector.run();
+        *seeks = intersector.seeks();
+        return make_pair(sites, depth);
+    };
+
+    uint64_t seeks = 0;
+    BamReader normalAll(normalPath);
+    BamReader tumorAll(tumorPath);
+    pair<size_t, size_t> expected = run(normalAll, tumorAll, 0, &seeks);
+    EXPECT_EQ(0u, seeks);
+    ASSERT_LT(0u, expected.first);
+
+    {
+        BamReader n(normalPath);
+        BamReader t(tumorPath);
+        EXPECT_EQ(expected, run(n, t, 10000, &seeks));
+        EXPECT_LT(0u, seeks);
+    }
+    {
+        MappedBamReader n(normalPath);
+        MappedBamReader t(tumorPath);
+        EXPECT_EQ(expected, run(n, t, 10000, &seeks));
+        EXPECT_LT(0u, seeks);
+    }
+    {
+        Region region = { 1, 0, 1000000 };
+        RegionLimitedBamReader n(normalPath, region);
+        RegionLimitedBamReader t(tumorPath, region);
+        pair<size_t, size_t> inRegion = run(n, t, 0, &seeks);
+
+        n.setRegion(region);
+        t.setRegion(region);
+        EXPECT_EQ(inRegion, run(n, t, 10000, &seeks));
+        EXPECT_LT(0u, seeks);
+    }
+}
+
+TEST_F(TestBamIntersector, targets) {
+    stringstream normal;
+    stringstream tumor;
+    normal << "@SQ\tSN:1\tLN:1000000\n";
+    tumor << "@SQ\tSN:1\tLN:1000000\n";
+    for (int pos = 1; pos < 200000; pos += 50) {
+        string read = "\t0\t1\t" + to_string(pos) + "\t60\t100M\t*\t0\t0\t"
+            + string(100, "ACGT"[pos % 4]) + "\t" + string(100, '<') + "\n";
+        normal << "N" << pos << read;
+        tumor << "T" << pos << read;
+    }
+    string normalPath = makeIndexedBam(tmpdir, normal.str());
+    string tumorPath = makeIndexedBam(tmpdir, tumor.str());
+
+    vector<Region> targets;
+    Region a = { 0, 990, 1010 };
+    Region b = { 0, 5000, 5100 };
+    Region c = { 0, 150000, 160000 };
+    targets.push_back(a);
+    targets.push_back(b);
+    targets.push_back(c);
+
+    Collector all;
+    {
+        BamReader n(normalPath);
+        BamReader t(tumorPath);
+        BamIntersector intersector(n, t, bind(&Collector::collect, &all, _1, _2, _3));
+        intersector.run();
+    }
+
+    Collector limited;
+    Region none = { 0, 0, 0 };
+    RegionLimitedBamReader n(normalPath, none);
+    MappedBamReader t(tumorPath, none);
+    n.setTargets(targets);
+    t.setTargets(targets);
+    BamIntersector intersector(n, t, bind(&Collector::collect, &limited, _1, _2, _3));
+    intersector.setTargets(targets);
+    intersector.run();
+
+    size_t expected = 0;
+    for (auto i = all.results.begin(); i != all.results.end(); ++i) {
+        vector<uint8_t> inside(1, 1);
+        maskOutsideRegions(targets, 0, i->first, i->first + 1, inside.data());
+        if (!inside[0])
+            continue;
+        ++expected;
+        SCOPED_TRACE(i->first);
+        ASSERT_EQ(1u, limited.results.count(i->first));
+        EXPECT_EQ(i->second.normalCount, limited.results[i->first].normalCount);
+        EXPECT_EQ(i->second.tumorCount, limited.results[i->first].tumorCount);
+    }
+    EXPECT_EQ(20u + 100u + 10000u, expected);
+    EXPECT_EQ(expected, limited.results.size());
+}
+
+TEST_F(TestBamIntersector, noAllocationsPerSite) {
+    // allocations are only counted in builds configured with
+    // COUNT_ALLOCATIONS. the vendored gtest predates GTEST_SKIP.
+    if (!AllocationCounter::enabled()) {
+        cout << "Skipped, built without COUNT_ALLOCATIONS\n";
+        return;
+    }
+
+    // uniform coverage, so that buffers and entry pools stop growing early
+    stringstream ss;
+    ss << "@SQ\tSN:1\tLN:247249719\n";
+    for (int i = 0; i < 20000; ++i) {
+        ss << "READ" << i << "\t0\t1\t" << (i * 5 + 1) << "\t60\t20M5I20M10D5M\t*\t0\t0\t"
+            << string(50, "ACGT"[i % 4]) << "\t" << string(50, char('#' + i % 40)) << "\n";
+    }
+    string bamPath = makeIndexedBam(tmpdir, ss.str());
+
+    BamReader normalReader(bamPath);
+    BamReader tumorReader(bamPath);
+
+    // a few pileup windows in
+    uint32_t const warmup = 5000;
+    uint32_t sites = 0;
+    uint64_t allocations = 0;
+    uint64_t depth = 0;
+    SiteSummary normalSummary;
+    SiteSummary tumorSummary;
+    auto cb = [&](int32_t pos, Pileup const& normal, Pileup const& tumor) {
+        if (++sites == warmup)
+            allocations = AllocationCounter::count();
+        normalSummary.summarize(normal, 1, 20);
+        tumorSummary.summarize(tumor, 1, 20);
+        depth += normalSummary.depth;
+    };
+
+    BamIntersector intersector(normalReader, tumorReader, cb);
+    intersector.run();
+    allocations = AllocationCounter::count() - allocations;
+
+    EXPECT_LT(warmup * 10, sites);
+    EXPECT_LT(sites, depth);
+    EXPECT_EQ(0u, allocations);
+}
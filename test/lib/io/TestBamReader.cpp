@@ -1,16 +1,22 @@
 #include "io/BamEntry.hpp"
 #include "io/BamFilter.hpp"
 #include "io/BamReader.hpp"
+#include "io/MappedBamReader.hpp"
 #include "io/RegionLimitedBamReader.hpp"
 #include "io/SamConvert.hpp"
 #include "utility/TempFile.hpp"
+#include "utility/ThreadPool.hpp"
 
 #include <boost/filesystem.hpp>
 #include <gtest/gtest.h>
+#include <sys/stat.h>
 #include <cstdlib>
 #include <fstream>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 namespace bfs = boost::filesystem;
 using namespace std;
@@ -32,16 +38,9 @@ public:
         samFile = tmpdir.tempFile(samSource);
     }
 
-    std::string makeBamFromSam(std::string const& path) {
-        std::string output = path + ".bam";
-        samToIndexedBam(path, output);
-        return output;
-    }
-
 protected:
     TempDir tmpdir;
     std::unique_ptr<TempFile> samFile;
-    std::unique_ptr<TempFile> bamFile;
 };
 
 TEST_F(TestBamReader, read) {
@@ -132,7 +131,7 @@ TEST_F(TestBamReader, filtered11) {
 }
 
 TEST_F(TestBamReader, regionLimitedAndFiltered) {
-    auto bamFile = makeBamFromSam(samFile->path());
+    auto bamFile = makeIndexedBam(tmpdir, samSource);
 
     // limit to all of chr 1
     std::unique_ptr<RegionLimitedBamReader> reader(new RegionLimitedBamReader(bamFile, "1"));
@@ -188,3 +187,92 @@ TEST_F(TestBamReader, regionLimitedAndFiltered) {
     delete e;
     EXPECT_FALSE(reader->take());
 }
+
+TEST_F(TestBamReader, filteredBeforeDecoding) {
+    // duplicates and low mapping qualities mixed in over many bgzf blocks
+    stringstream sam;
+    sam << "@SQ\tSN:1\tLN:10000000\n";
+    for (int i = 0; i < 20000; ++i) {
+        int flag = i % 3 == 0 ? 1024 : 0;
+        sam << "READ" << i << "\t" << flag << "\t1\t" << (i * 10 + 1)
+            << "\t" << (i % 60) << "\t25M\t*\t0\t0\t"
+            << "ACGTACGTACGTACGTACGTACGTA\t<<<<<<<<<<<<<<<<<<<<<<<<<\n";
+    }
+    auto bamPath = makeIndexedBam(tmpdir, sam.str());
+
+    BamFilter filter(BAM_DEF_MASK, 20);
+    Region region = { 0, 50000, 150000 };
+    vector<string> all;
+    vector<string> inRegion;
+    {
+        BamReader reader(bamPath);
+        while (BamEntry* e = reader.take()) {
+            if (filter.accept(e->rawData())) {
+                all.push_back(e->name());
+                if (e->start() < region.end && int(e->end()) > region.beg)
+                    inRegion.push_back(e->name());
+            }
+            delete e;
+        }
+    }
+    ASSERT_LT(5000u, all.size());
+    ASSERT_LT(1000u, inRegion.size());
+
+    ThreadPool pool(2);
+    BamReader plain(bamPath);
+    BamReader pooled(bamPath, &pool);
+    MappedBamReader mapped(bamPath);
+    RegionLimitedBamReader plainRegion(bamPath, region);
+    RegionLimitedBamReader pooledRegion(bamPath, region, &pool);
+    MappedBamReader mappedRegion(bamPath, region);
+    BamReaderBase* whole[] = { &plain, &pooled, &mapped };
+    BamReaderBase* limited[] = { &plainRegion, &pooledRegion, &mappedRegion };
+
+    auto names = [&](BamReaderBase& reader) {
+        reader.setFilter(&filter);
+        vector<string> rv;
+        while (BamEntry* e = reader.take()) {
+            rv.push_back(e->name());
+            delete e;
+        }
+        return rv;
+    };
+    for (int i = 0; i < 3; ++i) {
+        SCOPED_TRACE(i);
+        EXPECT_EQ(all, names(*whole[i]));
+        EXPECT_EQ(inRegion, names(*limited[i]));
+    }
+}
+
+TEST_F(TestBamReader, readFromPipe) {
+    auto bamPath = makeIndexedBam(tmpdir, samSource);
+    EXPECT_FALSE(BamReader::isStream(bamPath));
+    EXPECT_TRUE(BamReader::isStream("-"));
+
+    // no .bam in the name to go by
+    string fifo = (bfs::path(tmpdir.path()) / "normal").string();
+    ASSERT_EQ(0, mkfifo(fifo.c_str(), 0600));
+    EXPECT_TRUE(BamReader::isStream(fifo));
+
+    thread writer([&]() {
+        ifstream in(bamPath.c_str(), ios::binary);
+        ofstream out(fifo.c_str(), ios::binary);
+        out << in.rdbuf();
+    });
+
+    // the inflate pool is not used on a stream
+    ThreadPool pool(2);
+    vector<string> names;
+    {
+        BamReader reader(fifo, &pool);
+        EXPECT_FALSE(reader.skipTo(1, 0));
+        while (BamEntry* e = reader.take()) {
+            names.push_back(e->name());
+            delete e;
+        }
+    }
+    writer.join();
+
+    vector<string> expected = { "READ1", "READ2", "READ3" };
+    EXPECT_EQ(expected, names);
+}
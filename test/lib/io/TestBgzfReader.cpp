@@ -0,0 +1,235 @@
+#include "io/BamEntry.hpp"
+#include "io/BamReader.hpp"
+#include "io/BgzfReader.hpp"
+#include "io/RegionLimitedBamReader.hpp"
+#include "io/SamConvert.hpp"
+#include "utility/TempFile.hpp"
+#include "utility/ThreadPool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    // enough reads for the bam to span a number of bgzf blocks
+    string makeSam(int nReads) {
+        stringstream ss;
+        ss << "@SQ\tSN:1\tLN:1000000\n"
+           << "@SQ\tSN:2\tLN:1000000\n";
+        srand(7);
+        for (int i = 0; i < nReads; ++i) {
+            int tid = i < nReads / 2 ? 1 : 2;
+            ss << "READ" << i << "\t0\t" << tid << "\t" << (i * 20 + 1)
+                << "\t60\t20M5N30M\t*\t0\t0\t";
+            for (int j = 0; j < 50; ++j)
+                ss << "ACGT"[rand() % 4];
+            ss << "\t";
+            for (int j = 0; j < 50; ++j)
+                ss << char('!' + rand() % 40);
+            ss << "\n";
+        }
+        return ss.str();
+    }
+
+    vector<string> readNames(BamReaderBase& reader) {
+        vector<string> rv;
+        BamEntry* e;
+        while ((e = reader.take())) {
+            rv.push_back(e->name());
+            delete e;
+        }
+        return rv;
+    }
+
+    // read all records with samtools, remembering where each one starts
+    vector<bam1_t*> samtoolsRecords(string const& path, vector<uint64_t>& offsets) {
+        bamFile fp = bam_open(path.c_str(), "r");
+        bam_header_t* header = bam_header_read(fp);
+        vector<bam1_t*> rv;
+        offsets.clear();
+        for (;;) {
+            uint64_t offset = bam_tell(fp);
+            bam1_t* b = bam_init1();
+            if (bam_read1(fp, b) < 0) {
+                bam_destroy1(b);
+                break;
+            }
+            offsets.push_back(offset);
+            rv.push_back(b);
+        }
+        bam_header_destroy(header);
+        bam_close(fp);
+        return rv;
+    }
+
+    // the names of the reads bam_iter_read gives for region
+    vector<string> samtoolsRegionNames(string const& path, char const* region) {
+        bamFile fp = bam_open(path.c_str(), "r");
+        bam_header_t* header = bam_header_read(fp);
+        bam_index_t* index = bam_index_load(path.c_str());
+        int tid, beg, end;
+        bam_parse_region(header, region, &tid, &beg, &end);
+        bam_iter_t iter = bam_iter_query(index, tid, beg, end);
+
+        vector<string> rv;
+        bam1_t* b = bam_init1();
+        while (bam_iter_read(fp, iter, b) >= 0)
+            rv.push_back(bam1_qname(b));
+
+        bam_destroy1(b);
+        bam_iter_destroy(iter);
+        bam_index_destroy(index);
+        bam_header_destroy(header);
+        bam_close(fp);
+        return rv;
+    }
+
+    void expectSameRecord(bam1_t const* expected, bam1_t const* actual) {
+        EXPECT_EQ(0, memcmp(&expected->core, &actual->core, sizeof(bam1_core_t)));
+        ASSERT_EQ(expected->data_len, actual->data_len);
+        EXPECT_EQ(expected->l_aux, actual->l_aux);
+        EXPECT_EQ(0, memcmp(expected->data, actual->data, expected->data_len));
+    }
+}
+
+class TestBgzfReader : public ::testing::Test {
+public:
+    void SetUp() {
+        bamPath = makeIndexedBam(tmpdir, makeSam(5000));
+        expected = samtoolsRecords(bamPath, offsets);
+        ASSERT_EQ(5000u, expected.size());
+        // the test is pointless unless records are spread over blocks
+        ASSERT_LT(10u, (offsets.back() >> 16) / 0x4000);
+    }
+
+    void TearDown() {
+        for (auto i = expected.begin(); i != expected.end(); ++i)
+            bam_destroy1(*i);
+    }
+
+    void checkSequential(ThreadPool* pool) {
+        BgzfReader in(bamPath, pool, 4);
+        in.seek(offsets[0]);
+        bam1_t* b = bam_init1();
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQ(offsets[i], in.tell()) << "record " << i;
+            ASSERT_TRUE(readBamRecord(in, b));
+            expectSameRecord(expected[i], b);
+        }
+        EXPECT_FALSE(readBamRecord(in, b));
+        EXPECT_FALSE(readBamRecord(in, b));
+        bam_destroy1(b);
+    }
+
+protected:
+    TempDir tmpdir;
+    string bamPath;
+    vector<bam1_t*> expected;
+    vector<uint64_t> offsets;
+};
+
+TEST_F(TestBgzfReader, sequential) {
+    checkSequential(0);
+}
+
+TEST_F(TestBgzfReader, sequentialWithPool) {
+    ThreadPool pool(3);
+    checkSequential(&pool);
+}
+
+TEST_F(TestBgzfReader, seek) {
+    ThreadPool pool(2);
+    BgzfReader in(bamPath, &pool, 2);
+    bam1_t* b = bam_init1();
+
+    size_t idx[] = { 4000, 17, 17, 2500, 4999, 0, 2501 };
+    for (size_t i = 0; i < sizeof(idx)/sizeof(idx[0]); ++i) {
+        in.seek(offsets[idx[i]]);
+        EXPECT_EQ(offsets[idx[i]], in.tell());
+        for (size_t j = idx[i]; j < min(idx[i] + 100, expected.size()); ++j) {
+            ASSERT_TRUE(readBamRecord(in, b));
+            expectSameRecord(expected[j], b);
+        }
+    }
+    bam_destroy1(b);
+}
+
+TEST_F(TestBgzfReader, skipData) {
+    // every other record is passed over after its core
+    BgzfReader in(bamPath, 0, 0);
+    in.seek(offsets[0]);
+    bamFile fp = bam_open(bamPath.c_str(), "r");
+    bam_header_t* header = bam_header_read(fp);
+    bam1_t* b = bam_init1();
+    for (size_t i = 0; i < expected.size(); ++i) {
+        SCOPED_TRACE(i);
+        ASSERT_EQ(offsets[i], in.tell());
+        ASSERT_EQ(offsets[i], uint64_t(bam_tell(fp)));
+        for (int pass = 0; pass < 2; ++pass) {
+            bool core = pass ? readBamCore(fp, bamPath, b) : readBamCore(in, b);
+            ASSERT_TRUE(core);
+            EXPECT_EQ(0, memcmp(&expected[i]->core, &b->core, sizeof(bam1_core_t)));
+            EXPECT_EQ(expected[i]->data_len, b->data_len);
+            if (i % 2 == 0) {
+                pass ? skipBamData(fp, bamPath, b) : skipBamData(in, b);
+            } else {
+                pass ? readBamData(fp, bamPath, b) : readBamData(in, b);
+                expectSameRecord(expected[i], b);
+            }
+        }
+    }
+    EXPECT_FALSE(readBamCore(in, b));
+    EXPECT_FALSE(readBamCore(fp, bamPath, b));
+
+    bam_destroy1(b);
+    bam_header_destroy(header);
+    bam_close(fp);
+}
+
+TEST_F(TestBgzfReader, notBgzf) {
+    auto samFile = tmpdir.tempFile(makeSam(10));
+    BgzfReader in(samFile->path(), 0, 0);
+    char buf[10];
+    EXPECT_THROW(in.read(buf, sizeof(buf)), runtime_error);
+}
+
+TEST_F(TestBgzfReader, bamReaders) {
+    ThreadPool pool(2);
+
+    BamReader plain(bamPath);
+    BamReader pooled(bamPath, &pool);
+    EXPECT_EQ(readNames(plain), readNames(pooled));
+
+    char const* regions[] = { "1", "2", "1:30000-30100", "2:1-10", "1:99990-100500", "2:70000-80000" };
+    for (size_t i = 0; i < sizeof(regions)/sizeof(regions[0]); ++i) {
+        RegionLimitedBamReader plainRegion(bamPath, regions[i]);
+        RegionLimitedBamReader pooledRegion(bamPath, regions[i], &pool);
+        vector<string> names = readNames(plainRegion);
+        EXPECT_EQ(samtoolsRegionNames(bamPath, regions[i]), names) << regions[i];
+        EXPECT_EQ(names, readNames(pooledRegion)) << regions[i];
+        if (i < 3) {
+            EXPECT_FALSE(names.empty()) << regions[i];
+        }
+    }
+
+    // repositioning
+    Region region = { 1, 90000, 90100 };
+    RegionLimitedBamReader plainRegion(bamPath, region);
+    RegionLimitedBamReader pooledRegion(bamPath, region, &pool);
+    for (int i = 0; i < 3; ++i, region.beg -= 20000, region.end -= 20000) {
+        plainRegion.setRegion(region);
+        pooledRegion.setRegion(region);
+        // leave a peeked entry behind to be discarded by setRegion
+        delete pooledRegion.take();
+        delete plainRegion.take();
+        EXPECT_TRUE(pooledRegion.peek());
+        EXPECT_EQ(readNames(plainRegion), readNames(pooledRegion));
+    }
+}
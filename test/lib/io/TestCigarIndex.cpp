@@ -0,0 +1,113 @@
+#include "io/CigarIndex.hpp"
+#include "io/CigarParser.hpp"
+
+#include <gtest/gtest.h>
+
+#include <bam.h>
+
+#include <cstdlib>
+#include <vector>
+
+namespace {
+    struct CigarBuilder {
+        void add(int len, int op) {
+            cigar.push_back(bam_cigar_gen(len, op));
+        }
+
+        std::vector<uint32_t> cigar;
+    };
+}
+
+class TestCigarIndex : public ::testing::Test {
+public:
+    void build() {
+        index.build(builder.cigar.data(), builder.cigar.size());
+    }
+
+    CigarBuilder builder;
+    CigarIndex index;
+};
+
+TEST_F(TestCigarIndex, empty) {
+    build();
+    EXPECT_EQ(0u, index.refLength());
+    EXPECT_EQ(CigarIndex::OUTSIDE, index.readOffset(0));
+}
+
+TEST_F(TestCigarIndex, simple) {
+    builder.add(5, BAM_CSOFT_CLIP);
+    builder.add(10, BAM_CMATCH);
+    builder.add(2, BAM_CHARD_CLIP);
+    build();
+
+    EXPECT_EQ(10u, index.refLength());
+    for (uint32_t i = 0; i < 10; ++i)
+        EXPECT_EQ(int32_t(i + 5), index.readOffset(i));
+    EXPECT_EQ(CigarIndex::OUTSIDE, index.readOffset(10));
+    EXPECT_EQ(CigarIndex::OUTSIDE, index.readOffset(uint32_t(-1)));
+}
+
+TEST_F(TestCigarIndex, anyOrder) {
+    builder.add(2, BAM_CMATCH);
+    builder.add(1, BAM_CINS);
+    builder.add(3, BAM_CMATCH);
+    builder.add(2, BAM_CDEL);
+    builder.add(2, BAM_CEQUAL);
+    builder.add(3, BAM_CREF_SKIP);
+    builder.add(1, BAM_CDIFF);
+    build();
+
+    EXPECT_EQ(13u, index.refLength());
+    EXPECT_EQ(8, index.readOffset(12));
+    EXPECT_EQ(CigarIndex::SKIPPED, index.readOffset(10));
+    EXPECT_EQ(CigarIndex::DELETED, index.readOffset(5));
+    EXPECT_EQ(CigarIndex::DELETED, index.readOffset(6));
+    EXPECT_EQ(3, index.readOffset(2));
+    EXPECT_EQ(0, index.readOffset(0));
+    EXPECT_EQ(6, index.readOffset(7));
+    EXPECT_EQ(7, index.readOffset(8));
+    EXPECT_EQ(CigarIndex::SKIPPED, index.readOffset(9));
+    EXPECT_EQ(1, index.readOffset(1));
+}
+
+TEST_F(TestCigarIndex, rebuild) {
+    builder.add(2, BAM_CMATCH);
+    builder.add(2, BAM_CDEL);
+    builder.add(2, BAM_CMATCH);
+    build();
+    EXPECT_EQ(CigarIndex::DELETED, index.readOffset(2));
+
+    builder.cigar.clear();
+    builder.add(4, BAM_CMATCH);
+    build();
+    EXPECT_EQ(4u, index.refLength());
+    EXPECT_EQ(2, index.readOffset(2));
+    EXPECT_EQ(CigarIndex::OUTSIDE, index.readOffset(5));
+}
+
+TEST_F(TestCigarIndex, matchesParser) {
+    int const ops[] = {
+        BAM_CMATCH, BAM_CINS, BAM_CDEL, BAM_CREF_SKIP,
+        BAM_CSOFT_CLIP, BAM_CEQUAL, BAM_CDIFF, BAM_CPAD
+    };
+    int const nOps = sizeof(ops) / sizeof(ops[0]);
+
+    srand(1);
+    for (int iter = 0; iter < 200; ++iter) {
+        builder.cigar.clear();
+        int n = 1 + rand() % 10;
+        for (int i = 0; i < n; ++i)
+            builder.add(1 + rand() % 5, ops[rand() % nOps]);
+        build();
+
+        CigarParser parser(builder.cigar.data(), builder.cigar.size());
+        for (uint32_t pos = 0; pos < index.refLength() + 3; ++pos) {
+            int expected = parser.getSnvPileupOffset(pos);
+            int32_t actual = index.readOffset(pos);
+            if (expected < 0)
+                EXPECT_GT(0, actual) << "iteration " << iter << ", position " << pos;
+            else
+                EXPECT_EQ(expected, actual) << "iteration " << iter << ", position " << pos;
+        }
+    }
+}
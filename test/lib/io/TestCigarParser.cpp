@@ -101,3 +101,29 @@ TEST_F(TestCigarParser, parseWithSoftClipLeft) {
     EXPECT_EQ(12, p.getSnvPileupOffset(4));
     EXPECT_EQ(13, p.getSnvPileupOffset(5));
 }
+
+TEST_F(TestCigarParser, parseWithSkippedRegion) {
+    builder.add(2, BAM_CMATCH);
+    builder.add(5, BAM_CREF_SKIP);
+    builder.add(1, BAM_CINS);
+    builder.add(3, BAM_CMATCH);
+    uint32_t const* cigar = builder.cigar.data();
+    int n = builder.cigar.size();
+
+    CigarParser p(cigar, n);
+
+    EXPECT_EQ(0, p.getSnvPileupOffset(0));
+    EXPECT_EQ(1, p.getSnvPileupOffset(1));
+
+    // reference positions 2-6 are skipped. asking about them must not move
+    // the parser past the following match.
+    for (uint32_t i = 2; i < 7; ++i)
+        EXPECT_EQ(-1, p.getSnvPileupOffset(i)) << "at position " << i;
+
+    EXPECT_EQ(3, p.getSnvPileupOffset(7));
+    EXPECT_EQ(4, p.getSnvPileupOffset(8));
+    EXPECT_EQ(5, p.getSnvPileupOffset(9));
+
+    // past the end of the alignment
+    EXPECT_EQ(-1, p.getSnvPileupOffset(10));
+}
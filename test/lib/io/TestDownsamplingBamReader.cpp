@@ -0,0 +1,252 @@
+#include "io/BamEntry.hpp"
+#include "io/BamIntersector.hpp"
+#include "io/BamReader.hpp"
+#include "io/DownsamplingBamReader.hpp"
+#include "io/Pileup.hpp"
+#include "io/PileupWindow.hpp"
+#include "io/RegionLimitedBamReader.hpp"
+#include "io/SamConvert.hpp"
+#include "utility/TempFile.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    string samHeader = "@SQ\tSN:1\tLN:1000000\n@SQ\tSN:2\tLN:1000000\n";
+
+    string samRead(string const& name, int tid, int pos, int length) {
+        stringstream ss;
+        ss << name << "\t0\t" << tid << "\t" << pos << "\t60\t" << length << "M\t*\t0\t0\t"
+            << string(length, "ACGT"[pos % 4]) << "\t" << string(length, '<') << "\n";
+        return ss.str();
+    }
+
+    // a stack of reads that gets deeper and deeper, then a thin tail, on
+    // both sequences
+    string deepSam() {
+        stringstream ss;
+        ss << samHeader;
+        for (int tid = 1; tid <= 2; ++tid) {
+            for (int pos = 1; pos <= 500; ++pos) {
+                for (int i = 0; i < pos % 40; ++i)
+                    ss << samRead("R" + to_string(tid) + "_" + to_string(pos) + "_" + to_string(i), tid, pos, 50 + i);
+            }
+            for (int pos = 1000; pos < 2000; pos += 100)
+                ss << samRead("T" + to_string(tid) + "_" + to_string(pos), tid, pos, 50);
+        }
+        return ss.str();
+    }
+
+    vector<string> takeNames(BamReaderBase& reader) {
+        vector<string> rv;
+        while (BamEntry* e = reader.take()) {
+            rv.push_back(e->name());
+            BamEntry::release(e);
+        }
+        return rv;
+    }
+
+    // exposes the dropped entries not yet asked about
+    class SpanReader : public DownsamplingBamReader {
+    public:
+        SpanReader(BamReaderBase& source, uint32_t maxDepth, uint32_t seed)
+            : DownsamplingBamReader(source, maxDepth, seed)
+        {
+        }
+
+        using DownsamplingBamReader::droppedSpans_;
+    };
+
+    // read depths by sequence and position
+    typedef map<pair<int, int>, uint32_t> Depths;
+
+    Depths spanDepths(BamReaderBase& reader) {
+        Depths rv;
+        while (BamEntry* e = reader.take()) {
+            for (uint32_t pos = e->start(); pos < e->end(); ++pos)
+                ++rv[make_pair(e->tid(), int(pos))];
+            BamEntry::release(e);
+        }
+        return rv;
+    }
+}
+
+class TestDownsamplingBamReader : public ::testing::Test {
+protected:
+    TempDir tmpdir;
+};
+
+TEST_F(TestDownsamplingBamReader, belowTheCap) {
+    string path = makeIndexedBam(tmpdir, deepSam());
+    BamReader plain(path);
+    BamReader source(path);
+    DownsamplingBamReader reader(source, 10000, 0);
+    EXPECT_EQ(takeNames(plain), takeNames(reader));
+    EXPECT_EQ(0u, reader.dropped());
+    EXPECT_EQ(0u, reader.droppedAt(0, 100));
+    EXPECT_THROW(DownsamplingBamReader(source, 0, 0), invalid_argument);
+}
+
+TEST_F(TestDownsamplingBamReader, capsDepth) {
+    string path = makeIndexedBam(tmpdir, deepSam());
+    BamReader plain(path);
+    Depths full = spanDepths(plain);
+
+    uint32_t const cap = 50;
+    BamReader source(path);
+    DownsamplingBamReader reader(source, cap, 7);
+    Depths kept;
+
+    size_t capped = 0;
+    for (auto i = full.begin(); i != full.end(); ++i) {
+        // as the intersectors do, take the reads starting up to a position
+        // before asking about it
+        BamEntry const* next;
+        while ((next = reader.peek()) && make_pair(next->tid(), int(next->start())) <= i->first) {
+            BamEntry* e = reader.take();
+            for (uint32_t pos = e->start(); pos < e->end(); ++pos)
+                ++kept[make_pair(e->tid(), int(pos))];
+            BamEntry::release(e);
+        }
+
+        uint32_t k = kept.count(i->first) ? kept[i->first] : 0;
+        uint32_t dropped = reader.droppedAt(i->first.first, i->first.second);
+        EXPECT_GE(cap, k) << i->first.first << ":" << i->first.second;
+        EXPECT_EQ(i->second, k + dropped) << i->first.first << ":" << i->first.second;
+        // reads dropped at their start may outlast kept ones, so the
+        // depth can be below the cap where they are
+        capped += dropped > 0;
+    }
+    EXPECT_LT(100u, capped);
+    EXPECT_LT(0u, reader.dropped());
+}
+
+TEST_F(TestDownsamplingBamReader, reproducible) {
+    string path = makeIndexedBam(tmpdir, deepSam());
+    auto sample = [&](uint32_t seed) {
+        BamReader source(path);
+        DownsamplingBamReader reader(source, 20, seed);
+        return takeNames(reader);
+    };
+
+    vector<string> first = sample(1);
+    EXPECT_EQ(first, sample(1));
+    EXPECT_NE(first, sample(2));
+}
+
+TEST_F(TestDownsamplingBamReader, independentOfFileOrder) {
+    // the same reads, those starting together in opposite orders
+    stringstream forward;
+    stringstream backward;
+    forward << samHeader;
+    backward << samHeader;
+    for (int pos = 1; pos < 100; pos += 10) {
+        for (int i = 0; i < 30; ++i) {
+            forward << samRead("F" + to_string(pos) + "_" + to_string(i), 1, pos, 40);
+            backward << samRead("F" + to_string(pos) + "_" + to_string(29 - i), 1, pos, 40);
+        }
+    }
+
+    auto sample = [&](string const& path) {
+        BamReader source(path);
+        DownsamplingBamReader reader(source, 25, 3);
+        vector<string> rv = takeNames(reader);
+        sort(rv.begin(), rv.end());
+        return rv;
+    };
+
+    vector<string> kept = sample(makeIndexedBam(tmpdir, forward.str()));
+    EXPECT_EQ(kept, sample(makeIndexedBam(tmpdir, backward.str())));
+    EXPECT_LT(25u, kept.size());
+    EXPECT_GT(300u, kept.size());
+}
+
+TEST_F(TestDownsamplingBamReader, repositioned) {
+    string path = makeIndexedBam(tmpdir, deepSam());
+    Region region = { 1, 0, 600 };
+    RegionLimitedBamReader source(path, region);
+    DownsamplingBamReader reader(source, 30, 0);
+    vector<string> first = takeNames(reader);
+    ASSERT_LT(0u, first.size());
+    EXPECT_LT(0u, reader.droppedAt(1, 450));
+
+    reader.setRegion(region);
+    EXPECT_EQ(first, takeNames(reader));
+}
+
+TEST_F(TestDownsamplingBamReader, pileupsReportDropped) {
+    string path = makeIndexedBam(tmpdir, deepSam());
+
+    // pileup sizes at each position without downsampling
+    map<int32_t, pair<uint32_t, uint32_t>> full;
+    {
+        BamReader n(path);
+        BamReader t(path);
+        BamIntersector intersector(n, t, [&](int32_t pos, Pileup const& normal, Pileup const& tumor) {
+            if (normal.tid() == 0)
+                full[pos] = make_pair(normal.size(), tumor.size());
+            EXPECT_EQ(0u, normal.dropped());
+        });
+        intersector.run();
+    }
+
+    BamReader n(path);
+    BamReader t(path);
+    DownsamplingBamReader normal(n, 40, 0);
+    DownsamplingBamReader tumor(t, 20, 0);
+    size_t sites = 0;
+    BamIntersector intersector(normal, tumor, [&](int32_t pos, Pileup const& np, Pileup const& tp) {
+        if (np.tid() != 0)
+            return;
+        ++sites;
+        SCOPED_TRACE(pos);
+        EXPECT_GE(40u, np.size());
+        EXPECT_GE(20u, tp.size());
+        EXPECT_EQ(full[pos].first, np.size() + np.dropped());
+        EXPECT_EQ(full[pos].second, tp.size() + tp.dropped());
+    });
+    intersector.run();
+    // positions covered only by dropped reads are no longer sites
+    EXPECT_GE(full.size(), sites);
+    EXPECT_LT(full.size() / 2, sites);
+}
+
+TEST_F(TestDownsamplingBamReader, forgetsDroppedBehind) {
+    // three reads at every position of a long stretch that nothing asks
+    // about, as where the other sample has no coverage
+    int const last = 30000;
+    stringstream ss;
+    ss << samHeader;
+    for (int pos = 1; pos <= last; ++pos) {
+        for (int i = 0; i < 3; ++i)
+            ss << samRead("R" + to_string(pos) + "_" + to_string(i), 1, pos, 50);
+    }
+    string path = makeIndexedBam(tmpdir, ss.str());
+
+    BamReader source(path);
+    SpanReader reader(source, 1, 0);
+    size_t most = 0;
+    size_t kept = 0;
+    while (BamEntry* e = reader.take()) {
+        most = max(most, reader.droppedSpans_.size());
+        ++kept;
+        BamEntry::release(e);
+    }
+    EXPECT_LT(size_t(last), reader.dropped());
+    EXPECT_EQ(size_t(last) * 3, kept + reader.dropped());
+    // at most the three reads at each position over a window and a read
+    EXPECT_GE(3 * (PileupWindow::DEFAULT_WIDTH + 51), most);
+
+    // those near the end are still counted
+    uint32_t depth = reader.droppedAt(0, last);
+    EXPECT_LE(49u * 2, depth);
+    EXPECT_GE(50u * 3, depth);
+}
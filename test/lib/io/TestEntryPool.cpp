@@ -0,0 +1,170 @@
+#include "io/BamEntry.hpp"
+#include "io/BamFilter.hpp"
+#include "io/BamReader.hpp"
+#include "io/EntryPool.hpp"
+#include "io/MappedBamReader.hpp"
+#include "io/SamConvert.hpp"
+#include "utility/TempFile.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    string makeSam(int nReads) {
+        stringstream ss;
+        ss << "@SQ\tSN:1\tLN:10000000\n";
+        for (int i = 0; i < nReads; ++i) {
+            int flag = i % 3 == 0 ? 1024 : 0;
+            ss << "READ" << i << "\t" << flag << "\t1\t" << (i * 10 + 1)
+                << "\t" << (i % 60) << "\t20M\t*\t0\t0\t"
+                << "ACGTACGTACGTACGTACGT\t<<<<<<<<<<<<<<<<<<<<\n";
+        }
+        return ss.str();
+    }
+
+    // exposes the reader's pool
+    template<typename Reader>
+    class PoolReader : public Reader {
+    public:
+        explicit PoolReader(string const& path)
+            : Reader(path)
+        {
+        }
+
+        using Reader::entryPool;
+    };
+
+    vector<string> names(vector<BamEntry*> const& entries) {
+        vector<string> rv;
+        for (auto i = entries.begin(); i != entries.end(); ++i)
+            rv.push_back((*i)->name());
+        return rv;
+    }
+
+    void releaseAll(vector<BamEntry*>& entries) {
+        if (!entries.empty())
+            BamEntry::release(&entries[0], entries.size());
+        entries.clear();
+    }
+}
+
+class TestEntryPool : public ::testing::Test {
+public:
+    void SetUp() {
+        bamPath = makeIndexedBam(tmpdir, makeSam(1000));
+    }
+
+protected:
+    TempDir tmpdir;
+    string bamPath;
+};
+
+TEST_F(TestEntryPool, entriesAreReused) {
+    PoolReader<BamReader> reader(bamPath);
+
+    // a sliding window of live entries, like a pileup buffer
+    vector<BamEntry*> live;
+    size_t count = 0;
+    while (BamEntry* e = reader.take()) {
+        ++count;
+        live.push_back(e);
+        if (live.size() == 10) {
+            BamEntry::release(&live[0], 5);
+            live.erase(live.begin(), live.begin() + 5);
+        }
+    }
+    releaseAll(live);
+
+    EXPECT_EQ(1000u, count);
+    EXPECT_GE(12u, reader.entryPool()->allocated());
+}
+
+TEST_F(TestEntryPool, recycledEntriesAreReset) {
+    BamReader reader(bamPath);
+    BamEntry* e = reader.take();
+    ASSERT_TRUE(e);
+    EXPECT_STREQ("READ0", e->name());
+    BamEntry::release(e);
+
+    e = reader.take();
+    ASSERT_TRUE(e);
+    EXPECT_STREQ("READ1", e->name());
+    EXPECT_EQ(10, e->start());
+    EXPECT_EQ(30u, e->end());
+
+    BamEntry::PileupData pd;
+    ASSERT_TRUE(e->resolveCigar(15, pd));
+    EXPECT_EQ(bam_nt16_table[int('C')], pd.base);
+    BamEntry::release(e);
+}
+
+TEST_F(TestEntryPool, batchedTakeMatchesTake) {
+    BamFilter filter(1024, 10);
+
+    BamReader single(bamPath);
+    single.setFilter(&filter);
+    vector<BamEntry*> expected;
+    while (BamEntry* e = single.take())
+        expected.push_back(e);
+    ASSERT_LT(0u, expected.size());
+
+    BamReader batched(bamPath);
+    batched.setFilter(&filter);
+    vector<BamEntry*> actual;
+    // peek first so the buffered entry has to come out of the batch too
+    ASSERT_TRUE(batched.peek());
+    while (batched.take(actual, 37) == 37)
+        ;
+    EXPECT_EQ(0u, batched.take(actual, 37));
+
+    EXPECT_EQ(names(expected), names(actual));
+    releaseAll(expected);
+    releaseAll(actual);
+}
+
+TEST_F(TestEntryPool, batchedTakeMapped) {
+    BamReader plain(bamPath);
+    vector<BamEntry*> expected;
+    plain.take(expected, 2000);
+    EXPECT_EQ(1000u, expected.size());
+
+    MappedBamReader mapped(bamPath);
+    vector<BamEntry*> actual;
+    while (mapped.take(actual, 64) == 64)
+        ;
+
+    EXPECT_EQ(names(expected), names(actual));
+    releaseAll(expected);
+    releaseAll(actual);
+}
+
+TEST_F(TestEntryPool, entriesOutliveReader) {
+    vector<BamEntry*> entries;
+    {
+        BamReader reader(bamPath);
+        reader.take(entries, 100);
+        // one that is deleted rather than released
+        delete reader.take();
+    }
+
+    ASSERT_EQ(100u, entries.size());
+    EXPECT_STREQ("READ0", entries[0]->name());
+    EXPECT_STREQ("READ99", entries[99]->name());
+    releaseAll(entries);
+}
+
+TEST_F(TestEntryPool, unpooledEntriesAreDeleted) {
+    vector<BamEntry*> entries;
+    entries.push_back(new BamEntry(bam_init1()));
+    {
+        BamReader reader(bamPath);
+        reader.take(entries, 2);
+    }
+    entries.push_back(new BamEntry(bam_init1()));
+    releaseAll(entries);
+}
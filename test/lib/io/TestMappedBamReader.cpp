@@ -0,0 +1,206 @@
+#include "io/BamEntry.hpp"
+#include "io/BamFilter.hpp"
+#include "io/MappedBamReader.hpp"
+#include "io/RegionLimitedBamReader.hpp"
+#include "io/SamConvert.hpp"
+#include "utility/TempFile.hpp"
+#include "utility/ThreadPool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    // long reads with variable sized aux fields so that records straddle the
+    // reader's buffers at all sorts of offsets
+    string makeSam(int nReads) {
+        stringstream ss;
+        ss << "@SQ\tSN:1\tLN:10000000\n"
+           << "@SQ\tSN:2\tLN:10000000\n";
+        srand(11);
+        for (int i = 0; i < nReads; ++i) {
+            int tid = i < nReads / 2 ? 1 : 2;
+            int flag = i % 5 == 0 ? 1024 : 0;
+            ss << "READ" << i << "\t" << flag << "\t" << tid << "\t" << (i * 50 + 1)
+                << "\t" << (i % 60) << "\t100M20N100M\t*\t0\t0\t";
+            for (int j = 0; j < 200; ++j)
+                ss << "ACGT"[rand() % 4];
+            ss << "\t";
+            for (int j = 0; j < 200; ++j)
+                ss << char('!' + rand() % 40);
+            ss << "\tXX:Z:";
+            for (int j = rand() % 300; j >= 0; --j)
+                ss << char('a' + rand() % 26);
+            ss << "\n";
+        }
+        return ss.str();
+    }
+
+    // fully owned copies of records read through samtools
+    vector<bam1_t*> samtoolsRecords(BamReaderBase& reader) {
+        vector<bam1_t*> rv;
+        while (BamEntry* e = reader.take()) {
+            rv.push_back(bam_dup1(e->rawData()));
+            delete e;
+        }
+        return rv;
+    }
+
+    void expectSameRecord(bam1_t const* expected, BamEntry const* actual) {
+        bam1_t const* b = actual->rawData();
+        EXPECT_EQ(0, memcmp(&expected->core, &b->core, sizeof(bam1_core_t)));
+        ASSERT_EQ(expected->data_len, b->data_len);
+        EXPECT_EQ(expected->l_aux, b->l_aux);
+        EXPECT_EQ(0, memcmp(expected->data, b->data, expected->data_len));
+        EXPECT_EQ(bam_calend(&expected->core, bam1_cigar(expected)), actual->end());
+    }
+
+    void destroyAll(vector<bam1_t*>& records) {
+        for (auto i = records.begin(); i != records.end(); ++i)
+            bam_destroy1(*i);
+        records.clear();
+    }
+}
+
+class TestMappedBamReader : public ::testing::Test {
+public:
+    void SetUp() {
+        bamPath = makeIndexedBam(tmpdir, makeSam(8000));
+    }
+
+    void checkWholeFile(ThreadPool* pool) {
+        BamFilter filter(BAM_DEF_MASK, 10);
+        BamReader plain(bamPath);
+        plain.setFilter(&filter);
+        vector<bam1_t*> expected = samtoolsRecords(plain);
+        ASSERT_LT(4000u, expected.size());
+
+        MappedBamReader reader(bamPath, pool);
+        reader.setFilter(&filter);
+        EXPECT_FALSE(reader.region());
+        EXPECT_EQ(2, reader.header()->n_targets);
+        EXPECT_EQ(bamPath, reader.path());
+
+        // hold on to every 100th entry for the whole run. they must survive
+        // their buffers being left behind.
+        vector<BamEntry*> held;
+        for (size_t i = 0; i < expected.size(); ++i) {
+            BamEntry* e = reader.take();
+            ASSERT_TRUE(e) << "record " << i;
+            expectSameRecord(expected[i], e);
+            if (i % 100 == 0)
+                held.push_back(e);
+            else
+                delete e;
+        }
+        EXPECT_FALSE(reader.peek());
+        EXPECT_FALSE(reader.take());
+
+        for (size_t i = 0; i < held.size(); ++i) {
+            expectSameRecord(expected[i * 100], held[i]);
+            delete held[i];
+        }
+        destroyAll(expected);
+    }
+
+protected:
+    TempDir tmpdir;
+    string bamPath;
+};
+
+TEST_F(TestMappedBamReader, wholeFile) {
+    checkWholeFile(0);
+}
+
+TEST_F(TestMappedBamReader, wholeFileWithPool) {
+    ThreadPool pool(3);
+    checkWholeFile(&pool);
+}
+
+TEST_F(TestMappedBamReader, entriesOutliveReader) {
+    BamReader plain(bamPath);
+    BamEntry* expected = plain.take();
+
+    BamEntry* e;
+    {
+        MappedBamReader reader(bamPath);
+        e = reader.take();
+        // and a peeked entry, which the reader cleans up
+        EXPECT_TRUE(reader.peek());
+    }
+    expectSameRecord(expected->rawData(), e);
+    delete e;
+    delete expected;
+}
+
+TEST_F(TestMappedBamReader, regions) {
+    ThreadPool pool(2);
+    char const* regions[] = {
+        "1", "2", "1:100000-100300", "2:1-10", "1:499990-500500", "2:300000-350000"
+    };
+    for (size_t i = 0; i < sizeof(regions)/sizeof(regions[0]); ++i) {
+        RegionLimitedBamReader plain(bamPath, regions[i]);
+        vector<bam1_t*> expected = samtoolsRecords(plain);
+
+        MappedBamReader reader(bamPath, regions[i], i % 2 ? &pool : 0);
+        ASSERT_TRUE(reader.region());
+        EXPECT_EQ(plain.region()->tid, reader.region()->tid);
+        EXPECT_EQ(plain.region()->beg, reader.region()->beg);
+        EXPECT_EQ(plain.region()->end, reader.region()->end);
+
+        for (size_t j = 0; j < expected.size(); ++j) {
+            unique_ptr<BamEntry> e(reader.take());
+            ASSERT_TRUE(e.get()) << regions[i] << " record " << j;
+            expectSameRecord(expected[j], e.get());
+        }
+        EXPECT_FALSE(reader.take()) << regions[i];
+        destroyAll(expected);
+    }
+}
+
+TEST_F(TestMappedBamReader, setRegion) {
+    Region region = { 1, 300000, 300500 };
+    RegionLimitedBamReader plain(bamPath, region);
+    MappedBamReader reader(bamPath, region);
+
+    // backwards, forwards, and to the other sequence, leaving a peeked entry
+    // behind each time
+    int begs[][2] = { {1, 300000}, {1, 250000}, {1, 380000}, {0, 20000}, {0, 20100} };
+    for (size_t i = 0; i < sizeof(begs)/sizeof(begs[0]); ++i) {
+        region.tid = begs[i][0];
+        region.beg = begs[i][1];
+        region.end = region.beg + 2000;
+        plain.setRegion(region);
+        reader.setRegion(region);
+        vector<bam1_t*> expected = samtoolsRecords(plain);
+        ASSERT_FALSE(expected.empty());
+
+        for (size_t j = 0; j < expected.size(); ++j) {
+            unique_ptr<BamEntry> e(reader.take());
+            ASSERT_TRUE(e.get());
+            expectSameRecord(expected[j], e.get());
+        }
+        EXPECT_FALSE(reader.take());
+        destroyAll(expected);
+
+        plain.setRegion(region);
+        reader.setRegion(region);
+        EXPECT_TRUE(reader.peek());
+    }
+
+    region.tid = 2;
+    EXPECT_THROW(reader.setRegion(region), runtime_error);
+}
+
+TEST_F(TestMappedBamReader, notBam) {
+    auto samFile = tmpdir.tempFile(makeSam(10));
+    EXPECT_THROW(MappedBamReader(samFile->path()), runtime_error);
+}
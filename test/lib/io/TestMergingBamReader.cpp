@@ -0,0 +1,196 @@
+#include "io/BamEntry.hpp"
+#include "io/BamFilter.hpp"
+#include "io/BamReader.hpp"
+#include "io/MergingBamReader.hpp"
+#include "io/RegionLimitedBamReader.hpp"
+#include "io/SamConvert.hpp"
+#include "utility/TempFile.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    string const samHeader = "@SQ\tSN:1\tLN:1000000\n@SQ\tSN:2\tLN:1000000\n";
+
+    // the reads of lane out of nLanes: overlapping, with duplicates and
+    // reads starting together across lanes, and unmapped reads at the end
+    string laneSam(int lane, int nLanes, int nReads) {
+        stringstream ss;
+        ss << samHeader;
+        for (int i = lane; i < nReads; i += nLanes) {
+            int tid = i < nReads / 2 ? 1 : 2;
+            int pos = (i % (nReads / 2)) * 20 / nLanes * nLanes + 1;
+            int flag = i % 7 == 0 ? 1024 : 0;
+            ss << "L" << lane << "_" << i << "\t" << flag << "\t" << tid << "\t" << pos
+                << "\t60\t30M\t*\t0\t0\t" << string(30, 'A') << "\t" << string(30, '<') << "\n";
+        }
+        for (int i = 0; i < 3; ++i)
+            ss << "U" << lane << "_" << i << "\t4\t*\t0\t0\t*\t*\t0\t0\tACGT\t<<<<\n";
+        return ss.str();
+    }
+
+    struct Read {
+        uint32_t tid;
+        uint32_t start;
+        uint32_t end;
+        size_t lane;
+        string name;
+
+        bool operator<(Read const& rhs) const {
+            return tie(tid, start) < tie(rhs.tid, rhs.start);
+        }
+    };
+
+    vector<Read> takeReads(BamReaderBase& reader, size_t lane = 0) {
+        vector<Read> rv;
+        while (BamEntry* e = reader.take()) {
+            Read r = { uint32_t(e->tid()), uint32_t(e->start()), e->end(), lane, e->name() };
+            rv.push_back(r);
+            BamEntry::release(e);
+        }
+        return rv;
+    }
+
+    vector<string> names(vector<Read> const& reads) {
+        vector<string> rv;
+        for (auto i = reads.begin(); i != reads.end(); ++i)
+            rv.push_back(i->name);
+        return rv;
+    }
+}
+
+class TestMergingBamReader : public ::testing::Test {
+public:
+    void SetUp() {
+        for (int lane = 0; lane < 3; ++lane)
+            lanes.push_back(makeIndexedBam(tmpdir, laneSam(lane, 3, 30000)));
+    }
+
+    // the reads of every lane, in the order a merge should give them
+    vector<Read> expected(BamFilter* filter) {
+        vector<Read> rv;
+        for (size_t i = 0; i < lanes.size(); ++i) {
+            BamReader reader(lanes[i]);
+            reader.setFilter(filter);
+            vector<Read> reads = takeReads(reader, i);
+            rv.insert(rv.end(), reads.begin(), reads.end());
+        }
+        // lanes are sorted and appended in order, so ties go to the
+        // earlier lane
+        stable_sort(rv.begin(), rv.end());
+        return rv;
+    }
+
+    template<typename Open>
+    unique_ptr<MergingBamReader> merge(Open open, BamFilter* filter = 0) {
+        vector<unique_ptr<BamReaderBase>> sources;
+        for (auto i = lanes.begin(); i != lanes.end(); ++i) {
+            sources.emplace_back(open(*i));
+            sources.back()->setFilter(filter);
+        }
+        return unique_ptr<MergingBamReader>(new MergingBamReader(move(sources)));
+    }
+
+protected:
+    TempDir tmpdir;
+    vector<string> lanes;
+};
+
+TEST_F(TestMergingBamReader, mergesInOrder) {
+    auto open = [](string const& path) { return new BamReader(path); };
+    vector<Read> all = expected(0);
+    // unmapped reads come last
+    ASSERT_EQ(uint32_t(-1), all.back().tid);
+
+    auto reader = merge(open);
+    EXPECT_EQ(lanes[0] + "," + lanes[1] + "," + lanes[2], reader->path());
+    EXPECT_STREQ("2", reader->targetName(1));
+    EXPECT_EQ(names(all), names(takeReads(*reader)));
+    EXPECT_FALSE(reader->take());
+
+    // filtered by the sources
+    BamFilter filter(BAM_DEF_MASK, 0);
+    vector<Read> kept = expected(&filter);
+    ASSERT_LT(20000u, kept.size());
+    ASSERT_GT(all.size(), kept.size());
+    reader = merge(open, &filter);
+    EXPECT_EQ(names(kept), names(takeReads(*reader)));
+}
+
+TEST_F(TestMergingBamReader, singleSource) {
+    vector<unique_ptr<BamReaderBase>> sources;
+    sources.emplace_back(new BamReader(lanes[1]));
+    MergingBamReader reader(move(sources));
+
+    BamReader plain(lanes[1]);
+    EXPECT_EQ(names(takeReads(plain)), names(takeReads(reader)));
+    EXPECT_THROW(MergingBamReader(vector<unique_ptr<BamReaderBase>>()), invalid_argument);
+}
+
+TEST_F(TestMergingBamReader, regionLimited) {
+    Region region = { 1, 100000, 150000 };
+    vector<Read> inRegion;
+    vector<Read> all = expected(0);
+    for (auto i = all.begin(); i != all.end(); ++i) {
+        if (i->tid == uint32_t(region.tid) && i->start < uint32_t(region.end) && i->end > uint32_t(region.beg))
+            inRegion.push_back(*i);
+    }
+    ASSERT_LT(100u, inRegion.size());
+
+    auto reader = merge([&](string const& path) { return new RegionLimitedBamReader(path, region); });
+    ASSERT_TRUE(reader->region());
+    EXPECT_EQ(region.beg, reader->region()->beg);
+    EXPECT_EQ(names(inRegion), names(takeReads(*reader)));
+
+    // again, after part of it has been read
+    reader->setRegion(region);
+    BamEntry::release(reader->take());
+    reader->peek();
+    reader->setRegion(region);
+    EXPECT_EQ(names(inRegion), names(takeReads(*reader)));
+}
+
+TEST_F(TestMergingBamReader, skipTo) {
+    vector<Read> all = expected(0);
+    auto reader = merge([](string const& path) { return new BamReader(path); });
+
+    for (int i = 0; i < 10; ++i)
+        BamEntry::release(reader->take());
+    ASSERT_TRUE(reader->peek());
+
+    int32_t const pos = 250000;
+    ASSERT_TRUE(reader->skipTo(0, pos));
+    vector<Read> rest = takeReads(*reader);
+    EXPECT_TRUE(is_sorted(rest.begin(), rest.end()));
+    EXPECT_GT(all.size() * 2 / 3, rest.size());
+
+    // everything covering pos or after it is still there
+    vector<string> restNames = names(rest);
+    set<string> seen(restNames.begin(), restNames.end());
+    for (auto i = all.begin(); i != all.end(); ++i) {
+        if (i->tid > 0 || i->end > uint32_t(pos)) {
+            EXPECT_TRUE(seen.count(i->name)) << i->name;
+        }
+    }
+}
+
+TEST_F(TestMergingBamReader, differentSequences) {
+    string other = makeIndexedBam(tmpdir,
+        "@SQ\tSN:1\tLN:1000000\n@SQ\tSN:2\tLN:999999\n"
+        "READ1\t0\t1\t1\t60\t4M\t*\t0\t0\tACGT\t<<<<\n");
+    vector<unique_ptr<BamReaderBase>> sources;
+    sources.emplace_back(new BamReader(lanes[0]));
+    sources.emplace_back(new BamReader(other));
+    EXPECT_THROW(MergingBamReader(move(sources)), invalid_argument);
+}
@@ -4,6 +4,7 @@
 #include "utility/TempFile.hpp"
 
 #include <gtest/gtest.h>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <memory>
@@ -110,6 +111,41 @@ TEST_F(TestPileupBuffer, clearBefore) {
     ASSERT_EQ(0u, pb.size());
 }
 
+TEST_F(TestPileupBuffer, clearBeforeLongRead) {
+    // a spliced read spanning everything after it
+    stringstream sam;
+    sam << "@SQ\tSN:1\tLN:247249719\n"
+        << "SPLICED\t0\t1\t1\t60\t2M100000N2M\t*\t0\t0\tACGT\t<<<<\n";
+    for (int i = 0; i < 200; ++i) {
+        sam << "READ" << i << "\t0\t1\t" << (i * 10 + 2)
+            << "\t60\t4M\t*\t0\t0\tACGT\t<<<<\n";
+    }
+
+    auto samFile = tmpdir.tempFile(sam.str());
+    BamReader reader(samFile->path());
+
+    PileupBuffer pb;
+    while (BamEntry* e = reader.take())
+        ASSERT_TRUE(pb.push(e));
+    ASSERT_EQ(201u, pb.size());
+
+    // the short reads behind the spliced one go, but it stays in front
+    pb.clearBefore(0, 1000);
+    EXPECT_EQ(101u, pb.size());
+    EXPECT_EQ(0, pb.front()->start());
+    EXPECT_EQ(100004u, pb.end());
+
+    unique_ptr<Pileup> p(pb.pileup(1001));
+    ASSERT_EQ(1u, p->size());
+    EXPECT_EQ(bam_nt16_table[int('A')], (*p)[0].base);
+
+    pb.clearBefore(0, 1994);
+    EXPECT_EQ(2u, pb.size());
+    pb.clearBefore(0, 100004);
+    EXPECT_TRUE(pb.empty());
+    EXPECT_EQ(0u, pb.end());
+}
+
 TEST_F(TestPileupBuffer, cmpOverlap) {
     int32_t start = 0;
     uint32_t end = 0;
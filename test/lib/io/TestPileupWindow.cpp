@@ -0,0 +1,179 @@
+#include "io/BamReader.hpp"
+#include "io/Pileup.hpp"
+#include "io/PileupBuffer.hpp"
+#include "io/PileupWindow.hpp"
+#include "utility/TempFile.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+namespace {
+    // reads with soft clips, insertions, deletions and skipped regions, all
+    // overlapping the first one so that a PileupBuffer takes them all
+    const string sam =
+        "@SQ\tSN:1\tLN:247249719\n"
+        "READ1\t0\t1\t2\t60\t2S6M2I4M\t*\t0\t0\tGGACGTACTTACGT\tABCDEFGHIJKLMN\n"
+        "READ2\t0\t1\t3\t60\t3M2D3M\t*\t0\t0\tCATCAT\t!!!!!!\n"
+        "READ3\t0\t1\t5\t60\t2M5N4M1S\t*\t0\t0\tTTGGGGA\tabcdefg\n"
+        "READ4\t0\t1\t6\t60\t1M\t*\t0\t0\tN\t5\n"
+        "READ5\t0\t1\t7\t60\t4=2X\t*\t0\t0\tACGTAC\t012345\n"
+        ;
+}
+
+class TestPileupWindow : public testing::Test {
+public:
+    void SetUp() {
+        samFile = tmpdir.tempFile(sam);
+        reader.reset(new BamReader(samFile->path()));
+        while (BamEntry* e = reader->take())
+            ASSERT_TRUE(buffer.push(e));
+        ASSERT_EQ(5u, buffer.size());
+    }
+
+    void expectSame(Pileup const& expected, Pileup const& actual) {
+        ASSERT_EQ(expected.size(), actual.size());
+        for (uint32_t i = 0; i < expected.size(); ++i) {
+            EXPECT_EQ(expected[i].base, actual[i].base);
+            EXPECT_EQ(expected[i].quality, actual[i].quality);
+        }
+    }
+
+protected:
+    TempDir tmpdir;
+    unique_ptr<TempFile> samFile;
+    unique_ptr<BamReader> reader;
+    PileupBuffer buffer;
+};
+
+TEST_F(TestPileupWindow, matchesSinglePositions) {
+    PileupWindow window;
+    window.fill(buffer, 0, 30);
+    EXPECT_EQ(0u, window.begin());
+    EXPECT_EQ(30u, window.end());
+
+    for (uint32_t pos = 0; pos < 30; ++pos) {
+        unique_ptr<Pileup> expected(buffer.pileup(pos));
+        SCOPED_TRACE(pos);
+        expectSame(*expected, window.column(pos));
+    }
+}
+
+TEST_F(TestPileupWindow, partialWindows) {
+    unique_ptr<Pileup> expected(buffer.pileup(7));
+
+    // windows that cut through every read in different places
+    for (uint32_t begin = 0; begin <= 7; ++begin) {
+        for (uint32_t end = 8; end < 20; ++end) {
+            PileupWindow window;
+            window.fill(buffer, begin, end);
+            expectSame(*expected, window.column(7));
+        }
+    }
+}
+
+TEST_F(TestPileupWindow, columns) {
+    PileupWindow window;
+    window.fill(buffer, 0, 20);
+
+    // READ2 is in its deletion; READ4's N counts as every base
+    Pileup const& p = window.column(5);
+    EXPECT_EQ(0, p.tid());
+    ASSERT_EQ(3u, p.size());
+    EXPECT_EQ('A', bam_nt16_rev_table[p[0].base]);
+    EXPECT_EQ('G', p[0].quality + 33);
+    EXPECT_EQ('T', bam_nt16_rev_table[p[1].base]);
+    EXPECT_EQ('b', p[1].quality + 33);
+    EXPECT_EQ('N', bam_nt16_rev_table[p[2].base]);
+    EXPECT_EQ('5', p[2].quality + 33);
+
+    int counts[4];
+    p.baseCounts(counts);
+    EXPECT_EQ(2, counts[0]);
+    EXPECT_EQ(1, counts[1]);
+    EXPECT_EQ(1, counts[2]);
+    EXPECT_EQ(2, counts[3]);
+
+    // READ1 is past its insertion, READ2 past its deletion and READ3 is in
+    // its skipped region
+    Pileup const& q = window.column(9);
+    ASSERT_EQ(3u, q.size());
+    EXPECT_EQ('G', bam_nt16_rev_table[q[0].base]);
+    EXPECT_EQ('M', q[0].quality + 33);
+    EXPECT_EQ('T', bam_nt16_rev_table[q[1].base]);
+    EXPECT_EQ('!', q[1].quality + 33);
+    EXPECT_EQ('T', bam_nt16_rev_table[q[2].base]);
+    EXPECT_EQ('3', q[2].quality + 33);
+
+    q.baseCounts(counts);
+    EXPECT_EQ(0, counts[0]);
+    EXPECT_EQ(0, counts[1]);
+    EXPECT_EQ(1, counts[2]);
+    EXPECT_EQ(2, counts[3]);
+    EXPECT_EQ(2u, q.readsMatching(bam_nt16_table[int('T')], 0));
+    EXPECT_EQ(1u, q.readsMatching(bam_nt16_table[int('T')], 10));
+    EXPECT_EQ(1u, q.readsMatching(bam_nt16_table[int('G')], 44));
+    EXPECT_EQ(0u, q.readsMatching(bam_nt16_table[int('G')], 45));
+
+    EXPECT_TRUE(window.column(0).empty());
+    EXPECT_TRUE(window.column(19).empty());
+}
+
+TEST_F(TestPileupWindow, masked) {
+    PileupWindow full;
+    full.fill(buffer, 0, 20);
+
+    // every third column
+    uint8_t mask[20] = {0};
+    for (int i = 0; i < 20; i += 3)
+        mask[i] = 1;
+
+    PileupWindow window;
+    window.collect(buffer, 0, 20);
+    window.build(mask);
+    for (uint32_t pos = 0; pos < 20; ++pos) {
+        SCOPED_TRACE(pos);
+        if (mask[pos])
+            expectSame(full.column(pos), window.column(pos));
+        else
+            EXPECT_TRUE(window.column(pos).empty());
+    }
+}
+
+TEST_F(TestPileupWindow, markCandidates) {
+    PileupWindow window;
+    window.collect(buffer, 0, 20);
+
+    // all T but for a C at 8, and only 15 bases long
+    uint8_t ref[20];
+    fill(ref, ref + 20, bam_nt16_table[int('T')]);
+    ref[8] = bam_nt16_table[int('C')];
+    uint8_t candidates[20] = {0};
+    window.markCandidates(ref, 15, 0, candidates);
+
+    // compare against the built columns
+    PileupWindow full;
+    full.fill(buffer, 0, 20);
+    uint32_t kept = 0;
+    for (uint32_t pos = 0; pos < 20; ++pos) {
+        SCOPED_TRACE(pos);
+        Pileup const& p = full.column(pos);
+        bool differs = pos >= 15;
+        for (uint32_t i = 0; i < p.size(); ++i)
+            differs |= p[i].base != ref[pos];
+        EXPECT_EQ(differs, candidates[pos] != 0);
+        kept += candidates[pos];
+    }
+    EXPECT_LT(5u, kept);
+    EXPECT_GT(20u, kept);
+
+    // every quality is below 100
+    uint8_t lowQuality[20] = {0};
+    window.markCandidates(ref, 20, 100, lowQuality);
+    for (uint32_t pos = 0; pos < 20; ++pos)
+        EXPECT_EQ(!full.column(pos).empty(), lowQuality[pos] != 0) << "position " << pos;
+}
@@ -0,0 +1,110 @@
+#include "io/BamEntry.hpp"
+#include "io/BamFilter.hpp"
+#include "io/BamReader.hpp"
+#include "io/PipelinedBamReader.hpp"
+#include "io/RegionLimitedBamReader.hpp"
+#include "io/SamConvert.hpp"
+#include "utility/TempFile.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    string makeSam(int nReads) {
+        stringstream ss;
+        ss << "@SQ\tSN:1\tLN:1000000\n"
+           << "@SQ\tSN:2\tLN:1000000\n";
+        for (int i = 0; i < nReads; ++i) {
+            int tid = i < nReads / 2 ? 1 : 2;
+            // every 7th read is a duplicate so the filter has work to do
+            int flag = i % 7 == 0 ? 1024 : 0;
+            ss << "READ" << i << "\t" << flag << "\t" << tid << "\t" << (i * 10 + 1)
+                << "\t60\t4M\t*\t0\t0\tACGT\t<<<<\n";
+        }
+        return ss.str();
+    }
+
+    vector<string> readNames(BamReaderBase& reader) {
+        vector<string> rv;
+        BamEntry* e;
+        while ((e = reader.take())) {
+            rv.push_back(e->name());
+            delete e;
+        }
+        return rv;
+    }
+}
+
+class TestPipelinedBamReader : public ::testing::Test {
+public:
+    void SetUp() {
+        bamPath = makeIndexedBam(tmpdir, makeSam(1000));
+    }
+
+protected:
+    TempDir tmpdir;
+    string bamPath;
+};
+
+TEST_F(TestPipelinedBamReader, sameEntriesAsSource) {
+    BamFilter filter(BAM_DEF_MASK, 0);
+
+    BamReader plain(bamPath);
+    plain.setFilter(&filter);
+    vector<string> expected = readNames(plain);
+    ASSERT_EQ(857u, expected.size());
+
+    BamReader source(bamPath);
+    source.setFilter(&filter);
+    // small batches and queue to force plenty of handoffs
+    PipelinedBamReader reader(source, 3, 2);
+    EXPECT_EQ(source.header(), reader.header());
+    EXPECT_EQ(bamPath, reader.path());
+    EXPECT_FALSE(reader.region());
+
+    BamEntry* e = reader.peek();
+    ASSERT_TRUE(e);
+    EXPECT_EQ(expected[0], e->name());
+
+    EXPECT_EQ(expected, readNames(reader));
+    EXPECT_FALSE(reader.take());
+    EXPECT_EQ(286u, reader.queueStats().pushes);
+}
+
+TEST_F(TestPipelinedBamReader, regionLimited) {
+    RegionLimitedBamReader source(bamPath, "2:5001-5100");
+    PipelinedBamReader reader(source, 4, 4);
+    ASSERT_TRUE(reader.region());
+    EXPECT_EQ(1, reader.region()->tid);
+
+    vector<string> names = readNames(reader);
+    ASSERT_EQ(10u, names.size());
+    EXPECT_EQ("READ500", names.front());
+    EXPECT_EQ("READ509", names.back());
+}
+
+TEST_F(TestPipelinedBamReader, stopEarly) {
+    BamReader source(bamPath);
+    {
+        // the decode thread is blocked on a full queue when the reader is
+        // destroyed
+        PipelinedBamReader reader(source, 1, 1);
+        delete reader.take();
+    }
+    {
+        PipelinedBamReader reader(source, 1, 1);
+        // never started
+    }
+}
+
+TEST_F(TestPipelinedBamReader, invalidSizes) {
+    BamReader source(bamPath);
+    EXPECT_THROW(PipelinedBamReader(source, 0, 1), invalid_argument);
+    EXPECT_THROW(PipelinedBamReader(source, 1, 0), invalid_argument);
+}
@@ -0,0 +1,175 @@
+#include "io/BamEntry.hpp"
+#include "io/BamReader.hpp"
+#include "io/ReadSlab.hpp"
+#include "utility/TempFile.hpp"
+
+#include <gtest/gtest.h>
+
+#include <deque>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    // clips, insertions, deletions and skipped regions, some of them moving
+    // the aligned bases to the other half of a packed byte
+    const string sam =
+        "@SQ\tSN:1\tLN:247249719\n"
+        "READ1\t0\t1\t2\t60\t2S6M2I4M\t*\t0\t0\tGGACGTACTTACGT\tABCDEFGHIJKLMN\n"
+        "READ2\t0\t1\t3\t60\t3M2D3M\t*\t0\t0\tCATCAT\t!!!!!!\n"
+        "READ3\t0\t1\t5\t60\t2M5N4M1S\t*\t0\t0\tTTGGGGA\tabcdefg\n"
+        "READ4\t0\t1\t6\t60\t1M\t*\t0\t0\tN\t5\n"
+        "READ5\t0\t1\t7\t60\t4=2X\t*\t0\t0\tACGTAC\t012345\n"
+        "READ6\t0\t1\t8\t60\t1S5M1I3M\t*\t0\t0\tTACGTAGCAT\t+5?I+5?I+5\n"
+        "READ7\t0\t1\t9\t60\t3S1M1I2M2I1M\t*\t0\t0\tGGGACCGTTA\t!#%')+-/13\n"
+        ;
+
+    // the base and quality packed for reference position pos, if any
+    bool packedBase(PackedRead const& read, uint32_t pos, int& base, int& quality) {
+        uint32_t offset = pos - read.start();
+        for (uint32_t i = 0; i < read.nSegments(); ++i) {
+            PackedRead::Segment const& seg = read.segments()[i];
+            if (offset >= seg.refOffset && offset < seg.refOffset + seg.length) {
+                uint32_t readPos = seg.readPos + offset - seg.refOffset;
+                base = read.base(readPos);
+                quality = read.qualities()[readPos];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    string repeatedSam(int nReads) {
+        stringstream ss;
+        ss << "@SQ\tSN:1\tLN:10000000\n";
+        for (int i = 0; i < nReads; ++i) {
+            ss << "READ" << i << "\t0\t1\t" << (i + 1) << "\t60\t20M\t*\t0\t0\t"
+                << "ACGTACGTACGTACGTACGT\t<<<<<<<<<<<<<<<<<<<<\n";
+        }
+        return ss.str();
+    }
+}
+
+class TestReadSlab : public ::testing::Test {
+public:
+    vector<BamEntry*> readAll(string const& text) {
+        files.push_back(tmpdir.tempFile(text));
+        BamReader reader(files.back()->path());
+        vector<BamEntry*> rv;
+        while (BamEntry* e = reader.take())
+            rv.push_back(e);
+        return rv;
+    }
+
+    void TearDown() {
+        for (auto i = entries.begin(); i != entries.end(); ++i)
+            BamEntry::release(*i);
+    }
+
+protected:
+    TempDir tmpdir;
+    vector<unique_ptr<TempFile>> files;
+    vector<BamEntry*> entries;
+};
+
+TEST_F(TestReadSlab, packsAlignedBases) {
+    entries = readAll(sam);
+    ASSERT_EQ(7u, entries.size());
+
+    ReadSlab slab;
+    for (auto e = entries.begin(); e != entries.end(); ++e) {
+        SCOPED_TRACE((*e)->name());
+        PackedRead const* read = slab.add(**e, 0);
+        EXPECT_EQ((*e)->tid(), read->tid());
+        EXPECT_EQ((*e)->start(), read->start());
+        EXPECT_EQ((*e)->end(), read->end());
+
+        uint32_t aligned = 0;
+        for (uint32_t pos = read->start(); pos < read->end(); ++pos) {
+            BamEntry::PileupData pd;
+            int base;
+            int quality;
+            bool expected = (*e)->resolveCigar(pos, pd);
+            ASSERT_EQ(expected, packedBase(*read, pos, base, quality)) << "position " << pos;
+            if (expected) {
+                EXPECT_EQ(pd.base, base) << "position " << pos;
+                EXPECT_EQ(pd.quality, quality) << "position " << pos;
+                ++aligned;
+            }
+        }
+        EXPECT_EQ(aligned, read->length());
+    }
+
+    PackedRead const* spliced = slab.add(*entries[2], 0);
+    ASSERT_EQ(2u, spliced->nSegments());
+    EXPECT_EQ(7u, spliced->segments()[1].refOffset);
+    EXPECT_EQ(2u, spliced->segments()[1].readPos);
+    EXPECT_EQ(uint32_t('c' - 33), spliced->segments()[1].minQuality);
+}
+
+TEST_F(TestReadSlab, masksLowQualities) {
+    entries = readAll(sam);
+
+    // READ6: qualities 10, 20, 30 and 40 over and over
+    int const minQual = 25;
+    ReadSlab slab;
+    PackedRead const* read = slab.add(*entries[5], minQual);
+    ASSERT_EQ(2u, read->nSegments());
+    for (uint32_t i = 0; i < read->length(); ++i) {
+        int q = read->qualities()[i];
+        EXPECT_TRUE(q == 0 || q >= minQual) << "base " << i;
+    }
+    EXPECT_EQ(0u, read->segments()[0].minQuality);
+
+    // the bases are kept
+    PackedRead const* unmasked = slab.add(*entries[5], 0);
+    for (uint32_t i = 0; i < read->length(); ++i)
+        EXPECT_EQ(unmasked->base(i), read->base(i)) << "base " << i;
+    EXPECT_EQ(10u, unmasked->segments()[0].minQuality);
+}
+
+TEST_F(TestReadSlab, reusesBlocks) {
+    entries = readAll(repeatedSam(5000));
+
+    // a window of live records sliding along, as in a pileup buffer
+    ReadSlab slab(512);
+    deque<PackedRead const*> live;
+    for (auto e = entries.begin(); e != entries.end(); ++e) {
+        live.push_back(slab.add(**e, 0));
+        if (live.size() > 20) {
+            slab.remove(live.front());
+            live.pop_front();
+        }
+    }
+    size_t blocks = slab.blocks();
+    EXPECT_GT(10u, blocks);
+
+    // the last records are intact
+    int base;
+    int quality;
+    ASSERT_TRUE(packedBase(*live.back(), 4999 + 4, base, quality));
+    EXPECT_EQ(bam_nt16_table[int('A')], base);
+    EXPECT_EQ('<' - 33, quality);
+
+    slab.clear();
+    for (int i = 0; i < 100; ++i)
+        slab.remove(slab.add(*entries[i], 0));
+    EXPECT_EQ(blocks, slab.blocks());
+}
+
+TEST_F(TestReadSlab, largerThanABlock) {
+    entries = readAll(sam);
+    ReadSlab slab(16);
+    vector<PackedRead const*> reads;
+    for (auto e = entries.begin(); e != entries.end(); ++e)
+        reads.push_back(slab.add(**e, 0));
+
+    for (size_t i = 0; i < reads.size(); ++i) {
+        EXPECT_EQ(entries[i]->start(), reads[i]->start());
+        EXPECT_EQ(entries[i]->end(), reads[i]->end());
+    }
+    EXPECT_EQ(reads.size(), slab.blocks());
+}
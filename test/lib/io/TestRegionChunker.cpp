@@ -0,0 +1,57 @@
+#include "io/RegionChunker.hpp"
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    Region makeRegion(int tid, int beg, int end) {
+        Region r;
+        r.tid = tid;
+        r.beg = beg;
+        r.end = end;
+        return r;
+    }
+}
+
+TEST(TestRegionChunker, chunks) {
+    vector<Region> regions;
+    regions.push_back(makeRegion(0, 0, 25));
+    regions.push_back(makeRegion(1, 5, 15));
+    regions.push_back(makeRegion(2, 0, 0));
+    regions.push_back(makeRegion(3, 3, 4));
+
+    // the empty region on tid 2 produces no chunks
+    vector<Region> chunks = chunkRegions(regions, 10);
+    ASSERT_EQ(5u, chunks.size());
+
+    int expected[][3] = {
+        {0, 0, 10},
+        {0, 10, 20},
+        {0, 20, 25},
+        {1, 5, 15},
+        {3, 3, 4}
+    };
+    int const nExpected = sizeof(expected)/sizeof(expected[0]);
+    for (int i = 0; i < nExpected; ++i) {
+        EXPECT_EQ(expected[i][0], chunks[i].tid) << "chunk " << i;
+        EXPECT_EQ(expected[i][1], chunks[i].beg) << "chunk " << i;
+        EXPECT_EQ(expected[i][2], chunks[i].end) << "chunk " << i;
+    }
+}
+
+TEST(TestRegionChunker, hugeChunk) {
+    vector<Region> regions(1, makeRegion(0, 10, 2000000000));
+    vector<Region> chunks = chunkRegions(regions, 2147483647);
+    ASSERT_EQ(1u, chunks.size());
+    EXPECT_EQ(10, chunks[0].beg);
+    EXPECT_EQ(2000000000, chunks[0].end);
+}
+
+TEST(TestRegionChunker, invalidSize) {
+    vector<Region> regions(1, makeRegion(0, 0, 10));
+    EXPECT_THROW(chunkRegions(regions, 0), invalid_argument);
+}
@@ -0,0 +1,68 @@
+#include "io/BamReader.hpp"
+#include "io/Pileup.hpp"
+#include "io/PileupBuffer.hpp"
+#include "io/SiteSummary.hpp"
+#include "utility/TempFile.hpp"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+using namespace std;
+
+namespace {
+    // qualities: A=32, 5=20, !=0, K=42
+    const string sam =
+        "@SQ\tSN:1\tLN:247249719\n"
+        "READ1\t0\t1\t1\t60\t1M\t*\t0\t0\tA\tA\n"
+        "READ2\t0\t1\t1\t60\t1M\t*\t0\t0\tA\t5\n"
+        "READ3\t0\t1\t1\t60\t1M\t*\t0\t0\tA\t!\n"
+        "READ4\t0\t1\t1\t60\t1M\t*\t0\t0\tC\tK\n"
+        "READ5\t0\t1\t1\t60\t1M\t*\t0\t0\tN\tA\n"
+        "READ6\t0\t1\t1\t60\t1M\t*\t0\t0\tG\t5\n"
+        ;
+}
+
+TEST(TestSiteSummary, summarize) {
+    TempDir tmpdir;
+    auto samFile = tmpdir.tempFile(sam);
+    BamReader reader(samFile->path());
+    PileupBuffer buffer;
+    while (BamEntry* e = reader.take())
+        ASSERT_TRUE(buffer.push(e));
+
+    unique_ptr<Pileup> pileup(buffer.pileup(0));
+    ASSERT_EQ(6u, pileup->size());
+
+    int ref = bam_nt16_table[int('A')];
+    SiteSummary summary;
+    summary.summarize(*pileup, ref, 20);
+
+    EXPECT_EQ(6u, summary.depth);
+    EXPECT_EQ(pileup->readsMatching(ref, 20), summary.supporting);
+    EXPECT_EQ(2u, summary.supporting);
+    EXPECT_EQ(5u, summary.qualified);
+
+    int counts[4];
+    pileup->baseCounts(counts);
+    for (int i = 0; i < 4; ++i)
+        EXPECT_EQ(counts[i], summary.baseCounts[i]);
+    EXPECT_EQ(4, summary.baseCounts[0]);
+    EXPECT_EQ(2, summary.baseCounts[1]);
+
+    uint32_t total = 0;
+    for (int q = 0; q < 256; ++q)
+        total += summary.qualityHistogram[q];
+    EXPECT_EQ(summary.qualified, total);
+    EXPECT_EQ(0u, summary.qualityHistogram[0]);
+    EXPECT_EQ(2u, summary.qualityHistogram[20]);
+    EXPECT_EQ(2u, summary.qualityHistogram[32]);
+    EXPECT_EQ(1u, summary.qualityHistogram[42]);
+
+    // the same summary object can be reused
+    summary.summarize(*pileup, ref, 0);
+    EXPECT_EQ(6u, summary.qualified);
+    EXPECT_EQ(1u, summary.qualityHistogram[0]);
+    EXPECT_EQ(3u, summary.supporting);
+}
@@ -0,0 +1,239 @@
+#include "io/BamEntry.hpp"
+#include "io/BamIndexChunks.hpp"
+#include "io/BamReader.hpp"
+#include "io/MappedBamReader.hpp"
+#include "io/RegionLimitedBamReader.hpp"
+#include "io/SamConvert.hpp"
+#include "io/TargetRegions.hpp"
+#include "utility/TempFile.hpp"
+#include "utility/ThreadPool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+    Region makeRegion(int tid, int beg, int end) {
+        Region r;
+        r.tid = tid;
+        r.beg = beg;
+        r.end = end;
+        return r;
+    }
+
+    void expectRegions(vector<Region> const& expected, vector<Region> const& actual) {
+        ASSERT_EQ(expected.size(), actual.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            EXPECT_EQ(expected[i].tid, actual[i].tid) << "region " << i;
+            EXPECT_EQ(expected[i].beg, actual[i].beg) << "region " << i;
+            EXPECT_EQ(expected[i].end, actual[i].end) << "region " << i;
+        }
+    }
+
+    vector<string> takeNames(BamReaderBase& reader) {
+        vector<string> rv;
+        while (BamEntry* e = reader.take()) {
+            rv.push_back(e->name());
+            BamEntry::release(e);
+        }
+        return rv;
+    }
+}
+
+class TestTargetRegions : public ::testing::Test {
+public:
+    void SetUp() {
+        // reads every 50 bases on two sequences, some of them spliced
+        stringstream ss;
+        ss << "@SQ\tSN:1\tLN:1000000\n@SQ\tSN:2\tLN:1000000\n";
+        for (int tid = 1; tid <= 2; ++tid) {
+            for (int pos = 1; pos < 400000; pos += 50) {
+                char const* cigar = pos % 1000 == 1 ? "50M20000N50M" : "100M";
+                ss << "R" << tid << "_" << pos << "\t0\t" << tid << "\t" << pos
+                    << "\t60\t" << cigar << "\t*\t0\t0\t" << string(100, 'A')
+                    << "\t" << string(100, '<') << "\n";
+            }
+        }
+        bamPath = makeIndexedBam(tmpdir, ss.str());
+
+        targets.push_back(makeRegion(0, 1000, 1200));
+        targets.push_back(makeRegion(0, 1300, 1400)); // shares blocks with the last
+        targets.push_back(makeRegion(0, 150000, 150001));
+        targets.push_back(makeRegion(0, 390000, 600000)); // runs past the reads
+        targets.push_back(makeRegion(1, 0, 10));
+        targets.push_back(makeRegion(1, 250000, 260000));
+    }
+
+    // the names of the reads overlapping any target, the hard way
+    vector<string> expectedNames() {
+        BamReader reader(bamPath);
+        vector<string> rv;
+        while (BamEntry* e = reader.take()) {
+            for (auto t = targets.begin(); t != targets.end(); ++t) {
+                if (t->tid == e->tid() && t->beg < int(e->end()) && e->start() < t->end) {
+                    rv.push_back(e->name());
+                    break;
+                }
+            }
+            BamEntry::release(e);
+        }
+        return rv;
+    }
+
+protected:
+    TempDir tmpdir;
+    string bamPath;
+    vector<Region> targets;
+};
+
+TEST_F(TestTargetRegions, merge) {
+    vector<Region> regions;
+    regions.push_back(makeRegion(1, 50, 60));
+    regions.push_back(makeRegion(0, 20, 30));
+    regions.push_back(makeRegion(0, 0, 10));
+    regions.push_back(makeRegion(0, 10, 15)); // abuts
+    regions.push_back(makeRegion(0, 25, 40)); // overlaps
+    regions.push_back(makeRegion(0, 28, 29)); // contained
+    regions.push_back(makeRegion(0, 50, 50)); // empty
+    regions.push_back(makeRegion(1, 0, 50)); // abuts, on another sequence
+
+    vector<Region> expected;
+    expected.push_back(makeRegion(0, 0, 15));
+    expected.push_back(makeRegion(0, 20, 40));
+    expected.push_back(makeRegion(1, 0, 60));
+    expectRegions(expected, mergeRegions(regions));
+    EXPECT_TRUE(mergeRegions(vector<Region>()).empty());
+}
+
+TEST_F(TestTargetRegions, readBed) {
+    BamReader reader(bamPath);
+    stringstream bed;
+    bed << "# hotspots\n"
+        << "track name=panel\n"
+        << "browser position 1:1-100\n"
+        << "\n"
+        << "2\t100\t200\tgene1\n"
+        << "1\t5\t10\n"
+        << "1 8 20 gene2 0 +\n";
+
+    vector<Region> expected;
+    expected.push_back(makeRegion(0, 5, 20));
+    expected.push_back(makeRegion(1, 100, 200));
+    expectRegions(expected, readBedRegions(bed, reader.header(), "test"));
+
+    stringstream unknown("3\t0\t10\n");
+    EXPECT_THROW(readBedRegions(unknown, reader.header(), "test"), runtime_error);
+    stringstream reversed("1\t10\t5\n");
+    EXPECT_THROW(readBedRegions(reversed, reader.header(), "test"), runtime_error);
+    stringstream truncated("1\t10\n");
+    EXPECT_THROW(readBedRegions(truncated, reader.header(), "test"), runtime_error);
+    EXPECT_THROW(readBedRegions(bamPath + ".missing", reader.header()), runtime_error);
+}
+
+TEST_F(TestTargetRegions, mask) {
+    vector<Region> regions;
+    regions.push_back(makeRegion(0, 2, 4));
+    regions.push_back(makeRegion(0, 6, 7));
+    regions.push_back(makeRegion(1, 0, 100));
+
+    uint8_t mask[10];
+    fill(mask, mask + 10, 1);
+    maskOutsideRegions(regions, 0, 0, 10, mask);
+    uint8_t expected[10] = {0, 0, 1, 1, 0, 0, 1, 0, 0, 0};
+    for (int i = 0; i < 10; ++i)
+        EXPECT_EQ(expected[i], mask[i]) << "position " << i;
+
+    // a window starting inside a region
+    fill(mask, mask + 10, 1);
+    maskOutsideRegions(regions, 0, 3, 8, mask);
+    uint8_t shifted[5] = {1, 0, 0, 1, 0};
+    for (int i = 0; i < 5; ++i)
+        EXPECT_EQ(shifted[i], mask[i]) << "position " << i + 3;
+
+    // masked columns stay masked
+    fill(mask, mask + 10, 0);
+    maskOutsideRegions(regions, 1, 10, 20, mask);
+    EXPECT_EQ(10, count(mask, mask + 10, 0));
+
+    fill(mask, mask + 10, 1);
+    maskOutsideRegions(regions, 2, 0, 10, mask);
+    EXPECT_EQ(10, count(mask, mask + 10, 0));
+}
+
+TEST_F(TestTargetRegions, cursor) {
+    vector<Region> regions;
+    regions.push_back(makeRegion(0, 10, 20));
+    regions.push_back(makeRegion(0, 30, 40));
+    regions.push_back(makeRegion(2, 0, 5));
+
+    RegionCursor cursor;
+    EXPECT_FALSE(cursor.overlaps(0, 10, 20));
+    cursor.reset(&regions);
+    EXPECT_FALSE(cursor.overlaps(0, 0, 10));
+    EXPECT_TRUE(cursor.overlaps(0, 5, 11));
+    EXPECT_TRUE(cursor.overlaps(0, 19, 100));
+    EXPECT_FALSE(cursor.overlaps(0, 20, 30));
+    EXPECT_TRUE(cursor.overlaps(0, 25, 31));
+    EXPECT_FALSE(cursor.overlaps(1, 0, 100));
+    EXPECT_FALSE(cursor.done());
+    EXPECT_TRUE(cursor.overlaps(2, 4, 5));
+    EXPECT_FALSE(cursor.overlaps(2, 5, 6));
+    EXPECT_TRUE(cursor.done());
+}
+
+TEST_F(TestTargetRegions, coalescedChunks) {
+    bam_index_t* index = bam_index_load(bamPath.c_str());
+    ASSERT_TRUE(index);
+
+    size_t separate = 0;
+    for (auto t = targets.begin(); t != targets.end(); ++t)
+        separate += bamIndexChunks(index, t->tid, t->beg, t->end).size();
+
+    vector<BgzfChunk> chunks = bamIndexChunks(index, targets);
+    bam_index_destroy(index);
+
+    ASSERT_FALSE(chunks.empty());
+    EXPECT_GT(separate, chunks.size());
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        EXPECT_LT(chunks[i].beg, chunks[i].end);
+        // no block is in two chunks
+        if (i > 0) {
+            EXPECT_LT(chunks[i - 1].end >> 16, chunks[i].beg >> 16) << "chunk " << i;
+        }
+    }
+}
+
+TEST_F(TestTargetRegions, readers) {
+    vector<string> expected = expectedNames();
+    ASSERT_LT(100u, expected.size());
+
+    Region none = { 0, 0, 0 };
+    ThreadPool pool(2);
+    RegionLimitedBamReader samtools(bamPath, none);
+    RegionLimitedBamReader inflated(bamPath, none, &pool);
+    MappedBamReader mapped(bamPath, none);
+    BamReaderBase* readers[] = { &samtools, &inflated, &mapped };
+
+    for (size_t i = 0; i < sizeof(readers) / sizeof(readers[0]); ++i) {
+        SCOPED_TRACE(i);
+        readers[i]->setTargets(targets);
+        EXPECT_FALSE(readers[i]->region());
+        EXPECT_FALSE(readers[i]->skipTo(1, 0));
+        EXPECT_EQ(expected, takeNames(*readers[i]));
+
+        // back to a single region
+        Region r = { 1, 250000, 260000 };
+        readers[i]->setRegion(r);
+        EXPECT_TRUE(readers[i]->region());
+        EXPECT_LT(0u, takeNames(*readers[i]).size());
+    }
+
+    BamReader plain(bamPath);
+    EXPECT_THROW(plain.setTargets(targets), logic_error);
+}
@@ -0,0 +1,107 @@
+#include "io/BamIntersector.hpp"
+#include "io/RegionLimitedBamReader.hpp"
+#include "io/SamConvert.hpp"
+#include "io/TumorDrivenIntersector.hpp"
+#include "utility/TempFile.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <sstream>
+
+using namespace std;
+using namespace std::placeholders;
+
+namespace {
+    // reads of all A every 10 bases, with some of the tumor reads carrying a
+    // C at the given positions
+    string makeSam(int nReads, vector<int> const& variants) {
+        stringstream ss;
+        ss << "@SQ\tSN:1\tLN:1000000\n";
+        for (int i = 0; i < nReads; ++i) {
+            int start = i * 10;
+            string seq(50, 'A');
+            for (auto v = variants.begin(); v != variants.end(); ++v) {
+                if (*v >= start && *v < start + 50 && i % 2 == 0)
+                    seq[*v - start] = 'C';
+            }
+            ss << "READ" << i << "\t0\t1\t" << (start + 1) << "\t60\t50M\t*\t0\t0\t"
+                << seq << "\t" << string(50, '<') << "\n";
+        }
+        return ss.str();
+    }
+
+    uint32_t allA(int tid, uint32_t begin, uint32_t end, uint8_t* ref) {
+        fill(ref, ref + (end - begin), bam_nt16_table[int('A')]);
+        return end - begin;
+    }
+
+    struct Collector {
+        void collect(int32_t pos, const Pileup& normal, const Pileup& tumor) {
+            results[pos] = make_pair(normal.size(), tumor.size());
+        }
+
+        map<int32_t, pair<uint32_t, uint32_t>> results;
+    };
+}
+
+class TestTumorDrivenIntersector : public ::testing::Test {
+public:
+    void SetUp() {
+        // two variants close together, and one far from them
+        variants.push_back(2100);
+        variants.push_back(2200);
+        variants.push_back(7000);
+
+        normalBamPath = makeIndexedBam(tmpdir, makeSam(1000, vector<int>()));
+        tumorBamPath = makeIndexedBam(tmpdir, makeSam(1000, variants));
+    }
+
+protected:
+    TempDir tmpdir;
+    vector<int> variants;
+    string normalBamPath;
+    string tumorBamPath;
+};
+
+TEST_F(TestTumorDrivenIntersector, fetchesNormalAtCandidates) {
+    Region all = { 0, 0, 1000000 };
+
+    Collector expected;
+    {
+        RegionLimitedBamReader normal(normalBamPath, all);
+        RegionLimitedBamReader tumor(tumorBamPath, all);
+        BamIntersector intersector(normal, tumor,
+            bind(&Collector::collect, &expected, _1, _2, _3));
+        intersector.setCandidateFilter(allA, 0);
+        intersector.run();
+    }
+    ASSERT_EQ(variants.size(), expected.results.size());
+
+    RegionLimitedBamReader normal(normalBamPath, all);
+    RegionLimitedBamReader tumor(tumorBamPath, all);
+    Collector collector;
+    TumorDrivenIntersector intersector(normal, tumor,
+        bind(&Collector::collect, &collector, _1, _2, _3), allA, 0);
+    intersector.run();
+
+    EXPECT_EQ(expected.results, collector.results);
+    EXPECT_EQ(2u, intersector.normalQueries());
+}
+
+TEST_F(TestTumorDrivenIntersector, minDepth) {
+    Region all = { 0, 0, 1000000 };
+    RegionLimitedBamReader normal(normalBamPath, all);
+    RegionLimitedBamReader tumor(tumorBamPath, all);
+    Collector collector;
+    TumorDrivenIntersector intersector(normal, tumor,
+        bind(&Collector::collect, &collector, _1, _2, _3), allA, 0);
+    // every position has 5 reads in each sample
+    intersector.setMinDepth(5, 6);
+    intersector.run();
+
+    EXPECT_TRUE(collector.results.empty());
+    EXPECT_EQ(0u, intersector.normalQueries());
+}
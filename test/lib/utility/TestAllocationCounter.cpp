@@ -0,0 +1,18 @@
+#include "utility/AllocationCounter.hpp"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+TEST(TestAllocationCounter, count) {
+    uint64_t before = AllocationCounter::count();
+    std::unique_ptr<int> p(new int(1));
+    std::vector<int> v(100);
+    uint64_t after = AllocationCounter::count();
+
+    if (AllocationCounter::enabled())
+        EXPECT_EQ(before + 2, after);
+    else
+        EXPECT_EQ(0u, after);
+}
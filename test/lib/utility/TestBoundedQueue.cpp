@@ -0,0 +1,100 @@
+#include "utility/BoundedQueue.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+TEST(TestBoundedQueue, singleThreaded) {
+    BoundedQueue<int> q(3);
+    EXPECT_EQ(3u, q.capacity());
+    EXPECT_EQ(0u, q.size());
+
+    int x;
+    EXPECT_FALSE(q.tryPop(x));
+
+    for (int i = 0; i < 3; ++i) {
+        x = i;
+        EXPECT_TRUE(q.tryPush(x));
+    }
+    x = 3;
+    EXPECT_FALSE(q.tryPush(x));
+    EXPECT_EQ(3u, q.size());
+
+    // wrap around the end of the ring a few times
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_TRUE(q.tryPop(x));
+        EXPECT_EQ(i, x);
+        x = i + 3;
+        EXPECT_TRUE(q.tryPush(x));
+    }
+
+    QueueStats stats = q.stats();
+    EXPECT_EQ(3u, stats.capacity);
+    EXPECT_EQ(13u, stats.pushes);
+    EXPECT_EQ(2u, stats.maxOccupancy);
+    // 0, 1, 2, then 2 for each of the 10 pushes after a pop
+    EXPECT_EQ(23u, stats.occupancySum);
+}
+
+TEST(TestBoundedQueue, closeDrainsRemaining) {
+    BoundedQueue<int> q(4);
+    int x = 1;
+    q.push(x);
+    x = 2;
+    q.push(x);
+    q.close();
+
+    ASSERT_TRUE(q.pop(x));
+    EXPECT_EQ(1, x);
+    ASSERT_TRUE(q.pop(x));
+    EXPECT_EQ(2, x);
+    EXPECT_FALSE(q.pop(x));
+}
+
+TEST(TestBoundedQueue, cancelUnblocksProducer) {
+    BoundedQueue<int> q(1);
+    bool lastPush = true;
+    thread producer([&]() {
+        for (int i = 0; i < 10 && lastPush; ++i)
+            lastPush = q.push(i);
+    });
+
+    int x;
+    ASSERT_TRUE(q.pop(x));
+    EXPECT_EQ(0, x);
+    q.cancel();
+    producer.join();
+    EXPECT_FALSE(lastPush);
+}
+
+TEST(TestBoundedQueue, producerConsumer) {
+    size_t const n = 100000;
+    BoundedQueue<vector<size_t>> q(8);
+
+    thread producer([&]() {
+        for (size_t i = 0; i < n; ++i) {
+            vector<size_t> v(1, i);
+            q.push(v);
+        }
+        q.close();
+    });
+
+    size_t expected = 0;
+    vector<size_t> v;
+    while (q.pop(v)) {
+        ASSERT_EQ(1u, v.size());
+        ASSERT_EQ(expected, v[0]);
+        ++expected;
+    }
+    producer.join();
+
+    EXPECT_EQ(n, expected);
+    QueueStats stats = q.stats();
+    EXPECT_EQ(n, stats.pushes);
+    EXPECT_LE(stats.maxOccupancy, 8u);
+    EXPECT_LE(stats.meanOccupancy(), 8.0);
+}
@@ -0,0 +1,90 @@
+#include "utility/OrderedTaskRunner.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstddef>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+TEST(TestOrderedTaskRunner, outputInTaskOrder) {
+    size_t const nTasks = 200;
+    OrderedTaskRunner runner(4, 8);
+
+    auto task = [](uint32_t worker, size_t idx, string& out) {
+        // make early tasks finish last
+        if (idx % 7 == 0)
+            this_thread::sleep_for(chrono::microseconds(200));
+        stringstream ss;
+        ss << idx << "\n";
+        out = ss.str();
+    };
+
+    string actual;
+    auto sink = [&](string const& s) { actual += s; };
+    runner.run(nTasks, task, sink);
+
+    stringstream expected;
+    for (size_t i = 0; i < nTasks; ++i)
+        expected << i << "\n";
+    EXPECT_EQ(expected.str(), actual);
+}
+
+TEST(TestOrderedTaskRunner, workerIds) {
+    OrderedTaskRunner runner(3, 3);
+    vector<int> busy(runner.threads(), 0);
+    bool overlapped = false;
+    bool outOfRange = false;
+
+    auto task = [&](uint32_t worker, size_t idx, string& out) {
+        if (worker >= busy.size()) {
+            outOfRange = true;
+            return;
+        }
+        // a worker id is never in use by two tasks at once
+        if (busy[worker]++)
+            overlapped = true;
+        this_thread::sleep_for(chrono::microseconds(50));
+        --busy[worker];
+    };
+
+    runner.run(50, task, [](string const&) {});
+    EXPECT_FALSE(outOfRange);
+    EXPECT_FALSE(overlapped);
+}
+
+TEST(TestOrderedTaskRunner, noTasks) {
+    OrderedTaskRunner runner(2, 2);
+    size_t calls = 0;
+    runner.run(0,
+        [&](uint32_t, size_t, string&) { ++calls; },
+        [&](string const&) { ++calls; });
+    EXPECT_EQ(0u, calls);
+}
+
+TEST(TestOrderedTaskRunner, taskException) {
+    OrderedTaskRunner runner(2, 4);
+    auto task = [](uint32_t, size_t idx, string& out) {
+        if (idx == 10)
+            throw runtime_error("task failed");
+        out = "x";
+    };
+
+    size_t written = 0;
+    EXPECT_THROW(
+        runner.run(1000, task, [&](string const&) { ++written; }),
+        runtime_error);
+    EXPECT_LE(written, 10u);
+}
+
+TEST(TestOrderedTaskRunner, sinkException) {
+    OrderedTaskRunner runner(2, 4);
+    auto task = [](uint32_t, size_t, string& out) { out = "x"; };
+    auto sink = [](string const&) { throw runtime_error("sink failed"); };
+    EXPECT_THROW(runner.run(100, task, sink), runtime_error);
+}
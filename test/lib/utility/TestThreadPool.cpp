@@ -0,0 +1,49 @@
+#include "utility/ThreadPool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+TEST(TestThreadPool, runsJobs) {
+    ThreadPool pool(3);
+    EXPECT_EQ(3u, pool.threads());
+
+    vector<int> results(100, 0);
+    vector<future<void>> done;
+    for (size_t i = 0; i < results.size(); ++i)
+        done.push_back(pool.submit([&results, i]() { results[i] = i * i; }));
+
+    for (size_t i = 0; i < done.size(); ++i) {
+        done[i].get();
+        EXPECT_EQ(int(i * i), results[i]);
+    }
+}
+
+TEST(TestThreadPool, exceptions) {
+    ThreadPool pool(2);
+    future<void> bad = pool.submit([]() { throw runtime_error("oops"); });
+    future<void> good = pool.submit([]() {});
+    EXPECT_THROW(bad.get(), runtime_error);
+    EXPECT_NO_THROW(good.get());
+}
+
+TEST(TestThreadPool, destructorFinishesJobs) {
+    atomic<int> count(0);
+    {
+        ThreadPool pool(1);
+        for (int i = 0; i < 50; ++i)
+            pool.submit([&count]() { ++count; });
+    }
+    EXPECT_EQ(50, count.load());
+}
+
+TEST(TestThreadPool, atLeastOneThread) {
+    ThreadPool pool(0);
+    EXPECT_EQ(1u, pool.threads());
+    pool.submit([]() {}).get();
+}